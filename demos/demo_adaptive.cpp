@@ -0,0 +1,144 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <RCCircuit.hpp>
+
+using namespace ASC_ode;
+
+
+// pendulum, x = (phi, phi')
+class Pendulum : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = -9.81*sin(x(0));
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    df(0,1) = 1;
+    df(1,0) = -9.81*cos(x(0));
+  }
+};
+
+
+// fixed step RK4 with N steps vs. the embedded pairs at several tolerances
+void compare (std::string name, std::shared_ptr<NonlinearFunction> rhs,
+              Vector<> y0, double tend)
+{
+  Vector<> ref(y0.size()), y(y0.size());
+  {
+    EmbeddedRungeKutta stepper(rhs, DormandPrince54(), Tolerance(1e-13, 1e-15));
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  std::cout << name << std::endl;
+  std::cout << std::setw(24) << "method" << std::setw(12) << "rhs evals"
+            << std::setw(10) << "accepted" << std::setw(10) << "rejected"
+            << std::setw(14) << "error" << std::endl;
+
+  auto tableau = RK4();
+  ExplicitRungeKutta rk4(rhs, tableau.a, tableau.b, tableau.c);
+  for (int steps : { 100, 1000, 10000 })
+    {
+      y = y0;
+      for (int i = 0; i < steps; i++)
+        rk4.DoStep(tend/steps, y);
+      std::cout << std::setw(24) << "RK4 N=" + std::to_string(steps) << std::setw(12) << 4*steps
+                << std::setw(10) << steps << std::setw(10) << 0
+                << std::setw(14) << norm(y-ref) << std::endl;
+    }
+
+  struct { std::string name; EmbeddedTableau tab; } pairs[] =
+    { { "BS3(2)", BogackiShampine32() }, { "DP5(4)", DormandPrince54() }, { "Verner6(5)", Verner65() } };
+  for (auto & pair : pairs)
+    for (double tol : { 1e-4, 1e-6, 1e-8 })
+      {
+        EmbeddedRungeKutta stepper(rhs, pair.tab, Tolerance(tol, tol));
+        y = y0;
+        auto stats = SolveAdaptive(stepper, tend, y);
+        std::ostringstream label;
+        label << pair.name << " tol=" << tol;
+        std::cout << std::setw(24) << label.str() << std::setw(12) << stats.evaluations
+                  << std::setw(10) << stats.accepted << std::setw(10) << stats.rejected
+                  << std::setw(14) << norm(y-ref) << std::endl;
+      }
+  std::cout << std::endl;
+}
+
+
+// sampling on a fine output grid: dense output vs. steps on the output times
+void compareOutput (std::shared_ptr<NonlinearFunction> rhs, Vector<> y0, double tend, int samples)
+{
+  std::vector<double> times;
+  for (int i = 0; i <= samples; i++)
+    times.push_back(tend*i/samples);
+
+  // reference values at the output times
+  std::vector<Vector<>> ref;
+  {
+    EmbeddedRungeKutta stepper(rhs, DormandPrince54(), Tolerance(1e-13, 1e-15));
+    Vector<> y = y0;
+    SolveDenseOutput(stepper, times, y, [&](double t, VectorView<double> yt) { ref.push_back(Vector<>(yt)); });
+  }
+
+  std::cout << "pendulum sampled at " << samples+1 << " output times" << std::endl;
+  std::cout << std::setw(24) << "method" << std::setw(12) << "rhs evals"
+            << std::setw(14) << "max error" << std::endl;
+
+  auto maxError = [&](auto solve)
+  {
+    double err = 0;
+    size_t i = 0;
+    Vector<> y = y0;
+    solve(y, [&](double t, VectorView<double> yt) { err = std::max(err, norm(yt-ref[i++])); });
+    return err;
+  };
+
+  auto tableau = RK4();
+  ExplicitRungeKutta rk4(rhs, tableau.a, tableau.b, tableau.c);
+  double err = maxError([&](Vector<> & y, auto output)
+  {
+    output(0, y);
+    for (int i = 0; i < samples; i++)
+      {
+        rk4.DoStep(tend/samples, y);
+        output(times[i+1], y);
+      }
+  });
+  std::cout << std::setw(24) << "RK4 on output grid" << std::setw(12) << 4*samples
+            << std::setw(14) << err << std::endl;
+
+  for (double tol : { 1e-6, 1e-8, 1e-10 })
+    {
+      EmbeddedRungeKutta stepper(rhs, DormandPrince54(), Tolerance(tol, tol));
+      StepStatistics stats;
+      double err = maxError([&](Vector<> & y, auto output) { stats = SolveDenseOutput(stepper, times, y, output); });
+      std::ostringstream label;
+      label << "DP5(4) dense tol=" << tol;
+      std::cout << std::setw(24) << label.str() << std::setw(12) << stats.evaluations
+                << std::setw(14) << err << std::endl;
+    }
+  std::cout << std::endl;
+}
+
+
+int main()
+{
+  compare ("pendulum, phi0 = 1, t in [0,10]", std::make_shared<Pendulum>(), Vector<>{ 1, 0 }, 10);
+  // time is the second state variable
+  compare ("RC circuit, R = 100, C = 1e-6, t in [0,0.2]",
+           std::make_shared<RCCircuit>(100, 1e-6), Vector<>{ 1, 0 }, 0.2);
+  compareOutput (std::make_shared<Pendulum>(), Vector<>{ 1, 0 }, 10, 2000);
+}
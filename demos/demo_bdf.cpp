@@ -0,0 +1,87 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+#include <bdf.hpp>
+#include <RCCircuit.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  RC ladder networks of growing size: variable order BDF with dense
+  and sparse Newton matrices against the 3-stage Radau IIA method.
+*/
+int main()
+{
+  double tend = 0.1;
+
+  auto timed = [](auto func)
+  {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  };
+
+  for (size_t sections : { 50, 400 })
+    {
+      auto rhs = std::make_shared<RCLadder>(sections, 100, 1e-6);
+      Vector<> y0(sections+1);
+      y0 = 0.0;
+
+      Vector<> ref(sections+1), y(sections+1);
+      {
+        BDF stepper(rhs, Tolerance(1e-12, 1e-12), 5, true);
+        ref = y0;
+        SolveAdaptive(stepper, tend, ref);
+      }
+
+      std::cout << "RC ladder with " << sections << " sections, t in [0," << tend << "]" << std::endl;
+      std::cout << std::setw(24) << "method" << std::setw(8) << "steps" << std::setw(6) << "rej"
+                << std::setw(8) << "evals" << std::setw(6) << "jac" << std::setw(6) << "LU"
+                << std::setw(22) << "steps at order 1..5"
+                << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+      for (bool sparse : { false, true })
+        for (double tol : { 1e-4, 1e-6, 1e-8 })
+          {
+            BDF stepper(rhs, Tolerance(tol, tol), 5, sparse);
+            y = y0;
+            StepStatistics stats;
+            double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+
+            std::ostringstream label, orders;
+            label << (sparse ? "BDF sparse" : "BDF dense") << " tol=" << tol;
+            for (int q = 1; q <= 5; q++)
+              orders << " " << stepper.stepsWithOrder(q);
+            std::cout << std::setw(24) << label.str() << std::setw(8) << stats.accepted
+                      << std::setw(6) << stats.rejected << std::setw(8) << stats.evaluations
+                      << std::setw(6) << stepper.jacobians()
+                      << std::setw(6) << stepper.jacobianReuse().factorizations
+                      << std::setw(22) << orders.str()
+                      << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+          }
+
+      for (double tol : { 1e-4, 1e-6 })
+        {
+          RadauIIA stepper(rhs, 3, Tolerance(tol, tol));
+          y = y0;
+          StepStatistics stats;
+          double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+          std::ostringstream label;
+          label << "RadauIIA(5) tol=" << tol;
+          std::cout << std::setw(24) << label.str() << std::setw(8) << stats.accepted
+                    << std::setw(6) << stats.rejected << std::setw(8) << stats.evaluations
+                    << std::setw(6) << "-"
+                    << std::setw(6) << stepper.jacobianReuse().factorizations
+                    << std::setw(22) << "-"
+                    << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+        }
+      std::cout << std::endl;
+    }
+}
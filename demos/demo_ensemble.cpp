@@ -0,0 +1,175 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <functional>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <ensemble.hpp>
+#include <RCCircuit.hpp>
+
+using namespace ASC_ode;
+
+
+// phi'' = -g/L sin(phi), x = (phi, phi'), the parameter is the length L
+class PendulumEnsemble
+{
+public:
+  static constexpr size_t dim = 2;
+  static constexpr size_t params = 1;
+
+  template <size_t W>
+  void evaluate (const double * x, const double * p, double * f) const
+  {
+    for (size_t l = 0; l < W; l++)
+      {
+        f[l] = x[W+l];
+        f[W+l] = -9.81 / p[l] * std::sin(x[l]);
+      }
+  }
+};
+
+
+static double timed (std::function<void()> func)
+{
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+static void report (std::string name, size_t members, double time, double error)
+{
+  std::cout << std::setw(28) << name << std::setw(10) << members << std::setw(12) << time
+            << std::setw(16) << members/time << std::setw(14) << error << std::endl;
+}
+
+
+/*
+  Parameter sweep over RC circuits: every (R, C, U_C(0)) combination is
+  one member, all are integrated with classical RK4 on the same time grid.
+  The scalar path runs ExplicitRungeKutta::DoStep member by member, the
+  ensemble integrates chunks of EnsembleLanes members with vectorized
+  loops on a work stealing pool. The demo fails if the ensemble differs
+  from the scalar path, if a single output is not the final state, or if
+  members with R C below the stability bound of the step are not
+  reported as diverged.
+*/
+int main()
+{
+  auto tableau = RK4();
+
+  size_t nR = 32, nC = 32, nU = 8;
+  size_t members = nR*nC*nU;
+  double tend = 0.02;
+  size_t steps = 2000, outputs = 21;
+
+  Matrix<> y0(members, 2), params(members, 2);
+  for (size_t i = 0, m = 0; i < nR; i++)
+    for (size_t j = 0; j < nC; j++)
+      for (size_t k = 0; k < nU; k++, m++)
+        {
+          params(m, 0) = 50 + 150.0*i/(nR-1);
+          params(m, 1) = 0.5e-6 + 1.5e-6*j/(nC-1);
+          y0(m, 0) = -1 + 2.0*k/(nU-1);
+          y0(m, 1) = 0;
+        }
+
+  ThreadPool pool;
+  std::cout << "RC circuits, " << members << " members, " << steps << " RK4 steps, "
+            << pool.size() << " threads" << std::endl;
+  std::cout << std::setw(28) << "method" << std::setw(10) << "members" << std::setw(12) << "time [s]"
+            << std::setw(16) << "trajectories/s" << std::setw(14) << "diff" << std::endl;
+
+  // the scalar path on every 8th member, the reference for the others
+  size_t stride = 8;
+  Vector<> scalar(members/stride);
+  double time = timed([&]
+  {
+    for (size_t m = 0; m < members; m += stride)
+      {
+        ExplicitRungeKutta stepper(std::make_shared<RCCircuit>(params(m,0), params(m,1)), tableau.a, tableau.b, tableau.c);
+        Vector<> y = { y0(m,0), y0(m,1) };
+        for (size_t i = 0; i < steps; i++)
+          stepper.DoStep(tend/steps, y);
+        scalar(m/stride) = y(0);
+      }
+  });
+  report("scalar DoStep", members/stride, time, 0);
+
+  Vector<> out(members*outputs*2);
+  auto diff = [&]()
+  {
+    double err = 0;
+    for (size_t m = 0; m < members; m += stride)
+      err = std::max(err, std::fabs(out((m*outputs + outputs-1)*2) - scalar(m/stride)));
+    return err;
+  };
+
+  RCCircuitEnsemble rc;
+  {
+    ThreadPool single(1);
+    auto stats = SolveEnsemble<RCCircuitEnsemble,1>(rc, tableau.a, tableau.b, tableau.c, tend, steps, y0, params, outputs, out, single);
+    report("ensemble, 1 lane, 1 thread", members, stats.time, diff());
+    stats = SolveEnsemble(rc, tableau.a, tableau.b, tableau.c, tend, steps, y0, params, outputs, out, single);
+    report("ensemble, " + std::to_string(EnsembleLanes) + " lanes, 1 thread", members, stats.time, diff());
+  }
+  auto stats = SolveEnsemble(rc, tableau.a, tableau.b, tableau.c, tend, steps, y0, params, outputs, out, pool);
+  report("ensemble, " + std::to_string(EnsembleLanes) + " lanes, pool", members, stats.time, diff());
+  bool ok = diff() < 1e-12 && stats.diverged == 0;
+
+  {
+    // only the final states
+    Vector<> last(members*2);
+    SolveEnsemble(rc, tableau.a, tableau.b, tableau.c, tend, steps, y0, params, 1, last, pool);
+    double err = 0;
+    for (size_t m = 0; m < members; m++)
+      err = std::max(err, std::fabs(last(m*2) - out((m*outputs + outputs-1)*2)));
+    std::cout << "one output: |U_C(tend) - last of " << outputs << " outputs| = " << err << std::endl;
+    ok = ok && err == 0;
+
+    // RK4 is stable for tau < 2.8 R C, here only for the larger C
+    Matrix<> unstable = params;
+    size_t expected = 0;
+    for (size_t m = 0; m < members; m++)
+      {
+        unstable(m, 1) = m % 2 ? 1e-7 : 1e-8;
+        if (tend/steps > 2.8 * unstable(m,0) * unstable(m,1)) expected++;
+      }
+    stats = SolveEnsemble(rc, tableau.a, tableau.b, tableau.c, tend, steps, y0, unstable, outputs, out, pool);
+    std::cout << "C = 1e-8, 1e-7: " << stats.diverged << " of " << members << " members diverged, "
+              << expected << " beyond the stability bound" << std::endl;
+    ok = ok && stats.diverged == expected;
+  }
+
+
+  // pendulum: lengths and initial angles
+  size_t nL = 100, nphi = 100;
+  members = nL*nphi;
+  tend = 10;
+  steps = 1000;
+  outputs = 11;
+  Matrix<> py0(members, 2), pparams(members, 1);
+  for (size_t i = 0, m = 0; i < nL; i++)
+    for (size_t j = 0; j < nphi; j++, m++)
+      {
+        pparams(m, 0) = 0.5 + 1.5*i/(nL-1);
+        py0(m, 0) = 3.0*(j+1)/nphi;
+        py0(m, 1) = 0;
+      }
+  Vector<> pout(members*outputs*2);
+  stats = SolveEnsemble(PendulumEnsemble(), tableau.a, tableau.b, tableau.c, tend, steps, py0, pparams, outputs, pout, pool);
+
+  std::cout << std::endl << "pendulum, " << members << " members, " << steps << " RK4 steps: "
+            << stats.time << " s, " << stats.trajectoriesPerSecond() << " trajectories/s" << std::endl;
+  std::cout << "phi(t) for L = " << pparams(members-1, 0) << ", phi0 = " << py0(members-1, 0) << ":";
+  for (size_t k = 0; k < outputs; k++)
+    std::cout << " " << pout(((members-1)*outputs + k)*2);
+  std::cout << std::endl;
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <cmath>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <events.hpp>
+#include <RCCircuit.hpp>
+
+using namespace ASC_ode;
+
+
+// a ball under gravity, x = (height, velocity)
+class Ball : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = -9.81;
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    df(0,1) = 1;
+  }
+};
+
+
+/*
+  Events instead of fine steps:
+  - a bouncing ball, the impact is a terminal event, the velocity is
+    reversed and the integration restarted from there
+  - the capacitor voltage of the RC circuit crossing a threshold, rising
+    and falling crossings are non-terminal events
+  The event times are compared with the exact impacts, and with a clock
+  event at t = 3 across the restarts, and the crossings with a tightly
+  integrated reference. Exits with failure on a mismatch.
+*/
+int main()
+{
+  std::cout << std::setprecision(10);
+  bool ok = true;
+  double restitution = 0.8, g = 9.81;
+
+  std::cout << "bouncing ball, h0 = 10, restitution " << restitution << std::endl;
+  std::cout << std::setw(10) << "root" << std::setw(8) << "bounce" << std::setw(18) << "t"
+            << std::setw(18) << "error" << std::setw(8) << "steps" << std::endl;
+  for (auto method : { RootMethod::BRENT, RootMethod::ILLINOIS })
+    {
+      EmbeddedRungeKutta stepper(std::make_shared<Ball>(), DormandPrince54(), Tolerance(1e-8, 1e-8));
+      std::vector<Event> events =
+        {
+          { [](double t, VectorView<double> x) { return x(0); }, true, -1 },
+          { [](double t, VectorView<double> x) { return t - 3; } },
+        };
+      Vector<> x = { 10, 0 };
+      double t = 0, exact = std::sqrt(2*10/g), v = std::sqrt(2*g*10);
+      std::vector<double> clock;
+      for (int bounce = 1; bounce <= 5; bounce++)
+        {
+          auto stats = SolveEvents(stepper, t, t+100, x, events, 0, nullptr, method);
+          t = stats.t;
+          for (auto & occ : stats.occurrences)
+            if (occ.event == 1) clock.push_back(occ.t);
+          std::cout << std::setw(10) << (method == RootMethod::BRENT ? "Brent" : "Illinois")
+                    << std::setw(8) << bounce << std::setw(18) << t << std::setw(18) << t-exact
+                    << std::setw(8) << stats.accepted << std::endl;
+          ok = ok && stats.terminated && std::fabs(t-exact) < 1e-6;
+          x(0) = 0;
+          x(1) *= -restitution;
+          v *= restitution;
+          exact += 2*v/g;
+        }
+      ok = ok && clock.size() == 1 && std::fabs(clock[0] - 3) < 1e-10;
+    }
+
+
+  // x = (U_C, t), U_C follows the source cos(omega t) with a phase lag
+  auto rhs = std::make_shared<RCCircuit>(100, 1e-6);
+  double tend = 0.1, threshold = 0.5;
+  std::vector<Event> events =
+    {
+      { [=](double t, VectorView<double> x) { return x(0) - threshold; }, false, 1 },
+      { [=](double t, VectorView<double> x) { return x(0) - threshold; }, false, -1 },
+    };
+
+  EmbeddedRungeKutta refstepper(rhs, DormandPrince54(), Tolerance(1e-12, 1e-14));
+  Vector<> x = { 0, 0 };
+  auto ref = SolveEvents(refstepper, 0, tend, x, events);
+
+  std::cout << std::setprecision(4);
+  std::cout << std::endl << "RC circuit, U_C crossing " << threshold << " in [0," << tend << "]" << std::endl;
+  std::cout << std::setw(24) << "method" << std::setw(10) << "steps" << std::setw(10) << "events"
+            << std::setw(14) << "max error" << std::endl;
+  for (int digits : { 4, 6, 8 })
+    {
+      double tol = std::pow(10.0, -digits);
+      EmbeddedRungeKutta stepper(rhs, DormandPrince54(), Tolerance(tol, tol));
+      x = { 0, 0 };
+      auto stats = SolveEvents(stepper, 0, tend, x, events);
+      double err = 0;
+      for (size_t i = 0; i < std::min(stats.occurrences.size(), ref.occurrences.size()); i++)
+        err = std::max(err, std::fabs(stats.occurrences[i].t - ref.occurrences[i].t));
+      std::cout << std::setw(24) << "DOPRI5, tol 1e-" + std::to_string(digits)
+                << std::setw(10) << stats.accepted << std::setw(10) << stats.occurrences.size()
+                << std::setw(14) << err << std::endl;
+      ok = ok && stats.occurrences.size() == ref.occurrences.size() && err < 10*tol;
+    }
+
+  // fixed steps: checking the sign at the step ends only, and with events
+  auto tableau = RK4();
+  for (size_t steps : { 1000, 10000, 100000 })
+    {
+      ExplicitRungeKutta stepper(rhs, tableau.a, tableau.b, tableau.c);
+      x = { 0, 0 };
+      double uold = 0, err = 0;
+      size_t found = 0;
+      for (size_t i = 1; i <= steps; i++)
+        {
+          stepper.DoStep(tend/steps, x);
+          if ((uold - threshold) * (x(0) - threshold) < 0)
+            {
+              if (found < ref.occurrences.size())
+                err = std::max(err, std::fabs(i*tend/steps - ref.occurrences[found].t));
+              found++;
+            }
+          uold = x(0);
+        }
+      std::cout << std::setw(24) << "RK4, step ends" << std::setw(10) << steps
+                << std::setw(10) << found << std::setw(14) << err << std::endl;
+    }
+  {
+    ExplicitRungeKutta stepper(rhs, tableau.a, tableau.b, tableau.c);
+    x = { 0, 0 };
+    auto stats = SolveEvents(stepper, tend/1000, 0, tend, x, events);
+    double err = 0;
+    for (size_t i = 0; i < std::min(stats.occurrences.size(), ref.occurrences.size()); i++)
+      err = std::max(err, std::fabs(stats.occurrences[i].t - ref.occurrences[i].t));
+    std::cout << std::setw(24) << "RK4, events" << std::setw(10) << stats.accepted
+              << std::setw(10) << stats.occurrences.size() << std::setw(14) << err << std::endl;
+    ok = ok && stats.occurrences.size() == ref.occurrences.size() && err < 1e-5;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+#include <exponential.hpp>
+#include <mass_spring.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  Exponential Rosenbrock methods on a long hanging spring chain: the stiff
+  spring modes are integrated exactly by phi-functions computed with
+  Jacobian-vector products, against the implicit Radau IIA method.
+  A stiff linear system smaller than the Krylov dimension must be
+  integrated exactly in one step of any size, the demo fails otherwise.
+*/
+int main()
+{
+  MassSpringSystem<2> mss;
+  mss.setGravity( {0,-9.81} );
+  auto prev = mss.addFix( { { 0.0, 0.0 } } );
+  for (int i = 0; i < 50; i++)
+    {
+      auto m = mss.addMass( { 1, { 0.1*(i+1), 0.0 } } );
+      mss.addSpring( { 0.1, 1e5, { prev, m } } );
+      prev = m;
+    }
+  auto rhs = std::make_shared<MSS_FirstOrder<2>>(mss);
+
+  size_t nq = 2*mss.masses().size();
+  Vector<> y0(2*nq), x(nq), dx(nq), ddx(nq);
+  mss.getState(x, dx, ddx);
+  y0.range(0, nq) = x;
+  y0.range(nq, 2*nq) = dx;
+
+  double tend = 1;
+  Vector<> ref(2*nq), y(2*nq);
+  {
+    RadauIIA stepper(rhs, 5, Tolerance(1e-12, 1e-12));
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  auto timed = [](auto func)
+  {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  };
+
+  std::cout << "Hanging chain, 50 masses, k = 1e5, t in [0," << tend << "]" << std::endl;
+  std::cout << std::setw(24) << "method" << std::setw(8) << "steps" << std::setw(6) << "rej"
+            << std::setw(8) << "evals" << std::setw(10) << "J*v" << std::setw(8) << "Krylov"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+  for (double tol : { 1e-4, 1e-6, 1e-8 })
+    {
+      for (int order : { 3, 4 })
+        {
+          ExponentialRosenbrock stepper(rhs, order, Tolerance(tol, tol));
+          y = y0;
+          StepStatistics stats;
+          double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+          std::ostringstream label;
+          label << "exprb" << order << (order == 3 ? "2" : "3") << " tol=" << tol;
+          std::cout << std::setw(24) << label.str() << std::setw(8) << stats.accepted
+                    << std::setw(6) << stats.rejected << std::setw(8) << stats.evaluations
+                    << std::setw(10) << stepper.matvecs() << std::setw(8) << stepper.maxKrylovDimension()
+                    << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+        }
+
+      if (tol < 1e-7) continue;
+      RadauIIA stepper(rhs, 3, Tolerance(tol, tol));
+      y = y0;
+      StepStatistics stats;
+      double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+      std::ostringstream label;
+      label << "RadauIIA(5) tol=" << tol;
+      std::cout << std::setw(24) << label.str() << std::setw(8) << stats.accepted
+                << std::setw(6) << stats.rejected << std::setw(8) << stats.evaluations
+                << std::setw(10) << "-" << std::setw(8) << "-"
+                << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+    }
+
+  // fixed steps far beyond the period of the fastest spring mode
+  std::cout << std::endl << "fixed steps, exprb43" << std::endl;
+  for (int steps : { 50, 100, 200, 400 })
+    {
+      ExponentialRosenbrock stepper(rhs, 4, Tolerance(1e-8, 1e-8));
+      y = y0;
+      for (int i = 0; i < steps; i++)
+        stepper.DoStep(tend/steps, y);
+      std::cout << "tau = " << std::setw(8) << tend/steps << ", error = " << norm(y-ref)
+                << ", Krylov dimension up to " << stepper.maxKrylovDimension() << std::endl;
+    }
+
+  // y' = A y with eigenvalues down to -1e4: the Krylov space is the whole space
+  bool ok = true;
+  std::cout << std::endl << "linear system, 6 unknowns, t in [0,1]" << std::endl;
+  {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> uni(-1, 1);
+    Matrix<> a(6, 6);
+    for (size_t i = 0; i < 6; i++)
+      for (size_t j = 0; j < 6; j++)
+        a(i,j) = (i == j ? -std::pow(10.0, 0.8*i) : uni(gen));
+    auto linear = std::make_shared<MatVecFunc>(a, 1);
+    Vector<> z0(6), zref(6), z(6);
+    for (size_t i = 0; i < 6; i++)
+      z0(i) = 1;
+    RadauIIA reference(linear, 5, Tolerance(1e-13, 1e-13));
+    zref = z0;
+    SolveAdaptive(reference, 1, zref);
+    for (int order : { 3, 4 })
+      {
+        ExponentialRosenbrock stepper(linear, order);
+        z = z0;
+        stepper.DoStep(1, z);
+        double err = norm(z-zref) / norm(zref);
+        std::cout << "exprb" << order << (order == 3 ? "2" : "3") << ", one step: relative error "
+                  << err << ", Krylov dimension " << stepper.maxKrylovDimension() << std::endl;
+        ok = ok && err < 1e-9;
+      }
+
+    // a Krylov dimension of 3 needs halved steps, the dense output covers the whole step
+    ExponentialRosenbrock stepper(linear, 4, Tolerance(), true, 3);
+    Vector<> zdense(6);
+    z = z0;
+    stepper.DoStep(1, z);
+    stepper.DenseOutput(0, zdense);
+    double err0 = norm(zdense-z0);
+    stepper.DenseOutput(1, zdense);
+    double err1 = norm(zdense-z);
+    std::cout << "exprb43, Krylov dimension 3: relative error " << norm(z-zref) / norm(zref)
+              << ", dense output at 0, 1: " << err0 << ", " << err1 << std::endl;
+    ok = ok && err0 == 0 && err1 == 0;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,241 @@
+#include <iostream>
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <stdexcept>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <extrapolation.hpp>
+
+using namespace ASC_ode;
+
+
+// the oscillator of Exercise2/ex19.4, y = (cos t, -sin t)
+class Oscillator : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = -x(0);
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    df(0,1) = 1;
+    df(1,0) = -1;
+  }
+};
+
+// y' = 2 - sqrt(1-y) passes y = 1 at finite slope, beyond it the root is NaN
+class Breakdown : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 1; }
+  size_t dimF() const override { return 1; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = 2 - std::sqrt(1 - x(0));
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df(0,0) = 0.5 / std::sqrt(1 - x(0));
+  }
+};
+
+// restricted three body problem, the Arenstorf orbit is periodic (Hairer-Norsett-Wanner I, II.0)
+class Arenstorf : public NonlinearFunction
+{
+  double m_mu = 0.012277471;
+public:
+  size_t dimX() const override { return 4; }
+  size_t dimF() const override { return 4; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    double mu = m_mu, mup = 1-mu;
+    double d1 = std::pow((x(0)+mu)*(x(0)+mu) + x(1)*x(1), 1.5);
+    double d2 = std::pow((x(0)-mup)*(x(0)-mup) + x(1)*x(1), 1.5);
+    f(0) = x(2);
+    f(1) = x(3);
+    f(2) = x(0) + 2*x(3) - mup*(x(0)+mu)/d1 - mu*(x(0)-mup)/d2;
+    f(3) = x(1) - 2*x(2) - mup*x(1)/d1 - mu*x(1)/d2;
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    throw std::logic_error("Arenstorf: no Jacobian, for explicit methods only");
+  }
+};
+
+
+static void header ()
+{
+  std::cout << std::setw(24) << "method" << std::setw(12) << "evals" << std::setw(12) << "steps"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+}
+
+static void report (std::string name, size_t evals, size_t steps, double error, double time)
+{
+  std::cout << std::setw(24) << name << std::setw(12) << evals << std::setw(12) << steps
+            << std::setw(14) << error << std::setw(12) << time << std::endl;
+}
+
+
+/*
+  High accuracy reference runs: GBS extrapolation with adaptive order and
+  step size against fixed step RK4 and the embedded pairs, on the
+  oscillator with the exact solution and on the Arenstorf orbit, which
+  returns to its start after one period. Then the dense output and DoStep
+  over many steps against the exact solution of the oscillator. Exits with
+  failure on a mismatch.
+*/
+template <class Error>
+void compare (std::shared_ptr<NonlinearFunction> rhs, Vector<> y0, double tend, Error error)
+{
+  using clock = std::chrono::steady_clock;
+  auto seconds = [](clock::time_point start)
+  {
+    return std::chrono::duration<double>(clock::now()-start).count();
+  };
+  header();
+
+  auto tableau = RK4();
+  for (size_t steps : { 1000, 10000, 100000 })
+    {
+      ExplicitRungeKutta stepper(rhs, tableau.a, tableau.b, tableau.c);
+      Vector<> y = y0;
+      auto start = clock::now();
+      for (size_t i = 0; i < steps; i++)
+        stepper.DoStep(tend/steps, y);
+      report("RK4", 4*steps, steps, error(y), seconds(start));
+    }
+
+  for (int digits : { 8, 10, 12 })
+    {
+      double tol = std::pow(10.0, -digits);
+      EmbeddedRungeKutta stepper(rhs, Verner65(), Tolerance(tol, tol));
+      Vector<> y = y0;
+      auto start = clock::now();
+      auto stats = SolveAdaptive(stepper, tend, y);
+      report("Verner65, tol 1e-" + std::to_string(digits), stats.evaluations,
+             stats.accepted + stats.rejected, error(y), seconds(start));
+    }
+
+  for (int digits : { 8, 10, 12, 14 })
+    {
+      double tol = std::pow(10.0, -digits);
+      GraggBulirschStoer stepper(rhs, Tolerance(tol, tol));
+      Vector<> y = y0;
+      auto start = clock::now();
+      auto stats = SolveAdaptive(stepper, tend, y);
+      report("GBS, tol 1e-" + std::to_string(digits), stats.evaluations,
+             stats.accepted + stats.rejected, error(y), seconds(start));
+    }
+
+  // columns in parallel: more evaluations, the critical path is the longest column
+  ThreadPool pool;
+  GraggBulirschStoer stepper(rhs, Tolerance(1e-12, 1e-12));
+  stepper.setThreadPool(&pool);
+  Vector<> y = y0;
+  auto start = clock::now();
+  auto stats = SolveAdaptive(stepper, tend, y);
+  report("GBS 1e-12, " + std::to_string(pool.size()) + " threads", stats.evaluations,
+         stats.accepted + stats.rejected, error(y), seconds(start));
+}
+
+
+int main()
+{
+  std::cout << std::setprecision(4);
+
+  std::cout << "oscillator, t in [0,10]" << std::endl;
+  compare (std::make_shared<Oscillator>(), Vector<>{ 1, 0 }, 10, [](VectorView<double> y)
+  {
+    return std::hypot(y(0) - std::cos(10.0), y(1) + std::sin(10.0));
+  });
+
+  std::cout << std::endl << "Arenstorf orbit, one period" << std::endl;
+  double period = 17.0652165601579625588917206249;
+  compare (std::make_shared<Arenstorf>(), Vector<>{ 0.994, 0, 0, -2.00158510637908252240537862224 },
+           period, [](VectorView<double> y)
+  {
+    return std::hypot(y(0) - 0.994, y(1));
+  });
+
+  // dense output and DoStep on the oscillator, against the exact solution
+  bool ok = true;
+  auto rhs = std::make_shared<Oscillator>();
+  auto exact = [](double t, VectorView<double> y) { return std::hypot(y(0) - std::cos(t), y(1) + std::sin(t)); };
+  std::cout << std::endl << "oscillator, t in [0,10]" << std::endl;
+  for (int digits : { 8, 12 })
+    {
+      double tol = std::pow(10.0, -digits);
+      GraggBulirschStoer stepper(rhs, Tolerance(tol, tol));
+      std::vector<double> times;
+      for (int i = 1; i <= 1000; i++)
+        times.push_back(0.01*i);
+      Vector<> y { 1, 0 };
+      double err = 0;
+      auto stats = SolveDenseOutput(stepper, times, y, [&](double t, VectorView<double> yt)
+      {
+        err = std::max(err, exact(t, yt));
+      });
+      std::cout << "  dense output, tol 1e-" << digits << ": " << stats.accepted
+                << " steps, max error " << err << std::endl;
+      ok = ok && err < 100*tol;
+    }
+
+  {
+    // one DoStep over the whole interval, split by the error control
+    GraggBulirschStoer stepper(rhs, Tolerance(1e-12, 1e-12));
+    Vector<> y { 1, 0 }, ydense(2);
+    stepper.DoStep(10, y);
+    double err = exact(10, y);
+    stepper.DenseOutput(0, ydense);
+    double err0 = std::hypot(ydense(0) - 1, ydense(1));
+    stepper.DenseOutput(1, ydense);
+    double err1 = std::hypot(ydense(0) - y(0), ydense(1) - y(1));
+    std::cout << "  DoStep(10): error " << err << ", dense output at 0 and 1: "
+              << err0 << ", " << err1 << std::endl;
+    ok = ok && err < 1e-10 && err0 == 0 && err1 == 0;
+  }
+
+  {
+    // columns in parallel from within a task of the same pool run serially
+    ThreadPool pool(2);
+    std::vector<Vector<>> y(4, Vector<>{ 1, 0 });
+    pool.parallelFor(y.size(), [&](size_t i)
+    {
+      GraggBulirschStoer stepper(rhs, Tolerance(1e-12, 1e-12));
+      stepper.setThreadPool(&pool);
+      SolveAdaptive(stepper, 10, y[i]);
+    });
+    double err = 0;
+    for (auto & yi : y)
+      err = std::max(err, exact(10, yi));
+    std::cout << "  nested in the pool: max error " << err << std::endl;
+    ok = ok && err < 1e-10;
+  }
+
+  {
+    // a NaN right-hand side must not make DoStep halve the step forever
+    GraggBulirschStoer stepper(std::make_shared<Breakdown>(), Tolerance(1e-8, 1e-8));
+    Vector<> y { 0 };
+    bool thrown = false;
+    try { stepper.DoStep(1, y); }
+    catch (std::domain_error & e)
+      {
+        std::cout << "  NaN right-hand side: " << e.what() << std::endl;
+        thrown = true;
+      }
+    ok = ok && thrown;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+#include <bdf.hpp>
+#include <imex.hpp>
+#include <RCCircuit.hpp>
+#include <mass_spring.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  IMEX additive Runge-Kutta methods: only the stiff part enters the
+  Newton systems. A hanging chain with stiff springs (implicit) and
+  gravity (explicit), and an RC ladder with the source as explicit part,
+  against Radau IIA and BDF on the unsplit right hand side.
+*/
+
+static double timed (std::function<void()> func)
+{
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+static void header ()
+{
+  std::cout << std::setw(26) << "method" << std::setw(8) << "steps" << std::setw(6) << "rej"
+            << std::setw(10) << "f_I evals" << std::setw(10) << "f_E evals" << std::setw(6) << "LU"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+}
+
+static void row (std::string label, StepStatistics stats, size_t implicitEvals,
+                 std::string explicitEvals, size_t factorizations, double error, double time)
+{
+  std::cout << std::setw(26) << label << std::setw(8) << stats.accepted
+            << std::setw(6) << stats.rejected << std::setw(10) << implicitEvals
+            << std::setw(10) << explicitEvals << std::setw(6) << factorizations
+            << std::setw(14) << error << std::setw(12) << time << std::endl;
+}
+
+// runs all methods from y0 to tend, split is the additive form of full
+static void compare (std::shared_ptr<NonlinearFunction> full,
+                     std::shared_ptr<AdditiveFunction> split,
+                     VectorView<double> y0, double tend)
+{
+  size_t n = y0.size();
+  Vector<> ref(n), y(n);
+  {
+    BDF stepper(full, Tolerance(1e-12, 1e-12), 5, true);
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  header();
+  for (double tol : { 1e-4, 1e-6 })
+    {
+      for (int method = 0; method < 2; method++)
+        {
+          IMEXRungeKutta stepper(split, method == 0 ? ARS222() : ARK436L(), Tolerance(tol, tol), true);
+          y = y0;
+          StepStatistics stats;
+          double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+          std::ostringstream label;
+          label << (method == 0 ? "IMEX ARS(2,2,2)" : "IMEX ARK4(3)6L") << " tol=" << tol;
+          row(label.str(), stats, stepper.evaluations(), std::to_string(stepper.explicitEvaluations()),
+              stepper.jacobianReuse().factorizations, norm(y-ref), time);
+        }
+
+      {
+        BDF stepper(full, Tolerance(tol, tol), 5, true);
+        y = y0;
+        StepStatistics stats;
+        double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+        std::ostringstream label;
+        label << "BDF sparse tol=" << tol;
+        row(label.str(), stats, stats.evaluations, "-",
+            stepper.jacobianReuse().factorizations, norm(y-ref), time);
+      }
+
+      {
+        RadauIIA stepper(full, 3, Tolerance(tol, tol));
+        y = y0;
+        StepStatistics stats;
+        double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+        std::ostringstream label;
+        label << "RadauIIA(5) tol=" << tol;
+        row(label.str(), stats, stats.evaluations, "-",
+            stepper.jacobianReuse().factorizations, norm(y-ref), time);
+      }
+    }
+  std::cout << std::endl;
+}
+
+
+int main()
+{
+  {
+    // chain of 50 masses hanging from a fixed point
+    MassSpringSystem<2> mss;
+    mss.setGravity( {0,-9.81} );
+    auto prev = mss.addFix( { { 0.0, 0.0 } } );
+    for (int i = 0; i < 50; i++)
+      {
+        auto m = mss.addMass( { 1, { 0.1*(i+1), 0.0 } } );
+        mss.addSpring( { 0.1, 1e5, { prev, m } } );
+        prev = m;
+      }
+
+    size_t nq = 2*mss.masses().size();
+    Vector<> y0(2*nq), dx(nq), ddx(nq);
+    Vector<> x(nq);
+    mss.getState(x, dx, ddx);
+    y0.range(0, nq) = x;
+    y0.range(nq, 2*nq) = dx;
+
+    std::cout << "Hanging chain, 50 masses, springs implicit, gravity explicit, t in [0,1]" << std::endl;
+    compare(std::make_shared<MSS_FirstOrder<2>>(mss), MSS_SplitFunction(mss), y0, 1);
+  }
+
+  {
+    // the source drives the stiff first node, the IMEX methods lose accuracy there
+    size_t sections = 400;
+    double R = 100, C = 1e-6, omega = 100 * M_PI;
+    auto full = std::make_shared<RCLadder>(sections, R, C, omega);
+    auto split = std::make_shared<AdditiveFunction>
+      (std::make_shared<RCLadder>(sections, R, C, omega, SplitPart::IMPLICIT),
+       std::make_shared<RCLadder>(sections, R, C, omega, SplitPart::EXPLICIT));
+    Vector<> y0(sections+1);
+    y0 = 0.0;
+
+    std::cout << "RC ladder with " << sections << " sections, network implicit, source explicit, t in [0,0.1]" << std::endl;
+    compare(full, split, y0, 0.1);
+  }
+}
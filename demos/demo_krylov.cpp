@@ -0,0 +1,188 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+
+#include <nonlinfunc.hpp>
+#include <lu.hpp>
+#include <Newton.hpp>
+#include <krylov.hpp>
+
+using namespace ASC_ode;
+
+
+// Bratu problem -u'' = lambda e^u on (0,1), u = 0 at both ends, finite differences,
+// the Jacobian-vector products are the default difference quotients
+class Bratu : public NonlinearFunction
+{
+  size_t m_n;
+  double m_lambda, m_h2;
+public:
+  mutable size_t evaluations = 0;
+
+  Bratu (size_t n, double lambda) : m_n(n), m_lambda(lambda), m_h2(1.0/((n+1.0)*(n+1.0))) { }
+  size_t dimX() const override { return m_n; }
+  size_t dimF() const override { return m_n; }
+
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    evaluations++;
+    for (size_t i = 0; i < m_n; i++)
+      {
+        double left = i > 0 ? x(i-1) : 0, right = i+1 < m_n ? x(i+1) : 0;
+        f(i) = (2*x(i) - left - right) / m_h2 - m_lambda * std::exp(x(i));
+      }
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    SparseMatrix sparse(m_n, m_n);
+    evaluateDerivSparse(x, sparse);
+    sparse.addTo(df);
+  }
+  void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        pattern.add(i, i, 1.0);
+        if (i > 0) pattern.add(i, i-1, 1.0);
+        if (i+1 < m_n) pattern.add(i, i+1, 1.0);
+      }
+  }
+  void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        df.add(i, i, 2/m_h2 - m_lambda * std::exp(x(i)));
+        if (i > 0) df.add(i, i-1, -1/m_h2);
+        if (i+1 < m_n) df.add(i, i+1, -1/m_h2);
+      }
+  }
+};
+
+// the same with the exact product
+class BratuExact : public Bratu
+{
+  size_t m_n;
+  double m_lambda, m_h2;
+public:
+  BratuExact (size_t n, double lambda)
+    : Bratu(n, lambda), m_n(n), m_lambda(lambda), m_h2(1.0/((n+1.0)*(n+1.0))) { }
+
+  bool exactJacVec() const override { return true; }
+  void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                       VectorView<double> Jv) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        double left = i > 0 ? v(i-1) : 0, right = i+1 < m_n ? v(i+1) : 0;
+        Jv(i) = (2*v(i) - left - right) / m_h2 - m_lambda * std::exp(x(i)) * v(i);
+      }
+  }
+};
+
+// inverse diagonal of a given matrix
+class DiagonalPreconditioner : public Preconditioner
+{
+  Vector<> m_invdiag;
+public:
+  DiagonalPreconditioner (const Matrix<> & a) : m_invdiag(a.rows())
+  {
+    for (size_t i = 0; i < a.rows(); i++)
+      m_invdiag(i) = 1 / a(i,i);
+  }
+  void apply (VectorView<double> r) const override
+  {
+    for (size_t i = 0; i < r.size(); i++)
+      r(i) *= m_invdiag(i);
+  }
+};
+
+
+/*
+  GMRES against DenseLU on random non-symmetric matrices, with and without
+  preconditioner, and with short restarts. Newton-Krylov against Newton
+  with the exact Jacobian on the Bratu problem, with difference quotients
+  and with exact products, where the difference quotients must take f at
+  the Newton iterate from the residual: one evaluation per product.
+  Exits with failure on a mismatch.
+*/
+int main()
+{
+  bool ok = true;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> uni(-1, 1);
+
+  for (size_t n : { 10, 50, 200 })
+    for (int restart : { 5, 30 })
+      for (bool diag : { false, true })
+        {
+          // diagonally dominant, with badly scaled rows for the preconditioner to remove
+          Matrix<> a(n, n);
+          for (size_t i = 0; i < n; i++)
+            {
+              double scale = diag ? std::pow(10.0, 3*(uni(gen)+1)) : 1;
+              for (size_t j = 0; j < n; j++)
+                a(i,j) = scale * (i == j ? 2+uni(gen) : uni(gen) / n);
+            }
+          Vector<> b(n), x(n), xlu(n);
+          for (size_t i = 0; i < n; i++)
+            b(i) = uni(gen);
+          xlu = b;
+          DenseLU(a).solve(xlu);
+
+          DiagonalPreconditioner precond(a);
+          auto matvec = [&](VectorView<double> v, VectorView<double> av) { av = a * v; };
+          x = 0.0;
+          double tol = 1e-10 * norm(b);
+          int its = GMRES(matvec, diag ? &precond : nullptr, b, x, tol, 5000, restart);
+          Vector<> res(n);
+          res = a * x - b;
+          double diff = norm(x - xlu) / norm(xlu);
+          std::cout << "GMRES n = " << n << ", restart " << restart
+                    << (diag ? ", diagonal preconditioner" : "") << ": " << its << " its, residual "
+                    << norm(res) << ", |x - x_LU| / |x_LU| = " << diff << std::endl;
+          ok = ok && norm(res) < 1.01*tol && diff < 1e-6;
+        }
+
+  size_t n = 200;
+  auto bratu = std::make_shared<Bratu>(n, 3);
+  Vector<> xnewton(n);
+  xnewton = 0.0;
+  NewtonSolverContext(bratu).solve(bratu, xnewton, 1e-10);
+
+  {
+    // difference quotient from the known f(x) against the exact product
+    auto exact = std::make_shared<BratuExact>(n, 3);
+    Vector<> v(n), fx(n), jvd(n), jve(n);
+    for (size_t i = 0; i < n; i++)
+      v(i) = uni(gen);
+    std::shared_ptr<NonlinearFunction> f = bratu;
+    f->evaluate(xnewton, fx);
+    f->evaluateJacVec(xnewton, fx, v, jvd);
+    exact->evaluateJacVec(xnewton, v, jve);
+    double diff = norm(jvd - jve) / norm(jve);
+    std::cout << "difference quotient: |Jv_fd - Jv| / |Jv| = " << diff << std::endl;
+    ok = ok && diff < 1e-6;
+  }
+
+  for (bool jacobi : { false, true })
+    for (bool exactproducts : { false, true })
+      {
+        std::shared_ptr<Bratu> func = exactproducts ? std::make_shared<BratuExact>(n, 3)
+                                                    : std::make_shared<Bratu>(n, 3);
+        std::shared_ptr<Preconditioner> precond;
+        if (jacobi) precond = std::make_shared<JacobiPreconditioner>();
+        Vector<> x(n);
+        x = 0.0;
+        NewtonKrylovSolver(func, x, 1e-8, 50, precond, 100);
+        double diff = norm(x - xnewton);
+        std::cout << "Newton-Krylov" << (jacobi ? ", Jacobi" : "")
+                  << (exactproducts ? ", exact products" : ", difference quotients")
+                  << ": " << func->evaluations << " evaluations, |u - u_Newton| = " << diff << std::endl;
+        ok = ok && diff < 1e-6;
+      }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
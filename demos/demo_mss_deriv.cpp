@@ -0,0 +1,132 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+
+#include <nonlinfunc.hpp>
+
+using namespace ASC_ode;
+
+#include <mass_spring.hpp>
+
+
+/*
+  Consistency of the mass-spring derivatives on constrained systems:
+  the fused evaluateWithDeriv against evaluate and evaluateDeriv, the
+  Jacobian against central differences, and the sparse Jacobian and the
+  Jacobian-vector product against the dense Jacobian, at random
+  positions and multipliers. Exits with failure on a mismatch.
+*/
+template <int D>
+bool check (MassSpringSystem<D> & mss, std::string name, std::mt19937 & gen)
+{
+  std::uniform_real_distribution<double> uni(-1, 1);
+  auto func = std::make_shared<MSS_Function<D>>(mss);
+  size_t n = func->dimX();
+
+  Vector<> x(n), f(n), fwd(n), fp(n), fm(n), xh(n), v(n), jv(n);
+  Matrix<> df(n, n), dfwd(n, n), dfsparse(n, n);
+  double errfused = 0, errfd = 0, errsparse = 0, errjv = 0;
+  for (int sample = 0; sample < 10; sample++)
+    {
+      for (size_t i = 0; i < mss.masses().size(); i++)
+        for (size_t d = 0; d < D; d++)
+          x(i*D+d) = mss.masses()[i].pos(d) + 0.2*uni(gen);
+      for (size_t i = D*mss.masses().size(); i < n; i++)
+        x(i) = 10*uni(gen);
+
+      func->evaluate(x, f);
+      func->evaluateDeriv(x, df);
+      func->evaluateWithDeriv(x, fwd, dfwd);
+      errfused = std::max(errfused, norm(fwd - f) / norm(f));
+      for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+          errfused = std::max(errfused, std::fabs(dfwd(i,j) - df(i,j)) / (std::fabs(df(i,j)) + 1));
+
+      double h = 1e-6;
+      for (size_t j = 0; j < n; j++)
+        {
+          xh = x;
+          xh(j) += h;
+          func->evaluate(xh, fp);
+          xh(j) -= 2*h;
+          func->evaluate(xh, fm);
+          for (size_t i = 0; i < n; i++)
+            errfd = std::max(errfd, std::fabs((fp(i)-fm(i))/(2*h) - df(i,j)) / (std::fabs(df(i,j)) + 1));
+        }
+
+      SparseMatrix sparse(n, n);
+      func->evaluateDerivSparse(x, sparse);
+      dfsparse = 0.0;
+      sparse.addTo(dfsparse);
+      for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+          errsparse = std::max(errsparse, std::fabs(dfsparse(i,j) - df(i,j)));
+
+      for (size_t i = 0; i < n; i++)
+        v(i) = uni(gen);
+      func->evaluateJacVec(x, v, jv);
+      errjv = std::max(errjv, norm(jv - df*v) / norm(jv));
+    }
+
+  std::cout << name << ", " << n << " unknowns:" << std::endl
+            << "  fused - separate:          " << errfused << std::endl
+            << "  Jacobian - differences:    " << errfd << std::endl
+            << "  sparse - dense Jacobian:   " << errsparse << std::endl
+            << "  Jacobian-vector - dense:   " << errjv << std::endl;
+  return errfused < 1e-13 && errfd < 1e-6 && errsparse < 1e-13 && errjv < 1e-13;
+}
+
+
+int main()
+{
+  bool ok = true;
+  std::mt19937 gen(42);
+
+  {
+    // hanging chain, the last mass on a rod to a fix, two masses joined by a rod
+    MassSpringSystem<2> mss;
+    mss.setGravity( { 0, -9.81 } );
+    auto prev = mss.addFix( { { 0.0, 0.0 } } );
+    std::vector<Connector> masses;
+    for (int i = 1; i <= 10; i++)
+      {
+        auto m = mss.addMass( { 1.0 + 0.1*i, { double(i), 0.0 } } );
+        mss.addSpring( { 1, 100, { prev, m } } );
+        masses.push_back(m);
+        prev = m;
+      }
+    mss.addDistanceConstraint( { mss.addFix( { { 10.0, -1.0 } } ), prev, 1.0 } );
+    mss.addDistanceConstraint( { masses[2], masses[5], 3.0 } );
+    ok = check(mss, "2D chain with two constraints", gen) && ok;
+  }
+
+  {
+    // a square net in 3D, fixed at two corners, with a diagonal rod
+    MassSpringSystem<3> mss;
+    mss.setGravity( { 0, 0, -9.81 } );
+    const int m = 4;
+    Connector nodes[m][m];
+    for (int i = 0; i < m; i++)
+      for (int j = 0; j < m; j++)
+        {
+          Vec<3> pos = { double(i), double(j), 0.0 };
+          if ((i == 0 && j == 0) || (i == m-1 && j == 0))
+            nodes[i][j] = mss.addFix( { pos } );
+          else
+            nodes[i][j] = mss.addMass( { 1, pos } );
+        }
+    for (int i = 0; i < m; i++)
+      for (int j = 0; j < m; j++)
+        {
+          if (i+1 < m) mss.addSpring( { 1, 50, { nodes[i][j], nodes[i+1][j] } } );
+          if (j+1 < m) mss.addSpring( { 1, 50, { nodes[i][j], nodes[i][j+1] } } );
+        }
+    mss.addDistanceConstraint( { nodes[0][m-1], nodes[m-1][m-1], double(m-1) } );
+    mss.addDistanceConstraint( { nodes[1][1], nodes[2][2], std::sqrt(2.0) } );
+    ok = check(mss, "3D net with two constraints", gen) && ok;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
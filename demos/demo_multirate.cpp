@@ -0,0 +1,96 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <functional>
+
+#include <mass_spring.hpp>
+#include <symplectic.hpp>
+#include <multirate.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  A crane: a long truss boom of heavy masses and moderately stiff springs,
+  with a cable of light masses and stiff springs hanging from its tip and a
+  load on a rigid hook. The cable limits the step size of single rate
+  Stoermer-Verlet, the multirate method sub-cycles only the cable and the
+  load and takes the large steps the boom allows.
+*/
+
+static double timed (std::function<void()> func)
+{
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+static MassSpringSystem<2> Crane (size_t sections)
+{
+  MassSpringSystem<2> mss;
+  mss.setGravity( {0,-9.81} );
+  Connector lo = mss.addFix( { { 0.0, 0.0 } } );
+  Connector hi = mss.addFix( { { 0.0, 0.5 } } );
+  for (size_t i = 1; i <= sections; i++)
+    {
+      auto a = mss.addMass( { 10, { 0.5*i, 0.0 } } );
+      auto b = mss.addMass( { 10, { 0.5*i, 0.5 } } );
+      mss.addSpring( { 0.5, 1e4, { lo, a } } );
+      mss.addSpring( { 0.5, 1e4, { hi, b } } );
+      mss.addSpring( { 0.5, 1e4, { a, b } } );
+      mss.addSpring( { std::sqrt(0.5), 1e4, { lo, b } } );
+      lo = a;
+      hi = b;
+    }
+
+  double x = 0.5*sections;
+  Connector prev = lo;
+  for (size_t i = 1; i <= 20; i++)
+    {
+      auto m = mss.addMass( { 0.01, { x, -0.1*i } } );
+      mss.addSpring( { 0.1, 1e4, { prev, m } } );
+      prev = m;
+    }
+  auto load = mss.addMass( { 1, { x, -2.2 } } );
+  mss.addDistanceConstraint(DistanceConstraint(prev, load, 0.2));
+  return mss;
+}
+
+static double MaxDistance (MassSpringSystem<2> & a, MassSpringSystem<2> & b)
+{
+  double dist = 0;
+  for (size_t i = 0; i < a.masses().size(); i++)
+    dist = std::max(dist, norm(a.masses()[i].pos - b.masses()[i].pos));
+  return dist;
+}
+
+int main()
+{
+  size_t sections = 200;
+  double tend = 1;
+
+  auto ref = Crane(sections);
+  SolveODE_Symplectic(ref, tend, 100000);
+
+  std::cout << "Crane with " << ref.masses().size() << " masses, t in [0," << tend << "]" << std::endl;
+  std::cout << std::setw(12) << "method" << std::setw(8) << "steps" << std::setw(10) << "substeps"
+            << std::setw(8) << "fast" << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+  for (size_t steps : { 100, 200, 400 })
+    {
+      auto mss = Crane(sections);
+      auto part = MSS_MultiratePartition(mss, tend/steps);
+      size_t nfast = std::count(part.fast.begin(), part.fast.end(), true);
+      double time = timed([&] { SolveODE_Multirate(mss, tend, steps, part); });
+      std::cout << std::setw(12) << "multirate" << std::setw(8) << steps << std::setw(10) << part.substeps
+                << std::setw(8) << nfast << std::setw(14) << MaxDistance(mss, ref)
+                << std::setw(12) << time << std::endl;
+
+      auto single = Crane(sections);
+      time = timed([&] { SolveODE_Symplectic(single, tend, steps*part.substeps); });
+      std::cout << std::setw(12) << "Verlet" << std::setw(8) << steps*part.substeps << std::setw(10) << "-"
+                << std::setw(8) << "-" << std::setw(14) << MaxDistance(single, ref)
+                << std::setw(12) << time << std::endl;
+    }
+}
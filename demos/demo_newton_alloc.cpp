@@ -0,0 +1,148 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+
+using namespace ASC_ode;
+
+#include <Newmark.hpp>
+
+
+// count every heap allocation of the program
+static size_t num_allocs = 0;
+
+void * operator new (size_t size)
+{
+  num_allocs++;
+  if (void * p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete (void * p) noexcept { std::free(p); }
+void operator delete (void * p, size_t) noexcept { std::free(p); }
+
+
+// pendulum in cartesian coordinates, a leaf function with nonlinear Jacobian
+class Pendulum : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = -sin(x(0));
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    df(0,1) = 1;
+    df(1,0) = -cos(x(0));
+  }
+};
+
+// f(x) = x^3 - b, componentwise
+class Cubic : public NonlinearFunction
+{
+  size_t m_n;
+public:
+  Cubic (size_t n) : m_n(n) { }
+  size_t dimX() const override { return m_n; }
+  size_t dimF() const override { return m_n; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      f(i) = x(i)*x(i)*x(i) - (i+1);
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    for (size_t i = 0; i < m_n; i++)
+      df(i,i) = 3*x(i)*x(i);
+  }
+};
+
+
+int main()
+{
+  bool ok = true;
+
+  // repeated Newton solves with one context
+  {
+    auto func = std::make_shared<Cubic>(10);
+    NewtonSolverContext newton(func);
+    Vector<> x(10);
+
+    x = 1.0;
+    newton.solve(func, x);    // warm up
+
+    size_t before = num_allocs;
+    for (int i = 0; i < 1000; i++)
+      {
+        x = 1.0;
+        newton.solve(func, x);
+      }
+    size_t allocs = num_allocs - before;
+    std::cout << "NewtonSolverContext::solve: " << allocs << " allocations in 1000 solves" << std::endl;
+    ok = ok && allocs == 0;
+  }
+
+  // steady state time stepping
+  {
+    auto rhs = std::make_shared<Pendulum>();
+    ImplicitEuler stepper(rhs);
+    Vector<> y = { 1, 0 };
+
+    stepper.DoStep(0.01, y);  // warm up
+
+    size_t before = num_allocs;
+    for (int i = 0; i < 1000; i++)
+      stepper.DoStep(0.01, y);
+    size_t allocs = num_allocs - before;
+    std::cout << "ImplicitEuler::DoStep: " << allocs << " allocations in 1000 steps" << std::endl;
+    ok = ok && allocs == 0;
+  }
+
+  {
+    auto rhs = std::make_shared<Pendulum>();
+    auto [Gauss3a, Gauss3b] = ComputeABfromC (Gauss3c);
+    ImplicitRungeKutta stepper(rhs, Gauss3a, Gauss3b, Gauss3c);
+    Vector<> y = { 1, 0 };
+
+    stepper.DoStep(0.01, y);  // warm up
+
+    size_t before = num_allocs;
+    for (int i = 0; i < 1000; i++)
+      stepper.DoStep(0.01, y);
+    size_t allocs = num_allocs - before;
+    std::cout << "ImplicitRungeKutta::DoStep: " << allocs << " allocations in 1000 steps" << std::endl;
+    ok = ok && allocs == 0;
+  }
+
+  // the Newmark drivers, counted between the callbacks after the first step
+  for (bool alpha : { false, true })
+    {
+      auto rhs = std::make_shared<Pendulum>();
+      auto mass = std::make_shared<IdentityFunction>(2);
+      Vector<> x = { 1, 0 }, dx = { 0, 0 }, ddx = { 0, 0 };
+      size_t last = 0, allocs = 0;
+      int step = 0;
+      auto callback = [&](double t, VectorView<double> x)
+      {
+        if (step++ > 0) allocs += num_allocs - last;
+        last = num_allocs;
+      };
+      if (alpha)
+        SolveODE_Alpha(10, 1001, 0.8, x, dx, ddx, rhs, mass, callback);
+      else
+        SolveODE_Newmark(10, 1001, x, dx, rhs, mass, callback);
+      std::cout << (alpha ? "SolveODE_Alpha" : "SolveODE_Newmark") << ": "
+                << allocs << " allocations in 1000 steps" << std::endl;
+      ok = ok && allocs == 0;
+    }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
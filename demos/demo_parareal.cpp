@@ -0,0 +1,91 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+#include <parareal.hpp>
+#include <RCCircuit.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  Parareal on the RC ladder: implicit Euler with few large steps as
+  coarse propagator, the 3-stage Gauss method as fine propagator. The
+  fine propagators of the time slices run on a thread pool, the result
+  is compared with the sequential fine integration. The ideal speedup
+  assumes one thread per slice. With as many iterations as slices the
+  result must be the sequential one, else the demo exits with failure.
+*/
+int main()
+{
+  size_t sections = 200;
+  auto rhs = std::make_shared<RCLadder>(sections, 100, 1e-6, 100*M_PI);
+  double tend = 0.04;
+  size_t fineSteps = 800;
+
+  auto [a, b] = ComputeABfromC(Gauss3c);
+  StepperFactory fine = [&] { return std::make_unique<ImplicitRungeKutta>(rhs, a, b, Gauss3c); };
+  StepperFactory coarse = [&]
+  {
+    auto stepper = std::make_unique<ImplicitEuler>(rhs);
+    stepper->jacobianReuse().simplified = true;
+    return stepper;
+  };
+
+  Vector<> y0(sections+1), seq(sections+1), y(sections+1);
+  y0 = 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    auto stepper = fine();
+    seq = y0;
+    for (size_t i = 0; i < fineSteps; i++)
+      stepper->DoStep(tend/fineSteps, seq);
+  }
+  double seqtime = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+  ThreadPool pool;
+  std::cout << "RC ladder with " << sections << " sections, t in [0," << tend << "], "
+            << fineSteps << " Gauss3 steps, " << pool.size() << " threads" << std::endl;
+  std::cout << "sequential: " << seqtime << " s" << std::endl;
+  std::cout << std::setw(8) << "slices" << std::setw(8) << "tol" << std::setw(6) << "it"
+            << std::setw(14) << "diff to seq" << std::setw(12) << "time [s]"
+            << std::setw(12) << "coarse [s]" << std::setw(10) << "speedup" << std::setw(10) << "ideal" << std::endl;
+
+  for (size_t slices : { 4, 8, 16 })
+    for (double tol : { 1e-6, 1e-10 })
+      {
+        PararealOptions options;
+        options.slices = slices;
+        options.fineSteps = fineSteps / slices;
+        options.coarseSteps = 10;
+        options.tol = tol;
+        y = y0;
+        auto stats = SolveParareal(tend, y, coarse, fine, pool, options);
+        std::cout << std::setw(8) << slices << std::setw(8) << tol << std::setw(6) << stats.iterations
+                  << std::setw(14) << norm(y-seq) << std::setw(12) << stats.time
+                  << std::setw(12) << stats.coarseTime << std::setw(10) << stats.speedup(seqtime)
+                  << std::setw(10) << stats.idealSpeedup() << std::endl;
+      }
+
+  // all iterations: the fine solution on every slice
+  PararealOptions options;
+  options.slices = 8;
+  options.fineSteps = fineSteps / options.slices;
+  options.coarseSteps = 10;
+  options.maxIterations = options.slices;
+  options.tol = 0;
+  y = y0;
+  auto stats = SolveParareal(tend, y, coarse, fine, pool, options);
+  double diff = norm(y-seq) / norm(seq);
+  std::cout << options.slices << " slices, " << stats.iterations
+            << " iterations: relative difference to seq " << diff << std::endl;
+  bool ok = stats.iterations == options.slices && diff < 1e-8;
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,191 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <implicitRK.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  chain of n unit masses, fixed at the left end, x = (u, v).
+  Springs alternate between stiff (with damping) and soft,
+  so the slow motion of the chain is coupled to fast decaying modes.
+*/
+class StiffChain : public NonlinearFunction
+{
+  size_t m_n;
+  double m_kstiff, m_ksoft, m_damp;
+public:
+  StiffChain (size_t n, double kstiff, double ksoft, double damp)
+    : m_n(n), m_kstiff(kstiff), m_ksoft(ksoft), m_damp(damp) { }
+
+  size_t dimX() const override { return 2*m_n; }
+  size_t dimF() const override { return 2*m_n; }
+
+  // spring i connects mass i-1 (or the wall) with mass i
+  double stiffness (size_t i) const { return i % 2 == 0 ? m_kstiff : m_ksoft; }
+  double damping (size_t i) const { return i % 2 == 0 ? m_damp : 0; }
+
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    auto u = x.range(0, m_n);
+    auto v = x.range(m_n, 2*m_n);
+    f.range(0, m_n) = v;
+    auto a = f.range(m_n, 2*m_n);
+    a = 0.0;
+    for (size_t i = 0; i < m_n; i++)
+      {
+        double du = u(i) - (i > 0 ? u(i-1) : 0);
+        double dv = v(i) - (i > 0 ? v(i-1) : 0);
+        double force = stiffness(i)*du + damping(i)*dv;
+        a(i) -= force;
+        if (i > 0) a(i-1) += force;
+      }
+  }
+
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    for (size_t i = 0; i < m_n; i++)
+      df(i, m_n+i) = 1;
+    for (size_t i = 0; i < m_n; i++)
+      for (size_t off : { size_t(0), m_n })
+        {
+          double c = off == 0 ? stiffness(i) : damping(i);
+          df(m_n+i, off+i) -= c;
+          if (i > 0)
+            {
+              df(m_n+i, off+i-1) += c;
+              df(m_n+i-1, off+i) += c;
+              df(m_n+i-1, off+i-1) -= c;
+            }
+        }
+  }
+};
+
+
+// van der Pol oscillator, x = (u, u')
+class VanDerPol : public NonlinearFunction
+{
+  double m_mu;
+public:
+  VanDerPol (double mu) : m_mu(mu) { }
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = m_mu*(1-x(0)*x(0))*x(1) - x(0);
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df(0,0) = 0;
+    df(0,1) = 1;
+    df(1,0) = -2*m_mu*x(0)*x(1) - 1;
+    df(1,1) = m_mu*(1-x(0)*x(0));
+  }
+};
+
+
+// Newton iterations per step for the stage predictors
+void comparePredictors()
+{
+  auto rhs = std::make_shared<VanDerPol>(100);
+  double tend = 200;
+  struct { std::string name; StagePredictor predictor; } predictors[] =
+    { { "zero", StagePredictor::ZERO }, { "last stage", StagePredictor::LAST_STAGE },
+      { "extrapolated", StagePredictor::EXTRAPOLATED } };
+
+  std::cout << std::endl << "van der Pol, mu = 100, t in [0,200], RadauIIA(5) tol=1e-06" << std::endl;
+  std::cout << std::setw(26) << "predictor" << std::setw(10) << "steps"
+            << std::setw(10) << "rejected" << std::setw(14) << "its/step" << std::endl;
+  for (auto & pred : predictors)
+    {
+      RadauIIA stepper(rhs, 3, Tolerance(1e-6, 1e-6));
+      stepper.stepper().setPredictor(pred.predictor);
+      Vector<> y{ 2, 0 };
+      auto stats = SolveAdaptive(stepper, tend, y);
+      std::cout << std::setw(26) << pred.name << std::setw(10) << stats.accepted
+                << std::setw(10) << stats.rejected
+                << std::setw(14) << stepper.stepper().averageIterations() << std::endl;
+    }
+}
+
+
+int main()
+{
+  size_t n = 20;
+  double tend = 10;
+  auto rhs = std::make_shared<StiffChain>(n, 1e5, 1, 100);
+
+  // soft springs stretched, stiff springs at rest
+  Vector<> y0(2*n);
+  y0 = 0.0;
+  for (size_t i = 0; i < n; i++)
+    y0(i) = 0.1 * ((i+1)/2);
+
+  Vector<> ref(2*n), y(2*n);
+  {
+    RadauIIA stepper(rhs, 5, Tolerance(1e-11, 1e-13));
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  auto timed = [](auto func)
+  {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  };
+
+  std::cout << std::setw(26) << "method" << std::setw(10) << "steps"
+            << std::setw(10) << "rejected" << std::setw(12) << "rhs evals"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+  // fixed steps of the 3-stage Radau IIA
+  Vector<> c(3), w(3);
+  GaussRadau(c, w);
+  auto [a, b] = ComputeABfromC(c);
+  for (int steps : { 10, 100, 1000 })
+    {
+      ImplicitRungeKutta stepper(rhs, a, b, c);
+      y = y0;
+      double time = timed([&] { for (int i = 0; i < steps; i++) stepper.DoStep(tend/steps, y); });
+      std::cout << std::setw(26) << "Radau5 fixed N=" + std::to_string(steps) << std::setw(10) << steps
+                << std::setw(10) << 0 << std::setw(12) << "-"
+                << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+    }
+
+  for (int stages : { 2, 3, 5 })
+    for (double tol : { 1e-4, 1e-6, 1e-8 })
+      {
+        RadauIIA stepper(rhs, stages, Tolerance(tol, tol));
+        y = y0;
+        StepStatistics stats;
+        double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+        std::ostringstream label;
+        label << "RadauIIA(" << 2*stages-1 << ") tol=" << tol;
+        std::cout << std::setw(26) << label.str() << std::setw(10) << stats.accepted
+                  << std::setw(10) << stats.rejected << std::setw(12) << stats.evaluations
+                  << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+      }
+
+  // an explicit method is limited by the stiff springs
+  {
+    EmbeddedRungeKutta stepper(rhs, DormandPrince54(), Tolerance(1e-6, 1e-6));
+    y = y0;
+    StepStatistics stats;
+    double time = timed([&] { stats = SolveAdaptive(stepper, tend, y); });
+    std::cout << std::setw(26) << "DP5(4) tol=1e-06" << std::setw(10) << stats.accepted
+              << std::setw(10) << stats.rejected << std::setw(12) << stats.evaluations
+              << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+  }
+
+  comparePredictors();
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <explicitRK.hpp>
+#include <bdf.hpp>
+#include <rkc.hpp>
+
+using namespace ASC_ode;
+
+
+// u' = Laplace u + u^2 (1-u) on the unit square, finite differences on an
+// N x N grid with u = 0 on the boundary
+class ReactionDiffusion2D : public NonlinearFunction
+{
+  size_t m_N;
+  double m_h2inv;
+public:
+  ReactionDiffusion2D (size_t N) : m_N(N), m_h2inv((N+1.0)*(N+1.0)) { }
+  size_t dimX() const override { return m_N*m_N; }
+  size_t dimF() const override { return m_N*m_N; }
+
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    for (size_t i = 0; i < m_N; i++)
+      for (size_t j = 0; j < m_N; j++)
+        {
+          size_t k = i*m_N+j;
+          double u = x(k), lap = -4*u;
+          if (i > 0) lap += x(k-m_N);
+          if (i+1 < m_N) lap += x(k+m_N);
+          if (j > 0) lap += x(k-1);
+          if (j+1 < m_N) lap += x(k+1);
+          f(k) = m_h2inv*lap + u*u*(1-u);
+        }
+  }
+
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    SparseMatrix sparse(dimF(), dimX());
+    evaluateDerivSparse(x, sparse);
+    sparse.addTo(df);
+  }
+
+  void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    Vector<> x(dimX());
+    x = 0.0;
+    evaluateDerivSparse(x, pattern);
+  }
+
+  void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    for (size_t i = 0; i < m_N; i++)
+      for (size_t j = 0; j < m_N; j++)
+        {
+          size_t k = i*m_N+j;
+          double u = x(k);
+          df.add(k, k, -4*m_h2inv + 2*u - 3*u*u);
+          if (i > 0) df.add(k, k-m_N, m_h2inv);
+          if (i+1 < m_N) df.add(k, k+m_N, m_h2inv);
+          if (j > 0) df.add(k, k-1, m_h2inv);
+          if (j+1 < m_N) df.add(k, k+1, m_h2inv);
+        }
+  }
+};
+
+
+/*
+  Runge-Kutta-Chebyshev on a moderately stiff 2D reaction-diffusion
+  problem: the stage count follows the estimated spectral radius, only
+  right hand side evaluations and a few vectors are needed. Against an
+  explicit Runge-Kutta method, whose step size is bounded by stability,
+  and sparse BDF. A fixed step beyond the stability bound is split, its
+  dense output must still cover the whole step, the demo fails otherwise.
+*/
+int main()
+{
+  size_t N = 80;
+  auto rhs = std::make_shared<ReactionDiffusion2D>(N);
+  double tend = 0.1;
+
+  Vector<> y0(N*N), ref(N*N), y(N*N);
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      {
+        double px = (i+1.0)/(N+1), py = (j+1.0)/(N+1);
+        y0(i*N+j) = 20 * px*(1-px) * py*(1-py);
+      }
+  {
+    BDF stepper(rhs, Tolerance(1e-9, 1e-9), 5, true);
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  std::cout << "Reaction-diffusion on a " << N << "x" << N << " grid, t in [0," << tend << "]" << std::endl;
+  std::cout << std::setw(22) << "method" << std::setw(8) << "steps" << std::setw(6) << "rej"
+            << std::setw(10) << "evals" << std::setw(8) << "stages"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+  auto report = [&](std::string name, double tol, AdaptiveTimeStepper & stepper,
+                    std::function<std::string()> stages)
+  {
+    y = y0;
+    auto start = std::chrono::steady_clock::now();
+    StepStatistics stats = SolveAdaptive(stepper, tend, y);
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::ostringstream label;
+    label << name << " tol=" << tol;
+    std::cout << std::setw(22) << label.str() << std::setw(8) << stats.accepted
+              << std::setw(6) << stats.rejected << std::setw(10) << stats.evaluations
+              << std::setw(8) << stages()
+              << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+  };
+
+  for (double tol : { 1e-3, 1e-5 })
+    {
+      RungeKuttaChebyshev rkc(rhs, Tolerance(tol, tol));
+      report("RKC2", tol, rkc, [&] { return std::to_string(rkc.maxStagesUsed()); });
+
+      EmbeddedRungeKutta dopri(rhs, DormandPrince54(), Tolerance(tol, tol));
+      report("DOPRI5", tol, dopri, [] { return std::string("7"); });
+
+      BDF bdf(rhs, Tolerance(tol, tol), 5, true);
+      report("BDF sparse", tol, bdf, [] { return std::string("-"); });
+    }
+
+  bool ok = true;
+  {
+    double tau = 0.01;
+    Vector<> yhalf(N*N), ydense(N*N);
+    BDF stepper(rhs, Tolerance(1e-9, 1e-9), 5, true);
+    yhalf = y0;
+    SolveAdaptive(stepper, tau/2, yhalf);
+
+    // without error control an underestimated spectral radius is not
+    // noticed, Gershgorin gives a bound
+    RungeKuttaChebyshev rkc(rhs, Tolerance(), 10);
+    rkc.setSpectralRadius([N](VectorView<double>) { return 8.0*(N+1)*(N+1) + 10; });
+    y = y0;
+    rkc.DoStep(tau, y);
+    rkc.DenseOutput(0, ydense);
+    double err0 = norm(ydense-y0);
+    rkc.DenseOutput(1, ydense);
+    double err1 = norm(ydense-y);
+    rkc.DenseOutput(0.5, ydense);
+    double errhalf = norm(ydense-yhalf) / norm(yhalf);
+    std::cout << std::endl << "one step tau = " << tau << " with at most 10 stages, split in "
+              << int(std::ceil(tau / rkc.maxStepSize())) << ": dense output at 0, 1: "
+              << err0 << ", " << err1 << ", relative error at 1/2: " << errhalf << std::endl;
+    ok = err0 == 0 && err1 == 0 && errhalf < 1e-2;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include <nonlinfunc.hpp>
+#include <timestepper.hpp>
+#include <implicitRK.hpp>
+#include <bdf.hpp>
+#include <rosenbrock.hpp>
+
+using namespace ASC_ode;
+
+
+// van der Pol oscillator, x = (u, u')
+class VanDerPol : public NonlinearFunction
+{
+  double m_mu;
+public:
+  VanDerPol (double mu) : m_mu(mu) { }
+  size_t dimX() const override { return 2; }
+  size_t dimF() const override { return 2; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = x(1);
+    f(1) = m_mu*(1-x(0)*x(0))*x(1) - x(0);
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df(0,0) = 0;
+    df(0,1) = 1;
+    df(1,0) = -2*m_mu*x(0)*x(1) - 1;
+    df(1,1) = m_mu*(1-x(0)*x(0));
+  }
+};
+
+
+/*
+  Observed orders with fixed steps on the non-stiff van der Pol
+  oscillator, ROS2 also with the Jacobian kept over many steps, then the
+  adaptive methods against BDF and Radau IIA on the stiff one. Exits with
+  failure if an observed order is off.
+*/
+int main()
+{
+  bool ok = true;
+  std::cout << "observed orders, van der Pol, mu = 1, t in [0,10]" << std::endl;
+  {
+    auto rhs = std::make_shared<VanDerPol>(1);
+    Vector<> y0{ 2, 0 };
+    auto solve = [&](Rosenbrock & stepper, int steps)
+    {
+      Vector<> y = y0;
+      for (int i = 0; i < steps; i++)
+        stepper.DoStep(10.0/steps, y);
+      return y;
+    };
+    Rosenbrock reference(rhs, RODAS());
+    Vector<> ref = solve(reference, 40000);
+
+    struct { std::string name; RosenbrockTableau tab; bool w; } methods[] =
+      { { "ROS2", ROS2(), false }, { "ROS2 (W)", ROS2(), true },
+        { "ROS3P", ROS3P(), false }, { "RODAS", RODAS(), false } };
+    for (auto & method : methods)
+      {
+        std::cout << std::setw(10) << method.name << ":";
+        double olderr = 0, observed = 0;
+        for (int steps : { 100, 200, 400, 800, 1600 })
+          {
+            Rosenbrock stepper(rhs, method.tab, Tolerance(), method.w);
+            stepper.jacobianReuse().maxage = 10;
+            double err = norm(solve(stepper, steps) - ref);
+            if (olderr > 0)
+              {
+                observed = std::log2(olderr / err);
+                std::cout << std::setw(8) << std::setprecision(3) << observed;
+              }
+            olderr = err;
+          }
+        std::cout << "   (order " << method.tab.order << ")" << std::endl;
+        // RODAS approaches its order from above
+        ok = ok && observed > method.tab.order - 0.2 && observed < method.tab.order + 0.5;
+      }
+    std::cout << std::setprecision(6) << std::endl;
+  }
+
+  auto rhs = std::make_shared<VanDerPol>(1000);
+  double tend = 1000;
+  Vector<> y0{ 2, 0 };
+
+  Vector<> ref(2), y(2);
+  {
+    BDF stepper(rhs, Tolerance(1e-11, 1e-11));
+    ref = y0;
+    SolveAdaptive(stepper, tend, ref);
+  }
+
+  std::cout << "van der Pol, mu = 1000, t in [0," << tend << "]" << std::endl;
+  std::cout << std::setw(22) << "method" << std::setw(8) << "steps" << std::setw(6) << "rej"
+            << std::setw(8) << "evals" << std::setw(8) << "jac" << std::setw(8) << "LU"
+            << std::setw(14) << "error" << std::setw(12) << "time [s]" << std::endl;
+
+  auto report = [&](std::string name, double tol, AdaptiveTimeStepper & stepper,
+                    auto jacobians, auto factorizations)
+  {
+    y = y0;
+    StepStatistics stats;
+    auto start = std::chrono::steady_clock::now();
+    stats = SolveAdaptive(stepper, tend, y);
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::ostringstream label;
+    label << name << " tol=" << tol;
+    std::cout << std::setw(22) << label.str() << std::setw(8) << stats.accepted
+              << std::setw(6) << stats.rejected << std::setw(8) << stats.evaluations
+              << std::setw(8) << jacobians() << std::setw(8) << factorizations()
+              << std::setw(14) << norm(y-ref) << std::setw(12) << time << std::endl;
+  };
+
+  struct { std::string name; RosenbrockTableau tab; } methods[] =
+    { { "ROS2", ROS2() }, { "ROS3P", ROS3P() }, { "RODAS", RODAS() } };
+  for (double tol : { 1e-4, 1e-6 })
+    {
+      for (auto & method : methods)
+        for (bool w : { false, true })
+          if (!w || method.tab.wmethod)
+          {
+            Rosenbrock stepper(rhs, method.tab, Tolerance(tol, tol), w);
+            report(method.name + (w ? " (W)" : ""), tol, stepper,
+                   [&] { return stepper.jacobians(); },
+                   [&] { return stepper.jacobianReuse().factorizations; });
+          }
+
+      BDF bdf(rhs, Tolerance(tol, tol));
+      report("BDF", tol, bdf, [&] { return bdf.jacobians(); },
+             [&] { return bdf.jacobianReuse().factorizations; });
+
+      // every Jacobian is factored once per real eigenvalue and conjugate pair of A^{-1}
+      RadauIIA radau(rhs, 3, Tolerance(tol, tol));
+      report("RadauIIA(5)", tol, radau, [&] { return radau.jacobianReuse().factorizations; },
+             [&] { return radau.jacobianReuse().factorizations
+                          * radau.stepper().transformedSolver()->systems(); });
+      std::cout << std::endl;
+    }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+
+#include <nonlinfunc.hpp>
+#include <sparsematrix.hpp>
+#include <lu.hpp>
+#include <Newton.hpp>
+
+using namespace ASC_ode;
+
+
+// Bratu problem -u'' = lambda e^u on (0,1), u = 0 at both ends, finite differences
+class Bratu : public NonlinearFunction
+{
+  size_t m_n;
+  double m_lambda, m_h2;
+public:
+  Bratu (size_t n, double lambda) : m_n(n), m_lambda(lambda), m_h2(1.0/((n+1.0)*(n+1.0))) { }
+  size_t dimX() const override { return m_n; }
+  size_t dimF() const override { return m_n; }
+
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        double left = i > 0 ? x(i-1) : 0, right = i+1 < m_n ? x(i+1) : 0;
+        f(i) = (2*x(i) - left - right) / m_h2 - m_lambda * std::exp(x(i));
+      }
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    SparseMatrix sparse(m_n, m_n);
+    evaluateDerivSparse(x, sparse);
+    sparse.addTo(df);
+  }
+  void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        pattern.add(i, i, 1.0);
+        if (i > 0) pattern.add(i, i-1, 1.0);
+        if (i+1 < m_n) pattern.add(i, i+1, 1.0);
+      }
+  }
+  void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    for (size_t i = 0; i < m_n; i++)
+      {
+        df.add(i, i, 2/m_h2 - m_lambda * std::exp(x(i)));
+        if (i > 0) df.add(i, i-1, -1/m_h2);
+        if (i+1 < m_n) df.add(i, i+1, -1/m_h2);
+      }
+  }
+};
+
+
+/*
+  SparseLU against DenseLU on random sparse non-symmetric matrices, some
+  with zero diagonal entries so that pivoting is needed, and the sparse
+  Newton context against the dense one. Exits with failure on a mismatch.
+*/
+int main()
+{
+  bool ok = true;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> uni(-1, 1);
+
+  for (size_t n : { 5, 20, 100 })
+    for (bool zerodiag : { false, true })
+      {
+        SparseMatrix sparse(n, n);
+        Matrix<> dense(n, n);
+        dense = 0.0;
+        auto add = [&](size_t i, size_t j, double v)
+        {
+          sparse.add(i, j, v);
+          dense(i, j) += v;
+        };
+        for (size_t i = 0; i < n; i++)
+          {
+            if (!zerodiag || i % 3 != 0) add(i, i, 4 + uni(gen));
+            add(i, (i+1) % n, uni(gen));
+            add((i+1) % n, i, 2 + uni(gen));
+            add(i, (i*7+3) % n, uni(gen));
+          }
+
+        Vector<> b(n), xs(n), xd(n);
+        for (size_t i = 0; i < n; i++)
+          b(i) = uni(gen);
+        xs = b;
+        xd = b;
+
+        SparseLU slu;
+        slu.factor(sparse);
+        slu.solve(xs);
+        DenseLU dlu(dense);
+        dlu.solve(xd);
+
+        Vector<> res(n);
+        res = dense * xs - b;
+        double diff = norm(xs - xd) / norm(xd);
+        std::cout << "n = " << n << (zerodiag ? ", zero diagonal entries" : "")
+                  << ": |x_sparse - x_dense| / |x_dense| = " << diff
+                  << ", residual " << norm(res) << std::endl;
+        ok = ok && diff < 1e-12 && norm(res) < 1e-12 * norm(b) * n;
+      }
+
+  {
+    auto func = std::make_shared<Bratu>(200, 3);
+    Vector<> xs(200), xd(200);
+    xs = 0.0;
+    xd = 0.0;
+    SparseNewtonSolverContext sparse(func);
+    sparse.solve(func, xs, 1e-10);
+    NewtonSolverContext dense(func);
+    dense.solve(func, xd, 1e-10);
+    double diff = norm(xs - xd);
+    std::cout << "Bratu, n = 200: |u_sparse - u_dense| = " << diff << std::endl;
+    ok = ok && diff < 1e-10;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+
+#include <nonlinfunc.hpp>
+#include <Newton.hpp>
+#include <implicitRK.hpp>
+
+using namespace ASC_ode;
+
+
+// Robertson's chemical reaction, stiff with rate constants from 0.04 to 3e7
+class Robertson : public NonlinearFunction
+{
+public:
+  size_t dimX() const override { return 3; }
+  size_t dimF() const override { return 3; }
+  void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    f(0) = -0.04*x(0) + 1e4*x(1)*x(2);
+    f(1) = 0.04*x(0) - 1e4*x(1)*x(2) - 3e7*x(1)*x(1);
+    f(2) = 3e7*x(1)*x(1);
+  }
+  void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df(0,0) = -0.04;  df(0,1) = 1e4*x(2);               df(0,2) = 1e4*x(1);
+    df(1,0) = 0.04;   df(1,1) = -1e4*x(2) - 6e7*x(1);   df(1,2) = -1e4*x(1);
+    df(2,0) = 0;      df(2,1) = 6e7*x(1);               df(2,2) = 0;
+  }
+};
+
+
+/*
+  The stage solution of TransformedStageSolver, which solves one n x n
+  system per eigenvalue of A^{-1}, against Newton on the full s n stage
+  system with the dense Jacobian, for Gauss and Radau IIA with 2 to 5
+  stages on the Robertson problem. Exits with failure on a mismatch.
+*/
+int main()
+{
+  bool ok = true;
+  auto rhs = std::make_shared<Robertson>();
+  size_t n = rhs->dimX();
+  Vector<> y { 0.9, 2e-5, 0.1 };
+
+  for (bool radau : { false, true })
+    for (int s = 2; s <= 5; s++)
+      for (double tau : { 1e-3, 1e-1 })
+        {
+          Vector<> c(s), w(s);
+          if (radau)
+            GaussRadau(c, w);
+          else
+            GaussLegendre(c, w);
+          auto [a, b] = ComputeABfromC(c);
+
+          ImplicitRungeKutta irk(rhs, a, b, c);
+          irk.SolveStages(tau, y, 1e-12);
+
+          // the same stage equations, with a full Newton iteration
+          auto yold = std::make_shared<ConstantFunction>(s*n);
+          for (size_t i = 0; i < s*n; i++)
+            yold->get()(i) = y(i % n);
+          auto equ = std::make_shared<IdentityFunction>(s*n)
+            - Compose(std::make_shared<MultipleFunc>(rhs, s),
+                      yold + tau*std::make_shared<MatVecFunc>(a, n));
+          Vector<> k(s*n);
+          k = 0.0;
+          NewtonSolverContext(equ).solve(equ, k, 1e-12);
+
+          double diff = 0;
+          for (int j = 0; j < s; j++)
+            for (size_t i = 0; i < n; i++)
+              diff = std::max(diff, std::fabs(irk.stage(j)(i) - k(j*n+i)) / (std::fabs(k(j*n+i)) + 1e-3));
+          std::cout << std::setw(6) << (radau ? "Radau" : "Gauss") << " s = " << s << ", tau = "
+                    << std::setw(5) << tau << (irk.transformed() ? "" : " (not transformed)")
+                    << ": max relative stage difference " << diff << std::endl;
+          ok = ok && irk.transformed() && diff < 1e-8;
+        }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
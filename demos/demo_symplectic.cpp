@@ -0,0 +1,120 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+
+#include <mass_spring.hpp>
+#include <Newmark.hpp>
+#include <symplectic.hpp>
+
+using namespace ASC_ode;
+
+
+/*
+  Long runs of a swinging spring chain: the explicit symplectic splitting
+  methods keep the energy error bounded at O(n) cost per step, against
+  the implicit Newmark and generalized alpha methods. A chain of rigid
+  links shows the RATTLE version with distance constraints.
+*/
+
+static double timed (std::function<void()> func)
+{
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+// straight chain released at an angle from the vertical
+static MassSpringSystem<2> Chain (size_t n, bool rigid, double angle = 0.3)
+{
+  MassSpringSystem<2> mss;
+  mss.setGravity( {0,-9.81} );
+  auto prev = mss.addFix( { { 0.0, 0.0 } } );
+  for (size_t i = 0; i < n; i++)
+    {
+      auto m = mss.addMass( { 1, { 0.2*(i+1)*std::sin(angle), -0.2*(i+1)*std::cos(angle) } } );
+      if (rigid)
+        mss.addDistanceConstraint(DistanceConstraint(prev, m, 0.2));
+      else
+        mss.addSpring( { 0.2, 1e3, { prev, m } } );
+      prev = m;
+    }
+  return mss;
+}
+
+int main()
+{
+  double tend = 100;
+  size_t steps = 40000, chunks = 100;
+
+  std::cout << "Chain of 20 masses, k = 1e3, t in [0," << tend << "], " << steps << " steps" << std::endl;
+  std::cout << std::setw(14) << "method" << std::setw(16) << "max |E-E0|"
+            << std::setw(16) << "final E-E0" << std::setw(12) << "time [s]" << std::endl;
+
+  for (std::string name : { "verlet", "yoshida4", "blanesmoan", "yoshida6" })
+    {
+      auto mss = Chain(20, false);
+      double E0 = MSS_Energy(mss), maxdev = 0;
+      double time = timed([&]
+      {
+        for (size_t c = 0; c < chunks; c++)
+          {
+            SolveODE_Symplectic(mss, tend/chunks, steps/chunks, SymplecticMethodByName(name));
+            maxdev = std::max(maxdev, std::fabs(MSS_Energy(mss)-E0));
+          }
+      });
+      std::cout << std::setw(14) << name << std::setw(16) << maxdev
+                << std::setw(16) << MSS_Energy(mss)-E0 << std::setw(12) << time << std::endl;
+    }
+
+  for (std::string name : { "Newmark", "alpha(0.8)" })
+    {
+      auto mss = Chain(20, false);
+      double E0 = MSS_Energy(mss), maxdev = 0;
+      size_t n = 2*mss.masses().size();
+      Vector<> x(n), dx(n), ddx(n);
+      mss.getState(x, dx, ddx);
+      auto mss_func = std::make_shared<MSS_Function<2>> (mss);
+      auto mass = std::make_shared<IdentityFunction> (n);
+      mss_func->evaluate(x, ddx);
+      double time = timed([&]
+      {
+        for (size_t c = 0; c < chunks; c++)
+          {
+            if (name == "Newmark")
+              SolveODE_Newmark(tend/chunks, steps/chunks, x, dx, mss_func, mass);
+            else
+              SolveODE_Alpha(tend/chunks, steps/chunks, 0.8, x, dx, ddx, mss_func, mass);
+            mss.setState(x, dx, ddx);
+            maxdev = std::max(maxdev, std::fabs(MSS_Energy(mss)-E0));
+          }
+      });
+      std::cout << std::setw(14) << name << std::setw(16) << maxdev
+                << std::setw(16) << MSS_Energy(mss)-E0 << std::setw(12) << time << std::endl;
+    }
+
+  std::cout << std::endl << "Chain of 20 rigid links (RATTLE), t in [0," << tend << "], " << steps << " steps" << std::endl;
+  std::cout << std::setw(14) << "method" << std::setw(16) << "max |E-E0|"
+            << std::setw(16) << "max |g(q)|" << std::setw(12) << "time [s]" << std::endl;
+  for (std::string name : { "verlet", "yoshida4" })
+    {
+      auto mss = Chain(20, true);
+      double E0 = MSS_Energy(mss), maxdev = 0, maxviol = 0;
+      double time = timed([&]
+      {
+        for (size_t c = 0; c < chunks; c++)
+          {
+            SolveODE_Symplectic(mss, tend/chunks, steps/chunks, SymplecticMethodByName(name));
+            maxdev = std::max(maxdev, std::fabs(MSS_Energy(mss)-E0));
+            for (auto & dc : mss.constraints())
+              {
+                Vec<2> p1 = dc.c1.type == Connector::FIX ? mss.fixes()[dc.c1.nr].pos : mss.masses()[dc.c1.nr].pos;
+                Vec<2> p2 = dc.c2.type == Connector::FIX ? mss.fixes()[dc.c2.nr].pos : mss.masses()[dc.c2.nr].pos;
+                maxviol = std::max(maxviol, std::fabs(norm(p1-p2) - dc.rest_length));
+              }
+          }
+      });
+      std::cout << std::setw(14) << name << std::setw(16) << maxdev
+                << std::setw(16) << maxviol << std::setw(12) << time << std::endl;
+    }
+}
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+
+#include <nonlinfunc.hpp>
+#include <tape.hpp>
+
+using namespace ASC_ode;
+
+#include <mass_spring.hpp>
+
+
+// the residual of SolveODE_Alpha in the unknown acceleration, as a tree
+static std::shared_ptr<NonlinearFunction>
+AlphaResidual (double dt, double rhoinf, std::shared_ptr<NonlinearFunction> rhs,
+               std::shared_ptr<NonlinearFunction> mass,
+               VectorView<double> x, VectorView<double> dx, VectorView<double> ddx)
+{
+  double alpham = (2*rhoinf-1)/(rhoinf+1);
+  double alphaf = rhoinf/(rhoinf+1);
+  double gamma = 0.5-alpham+alphaf;
+  double beta = 0.25 * (1-alpham+alphaf)*(1-alpham+alphaf);
+
+  auto xold = std::make_shared<ConstantFunction>(x);
+  auto vold = std::make_shared<ConstantFunction>(dx);
+  auto aold = std::make_shared<ConstantFunction>(ddx);
+  auto anew = std::make_shared<IdentityFunction>(x.size());
+  auto vnew = vold + dt*((1-gamma)*aold+gamma*anew);
+  auto xnew = xold + dt*vold + dt*dt/2 * ((1-2*beta)*aold+2*beta*anew);
+  return Compose(mass, (1-alpham)*anew+alpham*aold) - (1-alphaf)*Compose(rhs,xnew) - alphaf*Compose(rhs, xold);
+}
+
+
+/*
+  The compiled tape against the tree it was compiled from, on the residual
+  of the generalized-alpha method for a chain of masses and springs, with
+  and without distance constraints, and on the stage equations of a
+  3-stage implicit Runge-Kutta method: values and Jacobians at random
+  points must agree. Then the time per evaluation of both. Exits with
+  failure on a mismatch.
+*/
+int main()
+{
+  bool ok = true;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> uni(-1, 1);
+
+  auto check = [&](std::string name, std::shared_ptr<NonlinearFunction> tree)
+  {
+    auto tape = compile(tree);
+    size_t n = tree->dimX(), nf = tree->dimF();
+    std::cout << name << ", " << n << " unknowns: " << tape->numInstructions() << " instructions, "
+              << tape->numSlots() << " slots" << std::endl;
+
+    Vector<> a(n), ftree(nf), ftape(nf), fwd(nf);
+    Matrix<> dtree(nf, n), dtape(nf, n), dwd(nf, n);
+    double maxerr = 0;
+    for (int sample = 0; sample < 10; sample++)
+      {
+        for (size_t i = 0; i < n; i++)
+          a(i) = 10*uni(gen);
+        tree->evaluate(a, ftree);
+        tree->evaluateDeriv(a, dtree);
+        tape->evaluate(a, ftape);
+        tape->evaluateDeriv(a, dtape);
+        tape->evaluateWithDeriv(a, fwd, dwd);
+        double scale = norm(ftree) + 1;
+        maxerr = std::max({ maxerr, norm(ftape - ftree) / scale, norm(fwd - ftree) / scale });
+        for (size_t i = 0; i < nf; i++)
+          for (size_t j = 0; j < n; j++)
+            maxerr = std::max({ maxerr, std::fabs(dtape(i,j) - dtree(i,j)) / (std::fabs(dtree(i,j)) + 1),
+                                std::fabs(dwd(i,j) - dtree(i,j)) / (std::fabs(dtree(i,j)) + 1) });
+      }
+    std::cout << "  max relative difference tape - tree: " << maxerr << std::endl;
+    ok = ok && maxerr < 1e-12;
+
+    using clock = std::chrono::steady_clock;
+    auto time = [&](auto && func)
+    {
+      int runs = 0;
+      auto start = clock::now();
+      double seconds;
+      do
+        {
+          func();
+          runs++;
+          seconds = std::chrono::duration<double>(clock::now()-start).count();
+        }
+      while (seconds < 0.2);
+      return 1e6 * seconds / runs;
+    };
+    std::cout << std::setprecision(3)
+              << "  evaluate:      tree " << std::setw(8) << time([&] { tree->evaluate(a, ftree); })
+              << " us, tape " << std::setw(8) << time([&] { tape->evaluate(a, ftape); }) << " us" << std::endl
+              << "  evaluateDeriv: tree " << std::setw(8) << time([&] { tree->evaluateDeriv(a, dtree); })
+              << " us, tape " << std::setw(8) << time([&] { tape->evaluateDeriv(a, dtape); }) << " us"
+              << std::endl << std::setprecision(6);
+  };
+
+  for (bool constrained : { false, true })
+    {
+      MassSpringSystem<2> mss;
+      mss.setGravity( { 0, -9.81 } );
+      auto prev = mss.addFix( { { 0.0, 0.0 } } );
+      for (int i = 1; i <= 40; i++)
+        {
+          auto m = mss.addMass( { 1, { double(i), 0.0 } } );
+          mss.addSpring( { 1, 100, { prev, m } } );
+          prev = m;
+        }
+      if (constrained)
+        mss.addDistanceConstraint( { mss.addFix( { { 40.0, -1.0 } } ), prev, 1.0 } );
+
+      std::shared_ptr<NonlinearFunction> rhs = std::make_shared<MSS_Function<2>>(mss);
+      std::shared_ptr<NonlinearFunction> mass;
+      if (constrained)
+        mass = std::make_shared<SystemMassFunction<2>>(mss);
+      else
+        mass = std::make_shared<IdentityFunction>(rhs->dimX());
+
+      size_t n = rhs->dimX();
+      Vector<> x(n), dx(n), ddx(n);
+      mss.getState(x.range(0, 80), dx.range(0, 80), ddx.range(0, 80));
+      for (size_t i = 0; i < n; i++)
+        {
+          x(i) += 0.1*uni(gen);
+          dx(i) = uni(gen);
+          ddx(i) = uni(gen);
+        }
+
+      check(constrained ? "alpha residual, chain with constraint" : "alpha residual, chain",
+            AlphaResidual(0.01, 0.8, rhs, mass, x, dx, ddx));
+
+      if (!constrained)
+        {
+          // the stage equations of ImplicitRungeKutta: Kronecker product, then block-diagonal
+          size_t stages = 3;
+          Matrix<> a(stages, stages);
+          for (size_t i = 0; i < stages; i++)
+            for (size_t j = 0; j < stages; j++)
+              a(i,j) = uni(gen);
+          auto yold = std::make_shared<ConstantFunction>(stages*n);
+          for (size_t i = 0; i < stages*n; i++)
+            yold->get()(i) = x(i % n);
+          auto tau = std::make_shared<Parameter>(0.01);
+          auto knew = std::make_shared<IdentityFunction>(stages*n);
+          check("implicit RK stages, chain",
+                knew - Compose(std::make_shared<MultipleFunc>(rhs, stages),
+                               yold + tau*std::make_shared<MatVecFunc>(a, n)));
+        }
+      else
+        // a diagonal after a general kernel
+        check("M f(2x) + f(x), chain with constraint",
+              Compose(mass, Compose(rhs, 2*std::make_shared<IdentityFunction>(n))) + rhs);
+    }
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,6 +2,7 @@
 #define NEWMARK_HPP
 
 #include <nonlinfunc.hpp>
+#include <tape.hpp>
 
 
 
@@ -15,7 +16,8 @@
                         VectorView<double> x, VectorView<double> dx,
                         std::shared_ptr<NonlinearFunction> rhs,   
                         std::shared_ptr<NonlinearFunction> mass,  
-                        std::function<void(double,VectorView<double>)> callback = nullptr)
+                        std::function<void(double,VectorView<double>)> callback = nullptr,
+                        NewtonSolverContext * newton = nullptr)
   {
     double dt = tend/steps;
     double gamma = 0.5;
@@ -33,12 +35,20 @@
     auto vnew = vold + dt*((1-gamma)*aold+gamma*anew);
     auto xnew = xold + dt*vold + dt*dt/2 * ((1-2*beta)*aold+2*beta*anew);    
 
-    auto equ = Compose(mass, anew) - Compose(rhs, xnew);
+    auto equ = compile(Compose(mass, anew) - Compose(rhs, xnew));
+
+    std::unique_ptr<NewtonSolverContext> localnewton;
+    if (!newton)
+      {
+        localnewton = std::make_unique<NewtonSolverContext>(equ);
+        newton = localnewton.get();
+      }
+    newton->jacobianReuse().setStepSize(dt);
 
     double t = 0;
     for (int i = 0; i < steps; i++)            
       {
-        NewtonSolver (equ, a);
+        newton->solve (equ, a);
         xnew -> evaluate (a, x);
         vnew -> evaluate (a, v);
 
@@ -59,7 +69,8 @@
                        VectorView<double> x, VectorView<double> dx, VectorView<double> ddx,
                        std::shared_ptr<NonlinearFunction> rhs,   
                        std::shared_ptr<NonlinearFunction> mass,  
-                       std::function<void(double,VectorView<double>)> callback = nullptr)
+                       std::function<void(double,VectorView<double>)> callback = nullptr,
+                       NewtonSolverContext * newton = nullptr)
   {
     double dt = tend/steps;
     double alpham = (2*rhoinf-1)/(rhoinf+1);
@@ -80,14 +91,22 @@
     auto xnew = xold + dt*vold + dt*dt/2 * ((1-2*beta)*aold+2*beta*anew);    
 
     // auto equ = Compose(mass, (1-alpham)*anew+alpham*aold) - Compose(rhs, (1-alphaf)*xnew+alphaf*xold);
-    auto equ = Compose(mass, (1-alpham)*anew+alpham*aold) - (1-alphaf)*Compose(rhs,xnew) - alphaf*Compose(rhs, xold);
+    auto equ = compile(Compose(mass, (1-alpham)*anew+alpham*aold) - (1-alphaf)*Compose(rhs,xnew) - alphaf*Compose(rhs, xold));
+
+    std::unique_ptr<NewtonSolverContext> localnewton;
+    if (!newton)
+      {
+        localnewton = std::make_unique<NewtonSolverContext>(equ);
+        newton = localnewton.get();
+      }
+    newton->jacobianReuse().setStepSize(dt);
 
     double t = 0;
     a = ddx;
 
     for (int i = 0; i < steps; i++)
       {
-        NewtonSolver (equ, a, 1e-9, 20);
+        newton->solve (equ, a, 1e-9, 20);
         xnew -> evaluate (a, x);
         vnew -> evaluate (a, v);
 
@@ -5,6 +5,8 @@
 
 #include "mass_spring.hpp"
 #include "Newmark.hpp"
+#include "symplectic.hpp"
+#include "multirate.hpp"
 
 namespace py = pybind11;
 
@@ -124,7 +126,7 @@ PYBIND11_MODULE(mass_spring, m) {
 
 
       // --- SIMULATION (MODIFIED FOR DAE/LAGRANGE) ---
-      .def("simulate", [](MassSpringSystem<3> & mss, double tend, size_t steps) {
+      .def("simulate", [](MassSpringSystem<3> & mss, double tend, size_t steps, bool simplified) {
         // Augmented dimensions (Mass DOFs + Constraint DOFs)
         size_t n_mass_dofs = 3 * mss.masses().size();
         size_t n_constraints = mss.constraints().size();
@@ -153,8 +155,12 @@ PYBIND11_MODULE(mass_spring, m) {
         // Use SystemMassFunction (which puts zeros on diagonal for multipliers)
         auto mass = std::make_shared<SystemMassFunction<3>> (mss);
 
+        // Simplified Newton reuses the factored Jacobian across time steps
+        NewtonSolverContext newton(n_total, n_total);
+        newton.jacobianReuse().simplified = simplified;
+
         // Solve using Generalized Alpha (rho_inf=0.8 damps high freq noise)
-        SolveODE_Alpha(tend, steps, 0.8, x, dx, ddx, mss_func, mass);
+        SolveODE_Alpha(tend, steps, 0.8, x, dx, ddx, mss_func, mass, nullptr, &newton);
 
         // Copy physical state back to mss
         for(size_t i=0; i<n_mass_dofs; i++) {
@@ -163,5 +169,19 @@ PYBIND11_MODULE(mass_spring, m) {
             ddx_mass(i) = ddx(i);
         }
         mss.setState (x_mass, dx_mass, ddx_mass);  
-    });
+    }, py::arg("tend"), py::arg("steps"), py::arg("simplified") = false)
+
+      // explicit symplectic splitting, RATTLE steps with distance constraints
+      .def("simulateSymplectic", [](MassSpringSystem<3> & mss, double tend, size_t steps, std::string method) {
+        SolveODE_Symplectic(mss, tend, steps, SymplecticMethodByName(method));
+    }, py::arg("tend"), py::arg("steps"), py::arg("method") = "verlet")
+
+      // multirate Verlet, fast masses tagged or (empty list) found from the local stiffness
+      .def("simulateMultirate", [](MassSpringSystem<3> & mss, double tend, size_t steps, std::vector<bool> fast) {
+        double tau = tend/steps;
+        auto part = fast.empty() ? MSS_MultiratePartition(mss, tau) : MSS_MultiratePartition(mss, tau, fast);
+        SolveODE_Multirate(mss, tend, steps, part);
+    }, py::arg("tend"), py::arg("steps"), py::arg("fast") = std::vector<bool>())
+
+      .def("energy", [](MassSpringSystem<3> & mss) { return MSS_Energy(mss); });
 }
\ No newline at end of file
@@ -204,6 +204,39 @@ public:
       for (size_t d = 0; d < D; d++)
         df(i*D + d, i*D + d) = mss.masses()[i].mass;
   }
+
+  virtual JacobianStructure derivStructure() const override
+  {
+    return { JacobianStructure::DIAGONAL };
+  }
+
+  virtual void evaluateDerivDiag (VectorView<double> x, VectorView<double> diag) const override
+  {
+    diag = 0.0;
+    for (size_t i = 0; i < mss.masses().size(); i++)
+      for (size_t d = 0; d < D; d++)
+        diag(i*D + d) = mss.masses()[i].mass;
+  }
+
+  virtual void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    for (size_t i = 0; i < D * mss.masses().size(); i++)
+      pattern.add(i, i, 1.0);
+  }
+
+  virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    for (size_t i = 0; i < mss.masses().size(); i++)
+      for (size_t d = 0; d < D; d++)
+        df.add(i*D + d, i*D + d, mss.masses()[i].mass);
+  }
+
+  bool exactJacVec() const override { return true; }
+  virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                               VectorView<double> Jv) const override
+  {
+    evaluate(v, Jv);
+  }
 };
 
 
@@ -216,9 +249,10 @@ template <int D>
 class MSS_Function : public NonlinearFunction
 {
   MassSpringSystem<D> & mss;
+  bool m_gravity;     // include the external forces
 public:
-  MSS_Function (MassSpringSystem<D> & _mss)
-    : mss(_mss) { }
+  MSS_Function (MassSpringSystem<D> & _mss, bool gravity = true)
+    : mss(_mss), m_gravity(gravity) { }
 
   virtual size_t dimX() const override { return D*mss.masses().size() + mss.constraints().size(); }
   virtual size_t dimF() const override{ return D*mss.masses().size() + mss.constraints().size(); }
@@ -227,109 +261,121 @@ public:
   {
     f = 0.0;
     size_t n_masses = mss.masses().size();
-    size_t n_constraints = mss.constraints().size();
-
-    auto xmat = x.asMatrix(n_masses, D);
-    auto fmat = f.asMatrix(n_masses, D); 
+    auto fmat = f.asMatrix(n_masses, D);
 
     // 1. Gravity (External Force)
-    for (size_t i = 0; i < n_masses; i++)
-      fmat.row(i) = mss.masses()[i].mass*mss.getGravity();
-
-    // 2. Springs (Elastic Force)
-    for (auto spring : mss.springs())
-      {
-        auto [c1,c2] = spring.connectors;
-        Vec<D> p1, p2;
-        if (c1.type == Connector::FIX) p1 = mss.fixes()[c1.nr].pos;
-        else p1 = xmat.row(c1.nr);
-        
-        if (c2.type == Connector::FIX) p2 = mss.fixes()[c2.nr].pos;
-        else p2 = xmat.row(c2.nr);
-
-        double L = norm(p1-p2);
-        if (L < 1e-12) continue;
-
-        double force = spring.stiffness * (L-spring.length);
-        Vec<D> dir12 = (1.0/L) * (p2-p1); // Direction p1 -> p2
-        
-        if (c1.type == Connector::MASS) fmat.row(c1.nr) += force*dir12;
-        if (c2.type == Connector::MASS) fmat.row(c2.nr) -= force*dir12;
-      }
-
-    // 3. Constraints (Lagrange Forces and Constraint Equations)
-    for (size_t i = 0; i < n_constraints; i++)
-    {
-        auto& dc = mss.constraints()[i];
-        double lambda = x(D * n_masses + i); // The multiplier is at the end of vector x
+    if (m_gravity)
+      for (size_t i = 0; i < n_masses; i++)
+        fmat.row(i) = mss.masses()[i].mass*mss.getGravity();
 
-        Vec<D> p1 = (dc.c1.type == Connector::FIX) ? mss.fixes()[dc.c1.nr].pos : xmat.row(dc.c1.nr);
-        Vec<D> p2 = (dc.c2.type == Connector::FIX) ? mss.fixes()[dc.c2.nr].pos : xmat.row(dc.c2.nr);
-        
-        Vec<D> d = p1 - p2; // Vector p2 -> p1
-        double L = norm(d);
-        if (L < 1e-12) continue;
-        
-        Vec<D> dir = d / L; // Gradient of C with respect to p1
-
-        // Constraint Force (-lambda * gradient) moved to the RHS (force side)
-        // Since we solve Ma = F, and Lagrange term is usually on LHS (Ma + G^T lambda = F_ext),
-        // we move it to RHS: Ma = F_ext - G^T lambda.
-        if (dc.c1.type == Connector::MASS) fmat.row(dc.c1.nr) -= lambda * dir;
-        if (dc.c2.type == Connector::MASS) fmat.row(dc.c2.nr) += lambda * dir;
-
-        // Constraint Equation: C(x) = L - L0 = 0
-        // Since the solver solves M*a - F = 0, and for the lambda row M=0, we need -F_lambda = 0.
-        // We set F_lambda = L - L0. So 0 - (L - L0) = 0  => L = L0.
-        f(D * n_masses + i) = (L - dc.rest_length);
-    }
+    // 2. Springs, 3. Constraints: the forces of the Jacobian assembly,
+    // without the Jacobian entries
+    assemble (x, [&](size_t i, double v) { f(i) += v; }, [](size_t, size_t, double) { });
   }
   
   // Exact Derivative (Jacobian Matrix)
   virtual void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
   {
+    df = 0.0;
+    assembleDeriv (x, [&](size_t i, size_t j, double v) { df(i,j) += v; });
+  }
+
+  // forces and Jacobian from one pass over springs and constraints
+  virtual void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                                  MatrixView<double> df) const override
+  {
+    f = 0.0;
     df = 0.0;
     size_t n_masses = mss.masses().size();
-    auto X = x.asMatrix(n_masses, D);
+    auto fmat = f.asMatrix(n_masses, D);
+    if (m_gravity)
+      for (size_t i = 0; i < n_masses; i++)
+        fmat.row(i) = mss.masses()[i].mass*mss.getGravity();
+
+    assemble (x,
+              [&](size_t i, double v) { f(i) += v; },
+              [&](size_t i, size_t j, double v) { df(i,j) += v; });
+  }
 
-    // --- Part A: Spring Stiffness ---
-    for (auto &spring : mss.springs())
+  // Every spring and constraint couples the D x D blocks of its two masses,
+  // constraints additionally couple to their multiplier
+  virtual void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    size_t n_masses = mss.masses().size();
+    auto addBlocks = [&](Connector c1, Connector c2)
     {
-        auto [c1, c2] = spring.connectors;
-        Vec<D> p1 = (c1.type == Connector::FIX) ? mss.fixes()[c1.nr].pos : X.row(c1.nr);
-        Vec<D> p2 = (c2.type == Connector::FIX) ? mss.fixes()[c2.nr].pos : X.row(c2.nr);
+      for (auto ca : { c1, c2 })
+        for (auto cb : { c1, c2 })
+          if (ca.type == Connector::MASS && cb.type == Connector::MASS)
+            for (size_t i = 0; i < D; i++)
+              for (size_t j = 0; j < D; j++)
+                pattern.add(ca.nr*D + i, cb.nr*D + j, 1.0);
+    };
 
-        Vec<D> d = p2 - p1;
-        double L = norm(d);
-        if (L < 1e-12) continue; 
+    for (auto &spring : mss.springs())
+      addBlocks(spring.connectors[0], spring.connectors[1]);
 
-        Vec<D> n = d / L;
-        double k = spring.stiffness;
-        double L0 = spring.length;
-        
-        // Geometric stiffness term due to spring tension
-        double force_over_L = k * (L - L0) / L;
+    for (size_t k = 0; k < mss.constraints().size(); k++)
+      {
+        auto &dc = mss.constraints()[k];
+        addBlocks(dc.c1, dc.c2);
+        for (auto c : { dc.c1, dc.c2 })
+          if (c.type == Connector::MASS)
+            for (size_t i = 0; i < D; i++)
+              {
+                pattern.add(c.nr*D + i, D*n_masses + k, 1.0);
+                pattern.add(D*n_masses + k, c.nr*D + i, 1.0);
+              }
+      }
+  }
 
-        for (size_t i = 0; i < D; i++)
-        for (size_t j = 0; j < D; j++)
-        {
-            double ninj = n(i)*n(j);
-            // K_ij = k * n_i*n_j + (f/L) * (delta_ij - n_i*n_j)
-            double Kij = k * ninj + force_over_L * ((i==j?1.0:0.0) - ninj);
-            
-            // We want dF/dx. Spring force pulls towards the other point.
-            if (c1.type == Connector::MASS) 
-                df(c1.nr*D + i, c1.nr*D + j) -= Kij; 
-            
-            if (c2.type == Connector::MASS) 
-                df(c2.nr*D + i, c2.nr*D + j) -= Kij; 
-            
-            if (c1.type == Connector::MASS && c2.type == Connector::MASS) {
-                df(c1.nr*D + i, c2.nr*D + j) += Kij; 
-                df(c2.nr*D + i, c1.nr*D + j) += Kij; 
-            }
-        }
-    }
+  virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    assembleDeriv (x, [&](size_t i, size_t j, double v) { df.add(i, j, v); });
+  }
+
+  bool exactJacVec() const override { return true; }
+  // exact product with the Jacobian, O(springs + constraints)
+  virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                               VectorView<double> Jv) const override
+  {
+    Jv = 0.0;
+    assembleDeriv (x, [&](size_t i, size_t j, double val) { Jv(i) += val * v(j); });
+  }
+
+  // forces and Jacobian entries of the springs with the given numbers only,
+  // without gravity and constraints, x may hold the positions only
+  template <typename ADDF, typename ADD>
+  void assemble (VectorView<double> x, const std::vector<size_t> & springs,
+                 ADDF addf, ADD add) const
+  {
+    auto X = x.asMatrix(mss.masses().size(), D);
+    for (size_t s : springs)
+      assembleSpring (X, mss.springs()[s], addf, add);
+  }
+
+private:
+  template <int> friend class MSS_FirstOrder;
+
+  // calls add(row, col, value) for every Jacobian entry, shared by the
+  // dense and the sparse derivative
+  template <typename ADD>
+  void assembleDeriv (VectorView<double> x, ADD add) const
+  {
+    assemble (x, [](size_t, double) { }, add);
+  }
+
+  // as assembleDeriv, additionally calls addf(row, value) for the
+  // spring and constraint forces and the constraint equations
+  template <typename ADDF, typename ADD>
+  void assemble (VectorView<double> x, ADDF addf, ADD add) const
+  {
+    size_t n_masses = mss.masses().size();
+    auto X = x.asMatrix(n_masses, D);
+
+    // --- Part A: Spring Stiffness ---
+    for (auto &spring : mss.springs())
+      assembleSpring (X, spring, addf, add);
 
     // --- Part B: Constraints and Multipliers ---
     for (size_t k = 0; k < mss.constraints().size(); k++)
@@ -350,6 +396,15 @@ public:
         // Geometric stiffness due to constraint tension (lambda)
         double lambda_over_L = lambda / L;
 
+        // Constraint force -lambda * grad C on the force side (M a = F_ext - G^T lambda),
+        // the multiplier row holds C(x) = L - L0, its mass row is zero
+        for (size_t i = 0; i < D; i++)
+        {
+            if (dc.c1.type == Connector::MASS) addf(dc.c1.nr*D + i, -lambda * n(i));
+            if (dc.c2.type == Connector::MASS) addf(dc.c2.nr*D + i, lambda * n(i));
+        }
+        addf(idx_lambda, L - dc.rest_length);
+
         for (size_t i = 0; i < D; i++)
         for (size_t j = 0; j < D; j++)
         {
@@ -357,27 +412,175 @@ public:
             // It contributes to dF/dx (Linearization of the constraint force)
             double Hij = lambda_over_L * ((i==j?1.0:0.0) - n(i)*n(j));
 
-            if (dc.c1.type == Connector::MASS) df(dc.c1.nr*D + i, dc.c1.nr*D + j) -= Hij;
-            if (dc.c2.type == Connector::MASS) df(dc.c2.nr*D + i, dc.c2.nr*D + j) -= Hij;
+            if (dc.c1.type == Connector::MASS) add(dc.c1.nr*D + i, dc.c1.nr*D + j, -Hij);
+            if (dc.c2.type == Connector::MASS) add(dc.c2.nr*D + i, dc.c2.nr*D + j, -Hij);
             if (dc.c1.type == Connector::MASS && dc.c2.type == Connector::MASS) {
-                df(dc.c1.nr*D + i, dc.c2.nr*D + j) += Hij;
-                df(dc.c2.nr*D + i, dc.c1.nr*D + j) += Hij;
+                add(dc.c1.nr*D + i, dc.c2.nr*D + j, Hij);
+                add(dc.c2.nr*D + i, dc.c1.nr*D + j, Hij);
             }
         }
 
         // Cross-blocks: dF/dlambda (Gradient^T) and dConstraint/dx (Gradient)
         for (size_t i = 0; i < D; i++) {
             if (dc.c1.type == Connector::MASS) {
-                df(dc.c1.nr*D + i, idx_lambda) -= n(i); // dF1 / dLambda
-                df(idx_lambda, dc.c1.nr*D + i) += n(i); // dConstraint / dp1
+                add(dc.c1.nr*D + i, idx_lambda, -n(i)); // dF1 / dLambda
+                add(idx_lambda, dc.c1.nr*D + i, n(i)); // dConstraint / dp1
             }
             if (dc.c2.type == Connector::MASS) {
-                df(dc.c2.nr*D + i, idx_lambda) += n(i); // dF2 / dLambda
-                df(idx_lambda, dc.c2.nr*D + i) -= n(i); // dConstraint / dp2
+                add(dc.c2.nr*D + i, idx_lambda, n(i)); // dF2 / dLambda
+                add(idx_lambda, dc.c2.nr*D + i, -n(i)); // dConstraint / dp2
             }
         }
     }
   }
+
+  // force and stiffness of one spring
+  template <typename MAT, typename ADDF, typename ADD>
+  void assembleSpring (const MAT & X, const Spring & spring, ADDF addf, ADD add) const
+  {
+    auto [c1, c2] = spring.connectors;
+    Vec<D> p1 = (c1.type == Connector::FIX) ? mss.fixes()[c1.nr].pos : X.row(c1.nr);
+    Vec<D> p2 = (c2.type == Connector::FIX) ? mss.fixes()[c2.nr].pos : X.row(c2.nr);
+
+    Vec<D> d = p2 - p1;
+    double L = norm(d);
+    if (L < 1e-12) return;
+
+    Vec<D> n = d / L;
+    double k = spring.stiffness;
+    double L0 = spring.length;
+    
+    // Geometric stiffness term due to spring tension
+    double force_over_L = k * (L - L0) / L;
+
+    for (size_t i = 0; i < D; i++)
+    {
+        if (c1.type == Connector::MASS) addf(c1.nr*D + i, k * (L - L0) * n(i));
+        if (c2.type == Connector::MASS) addf(c2.nr*D + i, -k * (L - L0) * n(i));
+    }
+
+    for (size_t i = 0; i < D; i++)
+    for (size_t j = 0; j < D; j++)
+    {
+        double ninj = n(i)*n(j);
+        // K_ij = k * n_i*n_j + (f/L) * (delta_ij - n_i*n_j)
+        double Kij = k * ninj + force_over_L * ((i==j?1.0:0.0) - ninj);
+        
+        // We want dF/dx. Spring force pulls towards the other point.
+        if (c1.type == Connector::MASS) 
+            add(c1.nr*D + i, c1.nr*D + j, -Kij); 
+        
+        if (c2.type == Connector::MASS) 
+            add(c2.nr*D + i, c2.nr*D + j, -Kij); 
+        
+        if (c1.type == Connector::MASS && c2.type == Connector::MASS) {
+            add(c1.nr*D + i, c2.nr*D + j, Kij); 
+            add(c2.nr*D + i, c1.nr*D + j, Kij); 
+        }
+    }
+  }
+};
+
+
+// --- CLASS 3: FIRST ORDER FORM ---
+// x = (positions, velocities), x' = (velocities, M^-1 F(positions)),
+// for systems without constraints. The spring forces are stiff and form
+// the implicit part of a split right hand side, gravity is the explicit part.
+
+template <int D>
+class MSS_FirstOrder : public NonlinearFunction
+{
+  MassSpringSystem<D> & mss;
+  MSS_Function<D> m_springs;
+  SplitPart m_part;
+public:
+  MSS_FirstOrder (MassSpringSystem<D> & _mss, SplitPart part = SplitPart::ALL)
+    : mss(_mss), m_springs(_mss, false), m_part(part)
+  {
+    if (mss.constraints().size())
+      throw std::invalid_argument("MSS_FirstOrder: constraints need the DAE form");
+  }
+
+  virtual size_t dimX() const override { return 2*D*mss.masses().size(); }
+  virtual size_t dimF() const override { return 2*D*mss.masses().size(); }
+
+  virtual void evaluate (VectorView<double> x, VectorView<double> f) const override
+  {
+    size_t n_masses = mss.masses().size();
+    size_t nq = D*n_masses;
+    f = 0.0;
+    auto acc = f.range(nq, 2*nq);
+    if (m_part != SplitPart::EXPLICIT)
+      {
+        f.range(0, nq) = x.range(nq, 2*nq);
+        m_springs.evaluate(x.range(0, nq), acc);
+        auto accmat = acc.asMatrix(n_masses, D);
+        for (size_t i = 0; i < n_masses; i++)
+          accmat.row(i) *= 1.0/mss.masses()[i].mass;
+      }
+    if (m_part != SplitPart::IMPLICIT)
+      {
+        auto accmat = acc.asMatrix(n_masses, D);
+        for (size_t i = 0; i < n_masses; i++)
+          accmat.row(i) += mss.getGravity();
+      }
+  }
+
+  virtual void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+  {
+    df = 0.0;
+    assembleDeriv (x, [&](size_t i, size_t j, double v) { df(i,j) += v; });
+  }
+
+  virtual void sparsityPattern (SparseMatrix & pattern) const override
+  {
+    if (m_part == SplitPart::EXPLICIT) return;
+    size_t nq = D*mss.masses().size();
+    for (size_t i = 0; i < nq; i++)
+      pattern.add(i, nq+i, 1.0);
+    for (auto &spring : mss.springs())
+      for (auto ca : spring.connectors)
+        for (auto cb : spring.connectors)
+          if (ca.type == Connector::MASS && cb.type == Connector::MASS)
+            for (size_t i = 0; i < D; i++)
+              for (size_t j = 0; j < D; j++)
+                pattern.add(nq + ca.nr*D + i, cb.nr*D + j, 1.0);
+  }
+
+  virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+  {
+    assembleDeriv (x, [&](size_t i, size_t j, double v) { df.add(i, j, v); });
+  }
+
+  bool exactJacVec() const override { return true; }
+  virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                               VectorView<double> Jv) const override
+  {
+    Jv = 0.0;
+    assembleDeriv (x, [&](size_t i, size_t j, double val) { Jv(i) += val * v(j); });
+  }
+
+private:
+  // gravity is constant, only the implicit part has a derivative
+  template <typename ADD>
+  void assembleDeriv (VectorView<double> x, ADD add) const
+  {
+    if (m_part == SplitPart::EXPLICIT) return;
+    size_t nq = D*mss.masses().size();
+    for (size_t i = 0; i < nq; i++)
+      add(i, nq+i, 1.0);
+    m_springs.assembleDeriv (x.range(0, nq), [&](size_t i, size_t j, double v)
+                             { add(nq+i, j, v / mss.masses()[i/D].mass); });
+  }
 };
 
+// stiff springs implicit, gravity explicit
+template <int D>
+auto MSS_SplitFunction (MassSpringSystem<D> & mss)
+{
+  return std::make_shared<AdditiveFunction>
+    (std::make_shared<MSS_FirstOrder<D>>(mss, SplitPart::IMPLICIT),
+     std::make_shared<MSS_FirstOrder<D>>(mss, SplitPart::EXPLICIT));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,246 @@
+#ifndef MULTIRATE_HPP
+#define MULTIRATE_HPP
+
+#include <cmath>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+
+#include "mass_spring.hpp"
+#include "symplectic.hpp"
+
+
+// masses of the fast group, and the number of fast steps per macro step
+struct MultiratePartition
+{
+  std::vector<bool> fast;
+  size_t substeps = 1;
+};
+
+
+// omega_i = sqrt(2 sum_springs k / m_i), bounds the frequencies mass i takes part in
+template <int D>
+std::vector<double> MSS_LocalFrequencies (MassSpringSystem<D> & mss)
+{
+  std::vector<double> stiffness(mss.masses().size(), 0.0);
+  for (auto & spring : mss.springs())
+    for (auto c : spring.connectors)
+      if (c.type == Connector::MASS)
+        stiffness[c.nr] += spring.stiffness;
+
+  std::vector<double> omega(stiffness.size());
+  for (size_t i = 0; i < omega.size(); i++)
+    omega[i] = std::sqrt(2 * stiffness[i] / mss.masses()[i].mass);
+  return omega;
+}
+
+
+/*
+  Partition by user tags: masses joined by distance constraints end up in
+  the same group, so a constrained component with one fast mass is fast.
+  The fast step tau/substeps satisfies tau/substeps * omega_i <= safety on
+  the fast masses (Stoermer-Verlet needs < 2).
+*/
+template <int D>
+MultiratePartition MSS_MultiratePartition (MassSpringSystem<D> & mss, double tau,
+                                           std::vector<bool> fast, double safety = 1)
+{
+  size_t n = mss.masses().size();
+  if (fast.size() != n)
+    throw std::invalid_argument("MSS_MultiratePartition: one tag per mass");
+
+  for (bool changed = true; changed; )
+    {
+      changed = false;
+      for (auto & dc : mss.constraints())
+        if (dc.c1.type == Connector::MASS && dc.c2.type == Connector::MASS
+            && fast[dc.c1.nr] != fast[dc.c2.nr])
+          {
+            fast[dc.c1.nr] = fast[dc.c2.nr] = true;
+            changed = true;
+          }
+    }
+
+  auto omega = MSS_LocalFrequencies(mss);
+  double omegamax = 0;
+  for (size_t i = 0; i < n; i++)
+    if (fast[i]) omegamax = std::max(omegamax, omega[i]);
+
+  MultiratePartition part;
+  part.fast = fast;
+  part.substeps = std::max<size_t>(1, size_t(std::ceil(tau * omegamax / safety)));
+  return part;
+}
+
+// automatic partition: masses with tau * omega_i > safety are fast
+template <int D>
+MultiratePartition MSS_MultiratePartition (MassSpringSystem<D> & mss, double tau, double safety = 1)
+{
+  auto omega = MSS_LocalFrequencies(mss);
+  std::vector<bool> fast(omega.size());
+  for (size_t i = 0; i < omega.size(); i++)
+    fast[i] = tau * omega[i] > safety;
+  return MSS_MultiratePartition(mss, tau, fast, safety);
+}
+
+
+/*
+  Multirate Stoermer-Verlet / RATTLE for a partitioned mass-spring system,
+  steps macro steps of size tau = tend/steps:
+    slow masses: half kick, drift over tau, (RATTLE projection)
+    fast masses: part.substeps Verlet steps of size tau/substeps, the slow
+                 masses they are coupled to by springs move linearly from
+                 their old to their new positions
+    slow masses: half kick with the forces at the new positions
+  Slow forces come from all springs at slow masses, fast forces from all
+  springs at fast masses, so a fast step costs O(springs at fast masses).
+  Constraints must not join the groups, see MSS_MultiratePartition.
+  The method is second order in tau; the slow masses see the fast ones only
+  at the macro steps, so slow masses coupled stiffly to fast ones should be
+  tagged fast as well.
+  Positions and velocities are read from and written back to the masses,
+  callback(t, x) gets the positions after every macro step.
+*/
+template <int D>
+void SolveODE_Multirate (MassSpringSystem<D> & mss, double tend, size_t steps,
+                         const MultiratePartition & part,
+                         std::function<void(double,VectorView<double>)> callback = nullptr,
+                         double ctol = 1e-12)
+{
+  size_t n_masses = mss.masses().size();
+  size_t nq = D*n_masses;
+  auto & fast = part.fast;
+  if (fast.size() != n_masses)
+    throw std::invalid_argument("SolveODE_Multirate: partition does not fit the system");
+
+  Vector<> q(nq), v(nq), f(nq), invmass(n_masses);
+  std::vector<size_t> fastMasses, slowMasses;
+  for (size_t i = 0; i < n_masses; i++)
+    {
+      invmass(i) = 1/mss.masses()[i].mass;
+      (fast[i] ? fastMasses : slowMasses).push_back(i);
+      for (int d = 0; d < D; d++)
+        {
+          q(i*D+d) = mss.masses()[i].pos(d);
+          v(i*D+d) = mss.masses()[i].vel(d);
+        }
+    }
+
+  // springs acting on each group, and the slow masses the fast springs see
+  auto isFast = [&](Connector c) { return c.type == Connector::MASS && fast[c.nr]; };
+  auto isSlow = [&](Connector c) { return c.type == Connector::MASS && !fast[c.nr]; };
+  std::vector<size_t> fastSprings, slowSprings, coupled;
+  std::vector<bool> isCoupled(n_masses, false);
+  for (size_t s = 0; s < mss.springs().size(); s++)
+    {
+      auto [c1, c2] = mss.springs()[s].connectors;
+      if (isFast(c1) || isFast(c2)) fastSprings.push_back(s);
+      if (isSlow(c1) || isSlow(c2)) slowSprings.push_back(s);
+      if (isFast(c1) || isFast(c2))
+        for (auto c : { c1, c2 })
+          if (isSlow(c) && !isCoupled[c.nr])
+            {
+              isCoupled[c.nr] = true;
+              coupled.push_back(c.nr);
+            }
+    }
+
+  std::vector<size_t> fastConstraints, slowConstraints;
+  for (size_t i = 0; i < mss.constraints().size(); i++)
+    {
+      auto & dc = mss.constraints()[i];
+      bool anyFast = isFast(dc.c1) || isFast(dc.c2);
+      bool anySlow = isSlow(dc.c1) || isSlow(dc.c2);
+      if (anyFast && anySlow)
+        throw std::invalid_argument("SolveODE_Multirate: a constraint joins the fast and the slow group");
+      (anyFast ? fastConstraints : slowConstraints).push_back(i);
+    }
+  MSS_Rattle<D> fastRattle(mss, invmass, fastConstraints);
+  MSS_Rattle<D> slowRattle(mss, invmass, slowConstraints);
+
+  // gravity and the given springs, added to the masses of one group
+  MSS_Function<D> springForces(mss);
+  auto forces = [&](const std::vector<size_t> & masses, const std::vector<size_t> & springs, bool group)
+  {
+    for (size_t i : masses)
+      for (int d = 0; d < D; d++)
+        f(i*D+d) = mss.masses()[i].mass * mss.getGravity()(d);
+    springForces.assemble(q, springs,
+                          [&](size_t row, double value) { if (fast[row/D] == group) f(row) += value; },
+                          [](size_t, size_t, double) { });
+  };
+  auto kick = [&](const std::vector<size_t> & masses, double h)
+  {
+    for (size_t i : masses)
+      for (int d = 0; d < D; d++)
+        v(i*D+d) += h * invmass(i) * f(i*D+d);
+  };
+  auto drift = [&](const std::vector<size_t> & masses, double h)
+  {
+    for (size_t i : masses)
+      for (int d = 0; d < D; d++)
+        q(i*D+d) += h * v(i*D+d);
+  };
+
+  Matrix<> qold(coupled.size(), D), qnew(coupled.size(), D);
+  auto interpolate = [&](double theta)
+  {
+    for (size_t l = 0; l < coupled.size(); l++)
+      for (int d = 0; d < D; d++)
+        q(coupled[l]*D+d) = (1-theta) * qold(l,d) + theta * qnew(l,d);
+  };
+
+  forces(slowMasses, slowSprings, false);
+  forces(fastMasses, fastSprings, true);
+  fastRattle.factor(q);
+  slowRattle.factor(q);
+
+  double tau = tend/steps;
+  size_t m = part.substeps;
+  double h = tau/m;
+  double t = 0;
+  for (size_t i = 0; i < steps; i++)
+    {
+      for (size_t l = 0; l < coupled.size(); l++)
+        for (int d = 0; d < D; d++)
+          qold(l,d) = q(coupled[l]*D+d);
+      kick(slowMasses, tau/2);
+      drift(slowMasses, tau);
+      slowRattle.projectPositions(q, v, tau, ctol);
+      for (size_t l = 0; l < coupled.size(); l++)
+        for (int d = 0; d < D; d++)
+          qnew(l,d) = q(coupled[l]*D+d);
+
+      // the fast forces at the start are known from the last step
+      for (size_t k = 1; k <= m; k++)
+        {
+          kick(fastMasses, h/2);
+          drift(fastMasses, h);
+          fastRattle.projectPositions(q, v, h, ctol);
+          interpolate(double(k)/m);
+          forces(fastMasses, fastSprings, true);
+          kick(fastMasses, h/2);
+          fastRattle.factor(q);
+          fastRattle.projectVelocities(v);
+        }
+
+      forces(slowMasses, slowSprings, false);
+      kick(slowMasses, tau/2);
+      slowRattle.factor(q);
+      slowRattle.projectVelocities(v);
+
+      t += tau;
+      if (callback) callback(t, q);
+    }
+
+  for (size_t i = 0; i < n_masses; i++)
+    for (int d = 0; d < D; d++)
+      {
+        mss.masses()[i].pos(d) = q(i*D+d);
+        mss.masses()[i].vel(d) = v(i*D+d);
+        mss.masses()[i].acc(d) = invmass(i) * f(i*D+d);
+      }
+}
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef SYMPLECTIC_HPP
+#define SYMPLECTIC_HPP
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <functional>
+#include <stdexcept>
+
+#include <sparsematrix.hpp>
+#include "mass_spring.hpp"
+
+
+// Splitting methods for M q'' = F(q): a step alternates kicks
+// v += kick_i h M^{-1} F(q) and drifts q += drift_i h v,
+//   kick_0, drift_0, kick_1, ..., drift_{s-1}, kick_s.
+// Methods composed of Stoermer-Verlet steps of sizes gamma_j h keep the
+// gamma_j, the constrained (RATTLE) version is built from these.
+struct SymplecticMethod
+{
+  std::vector<double> kick, drift;
+  std::vector<double> verletSteps;
+  int order;
+
+  // Verlet(gamma_1 h) ... Verlet(gamma_m h), the inner half kicks merged
+  static SymplecticMethod Composition (std::vector<double> gamma, int order)
+  {
+    SymplecticMethod m;
+    m.order = order;
+    m.verletSteps = gamma;
+    m.kick.push_back(gamma[0]/2);
+    for (size_t j = 0; j < gamma.size(); j++)
+      {
+        m.drift.push_back(gamma[j]);
+        m.kick.push_back(j+1 < gamma.size() ? (gamma[j]+gamma[j+1])/2 : gamma[j]/2);
+      }
+    return m;
+  }
+};
+
+// velocity form kick - drift - kick, order 2
+inline SymplecticMethod StoermerVerlet ()
+{
+  return SymplecticMethod::Composition({ 1.0 }, 2);
+}
+
+// triple jump of Yoshida (Forest-Ruth), order 4
+inline SymplecticMethod Yoshida4 ()
+{
+  double c = std::cbrt(2.0);
+  double g1 = 1 / (2 - c), g0 = -c / (2 - c);
+  return SymplecticMethod::Composition({ g1, g0, g1 }, 4);
+}
+
+// Yoshida's 7-step composition (solution A), order 6
+inline SymplecticMethod Yoshida6 ()
+{
+  double w1 = -1.17767998417887, w2 = 0.235573213359357, w3 = 0.784513610477560;
+  double w0 = 1 - 2*(w1+w2+w3);
+  return SymplecticMethod::Composition({ w3, w2, w1, w0, w1, w2, w3 }, 6);
+}
+
+// Blanes-Moan SRKN_6^b, order 4 with much smaller error constants than
+// the triple jump, 7 force evaluations (6 with FSAL)
+inline SymplecticMethod BlanesMoan4 ()
+{
+  double b1 = 0.0829844064174052, b2 = 0.396309801498368, b3 = -0.0390563049223486;
+  double b4 = 1 - 2*(b1+b2+b3);
+  double a1 = 0.245298957184271, a2 = 0.604872665711080;
+  double a3 = 0.5 - (a1+a2);
+  SymplecticMethod m;
+  m.order = 4;
+  m.kick = { b1, b2, b3, b4, b3, b2, b1 };
+  m.drift = { a1, a2, a3, a3, a2, a1 };
+  return m;
+}
+
+inline SymplecticMethod SymplecticMethodByName (const std::string & name)
+{
+  if (name == "verlet") return StoermerVerlet();
+  if (name == "yoshida4") return Yoshida4();
+  if (name == "yoshida6") return Yoshida6();
+  if (name == "blanesmoan") return BlanesMoan4();
+  throw std::invalid_argument("unknown symplectic method " + name);
+}
+
+
+template <int D>
+double Dot (const Vec<D> & a, const Vec<D> & b)
+{
+  double sum = 0;
+  for (int d = 0; d < D; d++)
+    sum += a(d)*b(d);
+  return sum;
+}
+
+// kinetic + spring + gravity energy, the constraints do no work
+template <int D>
+double MSS_Energy (MassSpringSystem<D> & mss)
+{
+  double energy = 0;
+  for (auto & m : mss.masses())
+    energy += 0.5 * m.mass * Dot<D>(m.vel, m.vel) - m.mass * Dot<D>(mss.getGravity(), m.pos);
+  for (auto & spring : mss.springs())
+    {
+      Vec<D> p[2];
+      for (int k = 0; k < 2; k++)
+        {
+          auto c = spring.connectors[k];
+          p[k] = (c.type == Connector::FIX) ? mss.fixes()[c.nr].pos : mss.masses()[c.nr].pos;
+        }
+      double dl = norm(p[1]-p[0]) - spring.length;
+      energy += 0.5 * spring.stiffness * dl*dl;
+    }
+  return energy;
+}
+
+
+/*
+  RATTLE projections for the distance constraints g_i(q) = (|p1-p2|^2 - L_i^2)/2
+  with the given numbers (default: all), the constraint forces act along
+  G(q)^T with the rows of G from d_i = p1-p2.
+  A = G M^{-1} G^T couples constraints sharing a mass, for chains and trees
+  its LU is O(n). It is factored once per Verlet step at the new positions:
+  exact for the velocity projection, and the iteration matrix of the
+  position projection in the next step.
+*/
+template <int D>
+class MSS_Rattle
+{
+  MassSpringSystem<D> & m_mss;
+  const Vector<> & m_invmass;
+  std::vector<size_t> m_constraints;
+  std::vector<size_t> m_masses;                                     // masses touched
+  std::vector<std::vector<std::pair<size_t,double>>> m_touching;    // per mass: (constraint, sign)
+  std::vector<Vec<D>> m_dirs;
+  Vector<> m_lam;
+  SparseMatrix m_mat;
+  SparseLU m_lu;
+
+public:
+  MSS_Rattle (MassSpringSystem<D> & mss, const Vector<> & invmass)
+    : MSS_Rattle(mss, invmass, AllConstraints(mss)) { }
+
+  MSS_Rattle (MassSpringSystem<D> & mss, const Vector<> & invmass,
+              std::vector<size_t> constraints)
+    : m_mss(mss), m_invmass(invmass), m_constraints(constraints),
+      m_lam(m_constraints.size())
+  {
+
+    std::vector<int> local(mss.masses().size(), -1);
+    for (size_t k = 0; k < m_constraints.size(); k++)
+      {
+        auto & dc = mss.constraints()[m_constraints[k]];
+        std::pair<Connector,double> ends[2] = { { dc.c1, 1.0 }, { dc.c2, -1.0 } };
+        for (auto [c, sign] : ends)
+          if (c.type == Connector::MASS)
+            {
+              if (local[c.nr] < 0)
+                {
+                  local[c.nr] = m_masses.size();
+                  m_masses.push_back(c.nr);
+                  m_touching.emplace_back();
+                }
+              m_touching[local[c.nr]].emplace_back(k, sign);
+            }
+      }
+    m_dirs.resize(m_constraints.size());
+  }
+
+  size_t size() const { return m_constraints.size(); }
+
+  // directions and the LU of A at the positions q
+  void factor (VectorView<double> q)
+  {
+    size_t nc = size();
+    if (nc == 0) return;
+    for (size_t k = 0; k < nc; k++)
+      {
+        auto & dc = m_mss.constraints()[m_constraints[k]];
+        m_dirs[k] = position(dc.c1, q) - position(dc.c2, q);
+      }
+    m_mat.setSize(nc, nc);
+    for (size_t l = 0; l < m_masses.size(); l++)
+      for (auto [i, si] : m_touching[l])
+        for (auto [j, sj] : m_touching[l])
+          m_mat.add(i, j, m_invmass(m_masses[l]) * si * sj * Dot<D>(m_dirs[i], m_dirs[j]));
+    m_lu.factor(m_mat);
+  }
+
+  // SHAKE: q on the constraints, moving along the constraint gradients at
+  // the last factor(), v gets the same correction divided by h
+  void projectPositions (VectorView<double> q, VectorView<double> v, double h, double ctol)
+  {
+    for (int it = 0; it < 50; it++)
+      {
+        double maxviol = 0;
+        for (size_t k = 0; k < size(); k++)
+          {
+            auto & dc = m_mss.constraints()[m_constraints[k]];
+            Vec<D> d = position(dc.c1, q) - position(dc.c2, q);
+            double L2 = dc.rest_length*dc.rest_length;
+            m_lam(k) = -(Dot<D>(d,d) - L2) / 2;
+            maxviol = std::max(maxviol, std::fabs(m_lam(k)) / L2);
+          }
+        if (maxviol < ctol) return;
+        m_lu.solve(m_lam);
+        addConstraintForces(q, 1);
+        addConstraintForces(v, 1/h);
+      }
+    throw std::domain_error("RATTLE: position projection did not converge");
+  }
+
+  // velocities tangential to the constraints at the last factor(), G v = 0
+  void projectVelocities (VectorView<double> v)
+  {
+    for (size_t k = 0; k < size(); k++)
+      {
+        auto & dc = m_mss.constraints()[m_constraints[k]];
+        m_lam(k) = 0;
+        for (int d = 0; d < D; d++)
+          {
+            if (dc.c1.type == Connector::MASS) m_lam(k) -= m_dirs[k](d) * v(dc.c1.nr*D+d);
+            if (dc.c2.type == Connector::MASS) m_lam(k) += m_dirs[k](d) * v(dc.c2.nr*D+d);
+          }
+      }
+    m_lu.solve(m_lam);
+    addConstraintForces(v, 1);
+  }
+
+private:
+  static std::vector<size_t> AllConstraints (MassSpringSystem<D> & mss)
+  {
+    std::vector<size_t> all(mss.constraints().size());
+    for (size_t i = 0; i < all.size(); i++) all[i] = i;
+    return all;
+  }
+
+  Vec<D> position (Connector c, VectorView<double> pos) const
+  {
+    if (c.type == Connector::FIX) return m_mss.fixes()[c.nr].pos;
+    Vec<D> p;
+    for (int d = 0; d < D; d++)
+      p(d) = pos(c.nr*D+d);
+    return p;
+  }
+
+  // vec += fac M^{-1} G^T lam
+  void addConstraintForces (VectorView<double> vec, double fac)
+  {
+    for (size_t l = 0; l < m_masses.size(); l++)
+      {
+        size_t m = m_masses[l];
+        for (auto [k, sign] : m_touching[l])
+          for (int d = 0; d < D; d++)
+            vec(m*D+d) += fac * m_invmass(m) * sign * m_lam(k) * m_dirs[k](d);
+      }
+  }
+};
+
+
+/*
+  Explicit symplectic time stepping for the masses of mss, with the forces
+  of MSS_Function: O(springs) per force evaluation, no linear solves, and
+  an energy error that stays bounded over long runs. The force at the end
+  of a step is reused at the start of the next one.
+  With distance constraints every Verlet step becomes a RATTLE step: the
+  positions are projected onto the constraints (SHAKE, iterated up to the
+  relative tolerance ctol) and the velocities onto their tangent space,
+  see MSS_Rattle.
+  Positions and velocities are read from and written back to the masses,
+  callback(t, x) gets the positions after every step.
+*/
+template <int D>
+void SolveODE_Symplectic (MassSpringSystem<D> & mss, double tend, size_t steps,
+                          const SymplecticMethod & method = StoermerVerlet(),
+                          std::function<void(double,VectorView<double>)> callback = nullptr,
+                          double ctol = 1e-12)
+{
+  size_t n_masses = mss.masses().size();
+  size_t nq = D*n_masses;
+  bool constrained = mss.constraints().size() > 0;
+  if (constrained && method.verletSteps.empty())
+    throw std::invalid_argument("SolveODE_Symplectic: constraints need a composition of Verlet steps");
+
+  MSS_Function<D> func(mss);
+  // the multipliers stay zero, the constraint forces come from RATTLE
+  Vector<> x(func.dimX()), f(func.dimF()), v(nq);
+  Vector<> invmass(n_masses);
+  x = 0.0;
+  for (size_t i = 0; i < n_masses; i++)
+    {
+      invmass(i) = 1/mss.masses()[i].mass;
+      for (int d = 0; d < D; d++)
+        {
+          x(i*D+d) = mss.masses()[i].pos(d);
+          v(i*D+d) = mss.masses()[i].vel(d);
+        }
+    }
+  auto q = x.range(0, nq);
+  bool forceValid = false;
+
+  auto kick = [&](double h)
+  {
+    if (h == 0.0) return;
+    if (!forceValid)
+      {
+        func.evaluate(x, f);
+        forceValid = true;
+      }
+    for (size_t i = 0; i < n_masses; i++)
+      for (int d = 0; d < D; d++)
+        v(i*D+d) += h * invmass(i) * f(i*D+d);
+  };
+  auto drift = [&](double h)
+  {
+    if (h == 0.0) return;
+    q += h * v;
+    forceValid = false;
+  };
+
+  MSS_Rattle<D> rattleProjection(mss, invmass);
+
+  auto rattle = [&](double h)
+  {
+    kick(h/2);
+    drift(h);
+    rattleProjection.projectPositions(q, v, h, ctol);
+    kick(h/2);
+    rattleProjection.factor(q);
+    rattleProjection.projectVelocities(v);
+  };
+
+  if (constrained)
+    rattleProjection.factor(q);
+
+  double dt = tend/steps;
+  double t = 0;
+  for (size_t i = 0; i < steps; i++)
+    {
+      if (constrained)
+        for (double g : method.verletSteps)
+          rattle(g*dt);
+      else
+        {
+          for (size_t j = 0; j < method.drift.size(); j++)
+            {
+              kick(method.kick[j]*dt);
+              drift(method.drift[j]*dt);
+            }
+          kick(method.kick.back()*dt);
+        }
+      t += dt;
+      if (callback) callback(t, q);
+    }
+
+  if (!forceValid)
+    func.evaluate(x, f);
+  for (size_t i = 0; i < n_masses; i++)
+    for (int d = 0; d < D; d++)
+      {
+        mss.masses()[i].pos(d) = q(i*D+d);
+        mss.masses()[i].vel(d) = v(i*D+d);
+        mss.masses()[i].acc(d) = invmass(i) * f(i*D+d);
+      }
+}
+
+#endif
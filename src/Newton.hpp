@@ -2,40 +2,192 @@
 #define Newton_h
 
 #include "nonlinfunc.hpp"
-#include <inverse.hpp>
-#include <lapack_interface.hpp>
+#include "lu.hpp"
 #include <functional>
 
 
 namespace ASC_ode
 {  
+  /*
+    Jacobian reuse policy for the simplified (modified) Newton method.
+    The factored Jacobian is kept across iterations and across calls,
+    it is refreshed when it gets older than maxage solves, when the
+    contraction rate ||dx_k|| / ||dx_k-1|| exceeds maxcontraction, or
+    when the step size changes.
+  */
+  struct JacobianReuse
+  {
+    bool simplified = false;
+    int maxage = 20;
+    double maxcontraction = 0.5;
+
+    int age = -1;                // solves since the last refresh, -1 if none
+    double tau = 0;
+    size_t iterations = 0;
+    size_t factorizations = 0;
+
+    void invalidate() { age = -1; }
+
+    // the step size enters the Newton equation, a new one invalidates the Jacobian
+    void setStepSize (double newtau)
+    {
+      if (newtau != tau) invalidate();
+      tau = newtau;
+    }
+
+    // full Newton would have factored in every iteration
+    size_t savedFactorizations() const { return iterations - factorizations; }
+  };
+
+
+  /*
+    Newton solver owning its workspace: residual, Jacobian and LU factors
+    are allocated once for the given dimensions, repeated solves of the
+    same size do not allocate. Time steppers keep one context for all steps.
+  */
+  class NewtonSolverContext
+  {
+    Vector<double> m_res;
+    Matrix<double> m_fprime;
+    DenseLU m_lu;
+    JacobianReuse m_reuse;
+  public:
+    NewtonSolverContext (size_t dimx, size_t dimf)
+      : m_res(dimf), m_fprime(dimf, dimx), m_lu(dimf) { }
+
+    NewtonSolverContext (std::shared_ptr<NonlinearFunction> func)
+      : NewtonSolverContext (func->dimX(), func->dimF()) { }
+
+    JacobianReuse & jacobianReuse() { return m_reuse; }
+    const JacobianReuse & jacobianReuse() const { return m_reuse; }
+
+    void solve (std::shared_ptr<NonlinearFunction> func, VectorView<double> x,
+                double tol = 1e-8, int maxsteps = 20,
+                std::function<void(int,double,VectorView<double>)> callback = nullptr)
+    {
+      if (func->dimF() != m_res.size() || func->dimX() != m_fprime.cols())
+        throw std::invalid_argument("NewtonSolverContext: function does not match workspace size");
+
+      auto refresh = [&](bool haveDeriv)
+      {
+        if (!haveDeriv) func->evaluateDeriv(x, m_fprime);
+        m_lu.refactor(m_fprime);
+        m_reuse.age = 0;
+        m_reuse.factorizations++;
+      };
+
+      if (!m_reuse.simplified || m_reuse.age >= m_reuse.maxage || !m_lu.valid())
+        m_reuse.invalidate();
+
+      double olddx = 0;
+      double olderr = 0;
+      for (int i = 0; i < maxsteps; i++)
+        {
+          // when a new Jacobian is due, take it together with the residual,
+          // unless the last residual was small enough to expect convergence
+          bool needDeriv = m_reuse.age < 0 || !m_reuse.simplified;
+          bool fused = needDeriv && (i == 0 || olderr > std::sqrt(tol));
+          if (fused)
+            func->evaluateWithDeriv(x, m_res, m_fprime);
+          else
+            func->evaluate(x, m_res);
+
+          double err= norm(m_res);
+          if (err < tol)
+            {
+              m_reuse.age++;
+              return;
+            }
+          olderr = err;
+
+          if (needDeriv)
+            refresh(fused);
+
+          m_lu.solve(m_res);
+          x -= m_res;
+          m_reuse.iterations++;
+
+          double newdx = norm(m_res);
+          if (i > 0 && newdx > m_reuse.maxcontraction * olddx)
+            m_reuse.invalidate();
+          olddx = newdx;
+
+          //if (callback)
+          //  callback(i, err, x);
+        }
+
+      m_reuse.invalidate();
+      throw std::domain_error("Newton did not converge");
+    }
+  };
+
+
   void NewtonSolver (std::shared_ptr<NonlinearFunction> func, VectorView<double> x,
                      double tol = 1e-8, int maxsteps = 20,
                      std::function<void(int,double,VectorView<double>)> callback = nullptr)
   {
-    Vector<double> res(func->dimF());
-    Matrix<double> fprime(func->dimF(), func->dimX());
+    NewtonSolverContext context(func);
+    context.solve (func, x, tol, maxsteps, callback);
+  }
 
-    for (int i = 0; i < maxsteps; i++)
-      {
-        func->evaluate(x, res);
-        double err= norm(res);
-        if (err < tol) return;
 
-        func->evaluateDeriv(x, fprime);
+  /*
+    Newton with sparse Jacobian, factored by a sparse direct solver.
+    The sparsity pattern and the fill-reducing ordering of SparseLU are
+    computed once for the function, repeated solves only refactor.
+  */
+  class SparseNewtonSolverContext
+  {
+    Vector<double> m_res;
+    SparseMatrix m_jacobian;
+    SparseLU m_lu;
+  public:
+    SparseNewtonSolverContext (std::shared_ptr<NonlinearFunction> func)
+      : m_res(func->dimF()), m_jacobian(func->dimF(), func->dimX())
+    {
+      SparseMatrix pattern(func->dimF(), func->dimX());
+      func->sparsityPattern(pattern);
+      m_lu.analyze(pattern);
+    }
+
+    // the Jacobian of the last iteration
+    const SparseMatrix & jacobian() const { return m_jacobian; }
 
-        calcInverse(fprime);
-        x -= fprime*res;
+    void solve (std::shared_ptr<NonlinearFunction> func, VectorView<double> x,
+                double tol = 1e-8, int maxsteps = 20)
+    {
+      if (func->dimF() != m_res.size() || func->dimX() != m_jacobian.width())
+        throw std::invalid_argument("SparseNewtonSolverContext: function does not match workspace size");
 
-        // LapackLU LU(fprime);
-        // LU.solve(res);
-        // x -= res;
- 
-        //if (callback)
-        //  callback(i, err, x);
-      }
+      for (int i = 0; i < maxsteps; i++)
+        {
+          func->evaluate(x, m_res);
+          double err= norm(m_res);
+          if (err < tol) return;
 
-    throw std::domain_error("Newton did not converge");
+          m_jacobian.setSize(func->dimF(), func->dimX());
+          func->evaluateDerivSparse(x, m_jacobian);
+
+          m_lu.factor(m_jacobian);
+          m_lu.solve(m_res);
+          x -= m_res;
+        }
+
+      throw std::domain_error("Newton did not converge");
+    }
+  };
+
+
+  // single sparse solve, jacobian receives the last Jacobian;
+  // repeated solves should keep a SparseNewtonSolverContext
+  void NewtonSolver (std::shared_ptr<NonlinearFunction> func, VectorView<double> x,
+                     SparseMatrix & jacobian,
+                     double tol = 1e-8, int maxsteps = 20,
+                     std::function<void(int,double,VectorView<double>)> callback = nullptr)
+  {
+    SparseNewtonSolverContext context(func);
+    context.solve (func, x, tol, maxsteps);
+    jacobian = context.jacobian();
   }
 
 }
@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include "nonlinfunc.hpp"
+#include "sparsematrix.hpp"
 
 using namespace ASC_ode;
 
@@ -43,3 +44,106 @@ public:
         df(1,1) = 0.0;
     }
 };
+
+
+// RC ladder network: the source cos(omega t) feeds a chain of n sections,
+// each a resistor R followed by a capacitor C to ground.
+// x = (U_1, ..., U_n, t), the stiffness grows like n^2.
+// For IMEX methods the linear network is the implicit part,
+// the source and the clock t' = 1 are the explicit part.
+class RCLadder : public NonlinearFunction
+{
+    size_t m_sections;
+    double m_R, m_C, m_omega;
+    SplitPart m_part;
+
+public:
+    RCLadder(size_t sections, double R, double C, double omega = 100.0 * M_PI,
+             SplitPart part = SplitPart::ALL)
+        : m_sections(sections), m_R(R), m_C(C), m_omega(omega), m_part(part) {}
+
+    size_t dimX() const override { return m_sections + 1; }
+    size_t dimF() const override { return m_sections + 1; }
+
+    void evaluate(VectorView<double> x, VectorView<double> f) const override
+    {
+        size_t n = m_sections;
+        double RC = m_R * m_C;
+        bool network = m_part != SplitPart::EXPLICIT;
+        bool source = m_part != SplitPart::IMPLICIT;
+        f = 0.0;
+        if (network)
+            for (size_t i = 0; i < n; i++)
+            {
+                double left = (i == 0) ? 0.0 : x(i-1);
+                double right = (i+1 < n) ? x(i+1) : x(i);
+                f(i) = (left - 2*x(i) + right) / RC;
+            }
+        if (source)
+        {
+            f(0) += std::cos(m_omega * x(n)) / RC;
+            f(n) = 1.0;
+        }
+    }
+
+    void evaluateDeriv(VectorView<double> x, MatrixView<double> df) const override
+    {
+        df = 0.0;
+        SparseMatrix sparse(dimF(), dimX());
+        evaluateDerivSparse(x, sparse);
+        sparse.addTo(df);
+    }
+
+    void sparsityPattern(SparseMatrix & pattern) const override
+    {
+        size_t n = m_sections;
+        if (m_part != SplitPart::EXPLICIT)
+            for (size_t i = 0; i < n; i++)
+            {
+                pattern.add(i, i, 1.0);
+                if (i > 0) pattern.add(i, i-1, 1.0);
+                if (i+1 < n) pattern.add(i, i+1, 1.0);
+            }
+        if (m_part != SplitPart::IMPLICIT)
+            pattern.add(0, n, 1.0);
+    }
+
+    void evaluateDerivSparse(VectorView<double> x, SparseMatrix & df) const override
+    {
+        size_t n = m_sections;
+        double RC = m_R * m_C;
+        if (m_part != SplitPart::EXPLICIT)
+            for (size_t i = 0; i < n; i++)
+            {
+                df.add(i, i, (i+1 < n ? -2.0 : -1.0) / RC);
+                if (i > 0) df.add(i, i-1, 1.0 / RC);
+                if (i+1 < n) df.add(i, i+1, 1.0 / RC);
+            }
+        if (m_part != SplitPart::IMPLICIT)
+            df.add(0, n, -m_omega / RC * std::sin(m_omega * x(n)));
+    }
+};
+
+
+// RCCircuit for SolveEnsemble: x = (U_C, t), the parameters p = (R, C)
+// vary over the ensemble members
+class RCCircuitEnsemble
+{
+    double m_omega;
+
+public:
+    static constexpr size_t dim = 2;
+    static constexpr size_t params = 2;
+
+    RCCircuitEnsemble(double omega = 100.0 * M_PI) : m_omega(omega) {}
+
+    template <size_t W>
+    void evaluate(const double * x, const double * p, double * f) const
+    {
+        for (size_t l = 0; l < W; l++)
+        {
+            f[l] = (std::cos(m_omega * x[W+l]) - x[l]) / (p[l] * p[W+l]);
+            f[W+l] = 1.0;
+        }
+    }
+};
@@ -0,0 +1,378 @@
+#ifndef BDF_HPP
+#define BDF_HPP
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "timestepper.hpp"
+#include "sparsematrix.hpp"
+
+namespace ASC_ode
+{
+
+  /*
+    Variable step size, variable order BDF (orders 1 to 5) in Nordsieck form.
+    The history is the array z_j = h^j y^(j) / j!, j = 0..q, a step size
+    change by the factor eta rescales z_j by eta^j (Byrne-Hindmarsh, LSODE).
+    A step predicts z by the Pascal matrix and corrects it by l * (y_n - y_pred),
+    with l(x) = prod_{i=1..q} (1 + x/i). The local error estimate at order q
+    is (y_n - y_pred) / (q+1), the order is chosen from the estimates at
+    orders q-1, q and q+1.
+
+    Every step solves one system of size n by simplified Newton with the
+    matrix I - gamma h J, gamma = 1/l_1. The Jacobian is kept for up to
+    jacobianReuse().maxage steps and renewed when Newton fails, the
+    matrix is factored again only if gamma h changed by more than 30%.
+    With sparse = true the Jacobian comes from evaluateDerivSparse and
+    is factored by SparseLU.
+  */
+  class BDF : public AdaptiveTimeStepper
+  {
+    static constexpr int MAXORDER = 5;
+
+    size_t m_n;
+    int m_maxorder;
+    bool m_sparse;
+
+    int m_q = 1;              // current order
+    int m_qlast = 1;          // order of the last step taken
+    double m_h = 0;           // step size the Nordsieck array is scaled for
+    double m_hnext = 0;       // proposed next step size
+    bool m_started = false;
+    int m_stepsAtOrder = 0;
+    int m_failures = 0;       // consecutive rejections
+
+    Matrix<> m_z, m_zsave;    // rows z_0 .. z_{MAXORDER}
+    Vector<> m_ypred, m_ynew, m_e, m_res, m_delta, m_deltaold;
+    bool m_haveDeltaOld = false;
+
+    // Newton matrix
+    Matrix<> m_jac;
+    DenseLU m_lu;
+    SparseMatrix m_matrix;    // I - gamma h J, the first n triplets are the identity
+    SparseLU m_sparselu;
+    bool m_haveJacobian = false;
+    bool m_factored = false;
+    double m_gammah = 0;      // gamma h of the factored matrix
+    double m_gammahJ = 0;     // gamma h the sparse matrix is scaled with
+    double m_crate = 1;       // estimated Newton contraction rate
+
+    JacobianReuse m_reuse;    // age in steps since the Jacobian was evaluated
+    size_t m_jacobians = 0;
+    size_t m_stepsPerOrder[MAXORDER+1] = { };
+
+  public:
+    BDF (std::shared_ptr<NonlinearFunction> rhs, Tolerance tol = Tolerance(),
+         int maxorder = 5, bool sparse = false)
+      : AdaptiveTimeStepper(rhs, tol), m_n(rhs->dimX()),
+        m_maxorder(std::clamp(maxorder, 1, MAXORDER)), m_sparse(sparse),
+        m_z(MAXORDER+1, m_n), m_zsave(MAXORDER+1, m_n),
+        m_ypred(m_n), m_ynew(m_n), m_e(m_n), m_res(m_n), m_delta(m_n), m_deltaold(m_n),
+        m_jac(sparse ? 0 : m_n, sparse ? 0 : m_n), m_lu(sparse ? 0 : m_n)
+    {
+      m_z = 0.0;
+      if (m_sparse)
+        {
+          SparseMatrix pattern(m_n, m_n);
+          for (size_t i = 0; i < m_n; i++)
+            pattern.add(i, i, 1.0);
+          m_rhs->sparsityPattern(pattern);
+          m_sparselu.analyze(pattern);
+        }
+    }
+
+    int order() const { return m_q; }
+    int maxOrder() const { return m_maxorder; }
+    int errorOrder() const override { return m_q+1; }
+    double proposedStepSize() const override { return m_hnext; }
+
+    JacobianReuse & jacobianReuse() { return m_reuse; }
+    size_t jacobians() const { return m_jacobians; }
+    size_t stepsWithOrder (int q) const { return m_stepsPerOrder[q]; }
+
+    // starts again with order 1 at the next step
+    void restart() { m_started = false; }
+
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      double err;
+      if (!Step(tau, y, err, false))
+        throw std::domain_error("BDF: Newton did not converge");
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      return Step(tau, y, err, true);
+    }
+
+    // the interpolation polynomial of the last step
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      double s = theta-1, p = 1;
+      y = m_z.row(0);
+      for (int j = 1; j <= m_qlast; j++)
+        {
+          p *= s;
+          y += p * m_z.row(j);
+        }
+    }
+
+  private:
+    static double lcoef (int q, int j)
+    {
+      // coefficients of prod_{i=1..q} (1 + x/i)
+      double l[MAXORDER+1] = { 1 };
+      for (int i = 1; i <= q; i++)
+        for (int k = i; k >= 1; k--)
+          l[k] += l[k-1] / i;
+      return l[j];
+    }
+
+    static double factorial (int k) { return k <= 1 ? 1 : k * factorial(k-1); }
+
+    bool Step (double tau, VectorView<double> y, double & err, bool adaptive)
+    {
+      bool same = m_started;
+      for (size_t i = 0; same && i < m_n; i++)
+        if (y(i) != m_z(0,i)) same = false;
+      if (!same)
+        Start(tau, y);
+      else if (tau != m_h)
+        Rescale(tau / m_h);
+
+      m_zsave = m_z;
+      // z := P z with the Pascal matrix P
+      for (int k = 0; k < m_q; k++)
+        for (int j = m_q-1; j >= k; j--)
+          m_z.row(j) += m_z.row(j+1);
+      m_ypred = m_z.row(0);
+
+      if (!SolveCorrector(tau))
+        {
+          m_z = m_zsave;
+          m_failures++;
+          m_hnext = 0.25 * tau;
+          err = std::numeric_limits<double>::infinity();
+          return false;
+        }
+
+      err = m_tol.errorNorm(m_e, y, m_ynew) / (m_q+1);
+      if (adaptive && !(err <= 1))
+        {
+          m_z = m_zsave;
+          m_failures++;
+          double eta = 1 / (1.2*std::pow(err, 1.0/(m_q+1)) + 1.2e-6);
+          eta = std::clamp(eta, m_failures >= 2 ? 0.1 : 0.2, 0.9);
+          if (m_failures >= 3 && m_q > 1)
+            {
+              // repeated failures: go back to order 1
+              m_q = 1;
+              m_stepsAtOrder = 0;
+              m_haveDeltaOld = false;
+            }
+          m_hnext = eta * tau;
+          return false;
+        }
+
+      for (int j = 0; j <= m_q; j++)
+        m_z.row(j) += lcoef(m_q, j) * m_e;
+      y = m_z.row(0);
+
+      m_failures = 0;
+      m_qlast = m_q;
+      m_stepsAtOrder++;
+      m_stepsPerOrder[m_q]++;
+      m_reuse.age++;
+      SelectOrder(err);
+      return true;
+    }
+
+    void Start (double tau, VectorView<double> y)
+    {
+      m_z = 0.0;
+      m_z.row(0) = y;
+      m_rhs->evaluate(y, m_res);
+      m_evaluations++;
+      m_z.row(1) = tau * m_res;
+      m_h = tau;
+      m_q = m_qlast = 1;
+      m_stepsAtOrder = 0;
+      m_failures = 0;
+      m_haveDeltaOld = false;
+      m_started = true;
+    }
+
+    void Rescale (double eta)
+    {
+      double fac = 1;
+      for (int j = 1; j <= m_q; j++)
+        {
+          fac *= eta;
+          m_z.row(j) *= fac;
+        }
+      m_deltaold *= fac*eta;
+      m_h *= eta;
+    }
+
+    // correction e = y_n - y_pred from e - gamma (h f(y_pred+e) - z_1) = 0
+    bool SolveCorrector (double tau)
+    {
+      double gamma = 1 / lcoef(m_q, 1);
+      double gammah = gamma * tau;
+      bool fresh = false;
+      if (!m_haveJacobian || m_reuse.age >= m_reuse.maxage)
+        {
+          EvaluateJacobian(gammah);
+          fresh = true;
+        }
+      if (!m_factored || fresh || std::fabs(gammah/m_gammah - 1) > 0.3)
+        Factor(gammah);
+
+      for (int attempt = 0; attempt < 2; attempt++)
+        {
+          if (Newton(gamma, tau))
+            return true;
+          if (fresh) break;
+          // an old Jacobian may be the reason
+          EvaluateJacobian(gammah);
+          Factor(gammah);
+          fresh = true;
+        }
+      return false;
+    }
+
+    bool Newton (double gamma, double tau)
+    {
+      const int maxit = 4;
+      double tol = 0.1 * (m_q+1);     // the error estimate is |e|/(q+1) <= 1
+      double olddel = 0;
+      m_e = 0.0;
+      for (int it = 0; it < maxit; it++)
+        {
+          m_ynew = m_ypred + m_e;
+          m_rhs->evaluate(m_ynew, m_res);
+          m_evaluations++;
+          // res = e - gamma (h f - z_1)
+          m_res *= -gamma*tau;
+          m_res += m_e;
+          m_res += gamma * m_z.row(1);
+          if (m_sparse)
+            m_sparselu.solve(m_res);
+          else
+            m_lu.solve(m_res);
+          m_e -= m_res;
+          m_reuse.iterations++;
+
+          double del = m_tol.errorNorm(m_res, m_ypred, m_ynew);
+          if (it > 0)
+            {
+              if (del > 2*olddel) break;     // diverges
+              m_crate = std::max(0.3*m_crate, del/olddel);
+            }
+          if (del * std::min(1.0, m_crate) <= tol)
+            {
+              m_ynew = m_ypred + m_e;
+              return true;
+            }
+          olddel = del;
+        }
+      return false;
+    }
+
+    void EvaluateJacobian (double gammah)
+    {
+      if (m_sparse)
+        {
+          m_matrix.setSize(m_n, m_n);
+          for (size_t i = 0; i < m_n; i++)
+            m_matrix.add(i, i, 1.0);
+          m_rhs->evaluateDerivSparse(m_ypred, m_matrix);
+          m_matrix.scaleFrom(m_n, -gammah);
+          m_gammahJ = gammah;
+        }
+      else
+        m_rhs->evaluateDeriv(m_ypred, m_jac);
+      m_haveJacobian = true;
+      m_reuse.age = 0;
+      m_jacobians++;
+    }
+
+    void Factor (double gammah)
+    {
+      if (m_sparse)
+        {
+          m_matrix.scaleFrom(m_n, gammah / m_gammahJ);
+          m_gammahJ = gammah;
+          m_sparselu.factor(m_matrix);
+        }
+      else
+        m_lu.refactor(m_n, [&](size_t i, size_t j)
+        { return (i == j ? 1.0 : 0.0) - gammah * m_jac(i,j); });
+      m_gammah = gammah;
+      m_factored = true;
+      m_crate = 1;
+      m_reuse.factorizations++;
+    }
+
+    // step size and order for the next step
+    void SelectOrder (double err)
+    {
+      int q = m_q;
+      double etaq = 1 / (1.2*std::pow(err, 1.0/(q+1)) + 1.2e-6);
+      double etadown = 0, etaup = 0;
+
+      if (m_stepsAtOrder > q)
+        {
+          if (q > 1)
+            {
+              // error at order q-1 from h^q y^(q) = q! z_q
+              m_res = factorial(q-1) * m_z.row(q);
+              double errdown = m_tol.errorNorm(m_res, m_ypred, m_ynew);
+              etadown = 1 / (1.3*std::pow(errdown, 1.0/q) + 1.3e-6);
+            }
+          if (q < m_maxorder && m_haveDeltaOld)
+            {
+              // error at order q+1 from h^(q+2) y^(q+2) = e_n - e_n-1
+              m_res = m_e - m_deltaold;
+              double errup = m_tol.errorNorm(m_res, m_ypred, m_ynew) / (q+2);
+              etaup = 1 / (1.4*std::pow(errup, 1.0/(q+2)) + 1.4e-6);
+            }
+        }
+
+      double eta = etaq;
+      if (etaup > eta && etaup >= etadown)
+        {
+          eta = etaup;
+          m_z.row(q+1) = (1 / factorial(q+1)) * m_e;
+          m_q = q+1;
+        }
+      else if (etadown > eta)
+        {
+          eta = etadown;
+          m_q = q-1;
+        }
+
+      if (m_q != q)
+        {
+          m_stepsAtOrder = 0;
+          m_haveDeltaOld = false;
+        }
+      else
+        {
+          m_deltaold = m_e;
+          m_haveDeltaOld = true;
+        }
+
+      // small changes would only cost a new factorization
+      if (eta < 1.1 && eta > 1 && m_q == q) eta = 1;
+      m_hnext = std::min(eta, 10.0) * m_h;
+    }
+  };
+
+}
+
+#endif
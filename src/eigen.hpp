@@ -0,0 +1,151 @@
+#ifndef EIGEN_HPP
+#define EIGEN_HPP
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "lu.hpp"
+
+namespace ASC_ode
+{
+
+  /*
+    Eigenvalues and right eigenvectors of a small real matrix with
+    distinct eigenvalues, such as the inverse of a Butcher matrix.
+    The eigenvalues are the roots of the characteristic polynomial
+    (Faddeev-LeVerrier, Durand-Kerner iteration with Newton polishing),
+    the eigenvectors are computed by inverse iteration.
+    Real eigenvalues come first, complex ones follow in conjugate pairs
+    with positive imaginary part first. Eigenvectors are scaled such that
+    their largest entry is 1, so eigenvectors of real eigenvalues are real.
+  */
+  class EigenSystem
+  {
+    using Complex = std::complex<double>;
+    size_t m_n;
+    std::vector<Complex> m_values;
+    std::vector<Complex> m_vectors;     // column j is the eigenvector of value j
+
+  public:
+    EigenSystem (MatrixView<double> a)
+      : m_n(a.rows()), m_values(m_n), m_vectors(m_n*m_n)
+    {
+      size_t n = m_n;
+
+      // characteristic polynomial sum_k c_k x^k, c_n = 1
+      std::vector<double> c(n+1), m(n*n, 0.0), am(n*n);
+      c[n] = 1;
+      for (size_t k = 1; k <= n; k++)
+        {
+          // m = a*m + c_{n-k+1} I
+          for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++)
+              {
+                double sum = 0;
+                for (size_t l = 0; l < n; l++)
+                  sum += a(i,l) * m[l*n+j];
+                am[i*n+j] = sum;
+              }
+          for (size_t i = 0; i < n; i++)
+            am[i*n+i] += c[n-k+1];
+          m = am;
+          double trace = 0;
+          for (size_t i = 0; i < n; i++)
+            for (size_t l = 0; l < n; l++)
+              trace += a(i,l) * m[l*n+i];
+          c[n-k] = -trace / k;
+        }
+
+      auto poly = [&](Complex x, Complex & deriv)
+      {
+        Complex p = c[n];
+        deriv = 0;
+        for (size_t k = n; k-- > 0; )
+          {
+            deriv = deriv*x + p;
+            p = p*x + c[k];
+          }
+        return p;
+      };
+
+      // Durand-Kerner
+      double radius = 1;
+      for (size_t k = 0; k < n; k++)
+        radius = std::max(radius, 1+std::fabs(c[k]));
+      std::vector<Complex> z(n);
+      for (size_t i = 0; i < n; i++)
+        z[i] = radius * std::pow(Complex(0.4, 0.9), double(i));
+      for (int it = 0; it < 1000; it++)
+        {
+          double change = 0;
+          for (size_t i = 0; i < n; i++)
+            {
+              Complex dp, denom = 1;
+              for (size_t j = 0; j < n; j++)
+                if (j != i) denom *= z[i]-z[j];
+              Complex dz = poly(z[i], dp) / denom;
+              z[i] -= dz;
+              change = std::max(change, std::abs(dz) / (1+std::abs(z[i])));
+            }
+          if (change < 1e-15) break;
+        }
+      for (auto & zi : z)
+        for (int it = 0; it < 3; it++)
+          {
+            Complex dp, p = poly(zi, dp);
+            if (dp != 0.0) zi -= p/dp;
+          }
+
+      // real ones first, then conjugate pairs
+      for (auto & zi : z)
+        if (std::fabs(zi.imag()) < 1e-10 * std::abs(zi))
+          zi = zi.real();
+      std::sort(z.begin(), z.end(), [](Complex x, Complex y)
+      {
+        bool rx = x.imag() == 0, ry = y.imag() == 0;
+        if (rx != ry) return rx;
+        if (x.real() != y.real()) return x.real() < y.real();
+        return x.imag() > y.imag();
+      });
+      for (size_t i = 0; i < n; i++)
+        if (z[i].imag() != 0 && i+1 < n)
+          {
+            if (z[i].imag() < 0) z[i] = std::conj(z[i]);
+            z[i+1] = std::conj(z[i]);
+            i++;
+          }
+      m_values = z;
+
+      // inverse iteration, with a slightly perturbed shift
+      ComplexLU lu(n);
+      std::vector<Complex> v(n);
+      for (size_t j = 0; j < n; j++)
+        {
+          Complex shift = m_values[j] * (1+1e-10) + 1e-12;
+          lu.refactor(n, [&](size_t i, size_t k) { return Complex(a(i,k)) - (i == k ? shift : 0.0); });
+          std::fill(v.begin(), v.end(), 1.0);
+          for (int it = 0; it < 3; it++)
+            {
+              lu.solve(v);
+              Complex maxentry = 0;
+              for (auto vi : v)
+                if (std::abs(vi) > std::abs(maxentry)) maxentry = vi;
+              for (auto & vi : v)
+                vi /= maxentry;
+            }
+          for (size_t i = 0; i < n; i++)
+            m_vectors[i*n+j] = m_values[j].imag() == 0 ? Complex(v[i].real()) : v[i];
+        }
+    }
+
+    size_t size() const { return m_n; }
+    Complex value (size_t j) const { return m_values[j]; }
+    Complex vector (size_t i, size_t j) const { return m_vectors[i*m_n+j]; }
+  };
+
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+#include "threadpool.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  // ensemble members integrated together, the inner loops run over them
+  constexpr size_t EnsembleLanes = 8;
+
+  /*
+    Many independent trajectories of one model, stored structure of arrays:
+    a chunk of W members keeps component d of all members contiguous,
+    x[d*W+l] for lane l. A model provides
+      static constexpr size_t dim, params;
+      template <size_t W> void evaluate (const double * x, const double * p, double * f) const;
+    with the parameters p[j*W+l] laid out the same way. Its loops over the
+    W lanes have a compile time length and no dependencies, the compiler
+    vectorizes them at -O3 (the default Release build), for the full
+    vector width of the machine with -march=native, as demo_ensemble is
+    built with the CMake option ASC_ODE_NATIVE (calls to sin, cos, exp
+    only with a vector math library and relaxed floating point flags).
+  */
+
+  struct EnsembleStatistics
+  {
+    size_t members = 0;
+    size_t steps = 0;
+    size_t diverged = 0;  // members with a non-finite final state
+    double time = 0;      // wall time [s]
+
+    double trajectoriesPerSecond() const { return time > 0 ? members / time : 0; }
+  };
+
+
+  // steps steps of the explicit Runge-Kutta method (a,b,c) for the members first .. first+W-1,
+  // returns the number of them with a non-finite final state
+  template <size_t W, class Model>
+  size_t EnsembleChunk (const Model & model, const Matrix<> & a, const Vector<> & b, const Vector<> & c,
+                      double tau, size_t steps, size_t outputs,
+                      const Matrix<> & y0, const Matrix<> & params, size_t first,
+                      VectorView<double> out, std::vector<double> & work)
+  {
+    constexpr size_t dim = Model::dim;
+    constexpr size_t np = Model::params;
+    size_t members = y0.rows();
+    size_t stages = c.size();
+    size_t stepsPerOutput = outputs > 1 ? steps / (outputs-1) : 0;
+
+    std::array<double, dim*W> y, ys;
+    std::array<double, np*W> p;
+    work.resize(stages*dim*W);
+    double * k = work.data();
+
+    // unused lanes of the last chunk repeat its last member
+    for (size_t l = 0; l < W; l++)
+      {
+        size_t m = std::min(first+l, members-1);
+        for (size_t d = 0; d < dim; d++)
+          y[d*W+l] = y0(m, d);
+        for (size_t j = 0; j < np; j++)
+          p[j*W+l] = params(m, j);
+      }
+
+    auto write = [&](size_t sample)
+    {
+      for (size_t l = 0; l < W && first+l < members; l++)
+        for (size_t d = 0; d < dim; d++)
+          out(((first+l)*outputs + sample)*dim + d) = y[d*W+l];
+    };
+    if (outputs > 1) write(0);
+
+    for (size_t step = 1; step <= steps; step++)
+      {
+        for (size_t s = 0; s < stages; s++)
+          {
+            ys = y;
+            for (size_t j = 0; j < s; j++)
+              {
+                double fac = tau * a(s, j);
+                if (fac == 0) continue;
+                const double * kj = k + j*dim*W;
+                for (size_t i = 0; i < dim*W; i++)
+                  ys[i] += fac * kj[i];
+              }
+            model.template evaluate<W>(ys.data(), p.data(), k + s*dim*W);
+          }
+        for (size_t s = 0; s < stages; s++)
+          {
+            double fac = tau * b(s);
+            const double * ks = k + s*dim*W;
+            for (size_t i = 0; i < dim*W; i++)
+              y[i] += fac * ks[i];
+          }
+        if (outputs > 1 && step % stepsPerOutput == 0)
+          write(step / stepsPerOutput);
+      }
+    if (outputs == 1) write(0);
+
+    size_t diverged = 0;
+    for (size_t l = 0; l < W && first+l < members; l++)
+      for (size_t d = 0; d < dim; d++)
+        if (!std::isfinite(y[d*W+l]))
+          {
+            diverged++;
+            break;
+          }
+    return diverged;
+  }
+
+
+  /*
+    Integrates all members (rows of y0 and params) over [0,tend] with steps
+    steps of the explicit Runge-Kutta method (a,b,c). Chunks of W members
+    are spread over the pool, idle workers steal chunks from busy ones.
+    out (preallocated, members x outputs x dim) receives the states at
+    t_k = k tend/(outputs-1), k = 0 .. outputs-1, at index
+    (member*outputs + k)*dim + d; steps must be a multiple of outputs-1.
+    With outputs = 1 out holds the states at tend.
+    The step size is the same for all members and is not controlled: a
+    member whose eigenvalues times tend/steps leave the stability region
+    of the method (for RK4 about |lambda tau| < 2.8 on the negative axis,
+    for RCCircuit tau < 2.8 R C) grows to inf or NaN. Those are counted
+    in diverged.
+  */
+  template <class Model, size_t W = EnsembleLanes>
+  EnsembleStatistics SolveEnsemble (const Model & model,
+                                    const Matrix<> & a, const Vector<> & b, const Vector<> & c,
+                                    double tend, size_t steps,
+                                    const Matrix<> & y0, const Matrix<> & params,
+                                    size_t outputs, VectorView<double> out, ThreadPool & pool)
+  {
+    size_t members = y0.rows();
+    if (y0.cols() != Model::dim || params.rows() != members || params.cols() != Model::params)
+      throw std::invalid_argument("SolveEnsemble: y0 must be members x dim, params members x params");
+    if (out.size() != members*outputs*Model::dim)
+      throw std::invalid_argument("SolveEnsemble: out must have size members x outputs x dim");
+    if (outputs > 1 && steps % (outputs-1) != 0)
+      throw std::invalid_argument("SolveEnsemble: steps must be a multiple of outputs-1");
+
+    auto start = std::chrono::steady_clock::now();
+    size_t chunks = (members + W-1) / W;
+    // stage derivatives, one array per worker reused by its chunks
+    std::vector<std::vector<double>> work(pool.size());
+    std::vector<size_t> diverged(pool.size(), 0);
+    pool.parallelForStealing(chunks, [&](size_t chunk, size_t worker)
+    {
+      diverged[worker] += EnsembleChunk<W>(model, a, b, c, tend/steps, steps, outputs,
+                                           y0, params, chunk*W, out, work[worker]);
+    });
+
+    EnsembleStatistics stats;
+    stats.members = members;
+    stats.steps = steps;
+    for (size_t d : diverged)
+      stats.diverged += d;
+    stats.time = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return stats;
+  }
+
+} // namespace ASC_ode
+
+#endif // ENSEMBLE_HPP
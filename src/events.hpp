@@ -0,0 +1,274 @@
+#ifndef EVENTS_HPP
+#define EVENTS_HPP
+
+#include <cmath>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+
+#include "timestepper.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Root of f in [a,b] with f(a) = fa and f(b) = fb of opposite sign, to
+    the absolute tolerance tol. Brent's method combines bisection with
+    secant steps and inverse quadratic interpolation (Brent 1973, zeroin).
+  */
+  inline double BrentRoot (std::function<double(double)> f, double a, double b,
+                           double fa, double fb, double tol)
+  {
+    if (fa == 0) return a;
+    if (fb == 0) return b;
+    if ((fa > 0) == (fb > 0))
+      throw std::invalid_argument("BrentRoot: no sign change in [a,b]");
+
+    double c = a, fc = fa, d = b-a, e = d;
+    for (int it = 0; it < 200; it++)
+      {
+        if ((fb > 0) == (fc > 0))
+          {
+            c = a;  fc = fa;
+            d = e = b-a;
+          }
+        if (std::fabs(fc) < std::fabs(fb))
+          {
+            a = b;  b = c;  c = a;
+            fa = fb;  fb = fc;  fc = fa;
+          }
+        double tol1 = 2 * 1e-16 * std::fabs(b) + 0.5*tol;
+        double m = 0.5 * (c-b);
+        if (std::fabs(m) <= tol1 || fb == 0) return b;
+
+        if (std::fabs(e) >= tol1 && std::fabs(fa) > std::fabs(fb))
+          {
+            // secant (a == c) or inverse quadratic interpolation
+            double s = fb/fa, p, q;
+            if (a == c)
+              {
+                p = 2*m*s;
+                q = 1-s;
+              }
+            else
+              {
+                double r = fb/fc;
+                q = fa/fc;
+                p = s * (2*m*q*(q-r) - (b-a)*(r-1));
+                q = (q-1) * (r-1) * (s-1);
+              }
+            if (p > 0) q = -q;
+            else p = -p;
+            if (2*p < std::min(3*m*q - std::fabs(tol1*q), std::fabs(e*q)))
+              {
+                e = d;
+                d = p/q;
+              }
+            else
+              d = e = m;
+          }
+        else
+          d = e = m;
+
+        a = b;  fa = fb;
+        b += std::fabs(d) > tol1 ? d : (m > 0 ? tol1 : -tol1);
+        fb = f(b);
+      }
+    return b;
+  }
+
+
+  /*
+    The same with the Illinois method: regula falsi, where the function
+    value kept at the old end of the bracket is halved whenever the same
+    end is kept twice.
+  */
+  inline double IllinoisRoot (std::function<double(double)> f, double a, double b,
+                              double fa, double fb, double tol)
+  {
+    if (fa == 0) return a;
+    if (fb == 0) return b;
+    if ((fa > 0) == (fb > 0))
+      throw std::invalid_argument("IllinoisRoot: no sign change in [a,b]");
+
+    for (int it = 0; it < 200 && std::fabs(b-a) > tol; it++)
+      {
+        double c = b - fb * (b-a) / (fb-fa);
+        double fc = f(c);
+        if (fc == 0) return c;
+        if ((fc > 0) != (fb > 0))
+          {
+            a = b;  fa = fb;
+          }
+        else
+          fa /= 2;
+        b = c;  fb = fc;
+      }
+    return std::fabs(fa) < std::fabs(fb) ? a : b;
+  }
+
+
+  /*
+    Event function g(t, y): the event happens where g changes sign.
+    direction > 0 only reports rising (- to +), direction < 0 only falling
+    zero crossings. A terminal event stops the integration there.
+  */
+  struct Event
+  {
+    std::function<double(double,VectorView<double>)> g;
+    bool terminal = false;
+    int direction = 0;
+  };
+
+  struct EventOccurrence
+  {
+    size_t event;    // index into the event list
+    double t;
+    Vector<> y;
+  };
+
+  enum class RootMethod { BRENT, ILLINOIS };
+
+  struct EventStatistics : public StepStatistics
+  {
+    std::vector<EventOccurrence> occurrences;   // in the order of time
+    bool terminated = false;                    // stopped by a terminal event
+    double t = 0;                               // reached time
+  };
+
+
+  /*
+    Checks the events after every step. g is evaluated at the step ends,
+    a sign change inside a step is located on the dense output of the
+    stepper to the tolerance ttol in time.
+  */
+  class EventLocator
+  {
+    const std::vector<Event> & m_events;
+    RootMethod m_method;
+    double m_ttol;
+    std::vector<double> m_g;
+    Vector<> m_ytheta;
+
+  public:
+    EventLocator (const std::vector<Event> & events, RootMethod method, double ttol,
+                  double t0, VectorView<double> y0)
+      : m_events(events), m_method(method), m_ttol(ttol),
+        m_g(events.size()), m_ytheta(y0.size())
+    {
+      for (size_t i = 0; i < events.size(); i++)
+        m_g[i] = events[i].g(t0, y0);
+    }
+
+    /*
+      After a step from told to t with the new state y: records the events
+      in [told, t] in occurrences. At a terminal event t and y are set to
+      the event and true is returned.
+    */
+    bool check (TimeStepper & stepper, double told, double & t, VectorView<double> y,
+                std::vector<EventOccurrence> & occurrences)
+    {
+      double h = t - told;
+      std::vector<double> gnew(m_events.size());
+      std::vector<std::pair<double,size_t>> found;    // (theta, event)
+      for (size_t i = 0; i < m_events.size(); i++)
+        {
+          auto & ev = m_events[i];
+          gnew[i] = ev.g(t, y);
+          double g0 = m_g[i], g1 = gnew[i];
+          // a zero at the start belongs to the previous step
+          if (g0 == 0 || (g1 != 0 && (g0 > 0) == (g1 > 0))) continue;
+          if (ev.direction > 0 && g0 > 0) continue;
+          if (ev.direction < 0 && g0 < 0) continue;
+
+          auto phi = [&](double theta)
+          {
+            stepper.DenseOutput(theta, m_ytheta);
+            return ev.g(told + theta*h, m_ytheta);
+          };
+          double tol = m_ttol / std::fabs(h);
+          double theta = m_method == RootMethod::BRENT
+            ? BrentRoot(phi, 0, 1, g0, g1, tol)
+            : IllinoisRoot(phi, 0, 1, g0, g1, tol);
+          found.emplace_back(theta, i);
+        }
+      m_g = gnew;
+
+      std::sort(found.begin(), found.end());
+      for (auto [theta, i] : found)
+        {
+          if (theta < 1)
+            stepper.DenseOutput(theta, m_ytheta);
+          else
+            m_ytheta = y;
+          double tev = theta < 1 ? told + theta*h : t;
+          occurrences.push_back({ i, tev, m_ytheta });
+          if (m_events[i].terminal)
+            {
+              t = tev;
+              y = m_ytheta;
+              return true;
+            }
+        }
+      return false;
+    }
+  };
+
+
+  /*
+    SolveAdaptive with events: integrates from t0 to tend or to the first
+    terminal event, y is the state there. The steps are not shortened for
+    events, so the stepper needs dense output. callback(t, y) is called
+    after every step and at a terminal event.
+  */
+  inline EventStatistics SolveEvents (AdaptiveTimeStepper & stepper, double t0, double tend,
+                                      VectorView<double> y, const std::vector<Event> & events,
+                                      double tau = 0,
+                                      std::function<void(double,VectorView<double>)> callback = nullptr,
+                                      RootMethod method = RootMethod::BRENT, double ttol = 1e-12,
+                                      PIController controller = PIController())
+  {
+    if (!stepper.hasDenseOutput())
+      throw std::invalid_argument("SolveEvents: stepper has no dense output");
+
+    EventStatistics stats;
+    EventLocator locator(events, method, ttol, t0, y);
+    auto control = [&](double told, double & t, VectorView<double> ynew)
+    {
+      stats.terminated = locator.check(stepper, told, t, ynew, stats.occurrences);
+      if (callback) callback(t, ynew);
+      return stats.terminated;
+    };
+    stats.t = IntegrateAdaptive(stepper, t0, tend, y, tau, control, stats, controller);
+    return stats;
+  }
+
+
+  // the same with constant step size tau
+  inline EventStatistics SolveEvents (TimeStepper & stepper, double tau, double t0, double tend,
+                                      VectorView<double> y, const std::vector<Event> & events,
+                                      std::function<void(double,VectorView<double>)> callback = nullptr,
+                                      RootMethod method = RootMethod::BRENT, double ttol = 1e-12)
+  {
+    if (!stepper.hasDenseOutput())
+      throw std::invalid_argument("SolveEvents: stepper has no dense output");
+
+    EventStatistics stats;
+    EventLocator locator(events, method, ttol, t0, y);
+    auto control = [&](double told, double & t, VectorView<double> ynew)
+    {
+      stats.terminated = locator.check(stepper, told, t, ynew, stats.occurrences);
+      if (callback) callback(t, ynew);
+      return stats.terminated;
+    };
+    stats.t = IntegrateFixed(stepper, tau, t0, tend, y, control, stats);
+    return stats;
+  }
+
+} // namespace ASC_ode
+
+#endif // EVENTS_HPP
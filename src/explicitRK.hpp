@@ -0,0 +1,358 @@
+#ifndef EXPLICITRK_HPP
+#define EXPLICITRK_HPP
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+#include "timestepper.hpp"
+#include "nonlinfunc.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  // cubic Hermite interpolation on [t0, t0+tau] from the values and derivatives at both ends
+  inline void HermiteInterpolation (double theta, double tau,
+                                    VectorView<double> y0, VectorView<double> f0,
+                                    VectorView<double> y1, VectorView<double> f1,
+                                    VectorView<double> y)
+  {
+    double h00 = (1+2*theta)*(1-theta)*(1-theta);
+    double h10 = theta*(1-theta)*(1-theta);
+    double h01 = theta*theta*(3-2*theta);
+    double h11 = -theta*theta*(1-theta);
+    y = h00*y0 + h01*y1;
+    y += (tau*h10)*f0;
+    y += (tau*h11)*f1;
+  }
+
+  // f1 = f(y1) unless already known, for the dense output and the next step starting at y1
+  inline void SlopeOnDemand (NonlinearFunction & rhs, VectorView<double> y1, VectorView<double> f1,
+                             bool & havef1, size_t & evaluations)
+  {
+    if (havef1) return;
+    rhs.evaluate(y1, f1);
+    evaluations++;
+    havef1 = true;
+  }
+
+  // cubic Hermite dense output of the step from y0 to y1, f(y1) is evaluated on demand
+  inline void HermiteDenseOutput (NonlinearFunction & rhs, double theta, double tau,
+                                  VectorView<double> y0, VectorView<double> f0,
+                                  VectorView<double> y1, VectorView<double> f1,
+                                  bool & havef1, size_t & evaluations, VectorView<double> y)
+  {
+    SlopeOnDemand(rhs, y1, f1, havef1, evaluations);
+    HermiteInterpolation(theta, tau, y0, f0, y1, f1, y);
+  }
+
+  // a step starting at y can take f(y) from the last step if it ended at ylast,
+  // compared exactly, equal states have equal slopes
+  inline bool SameState (VectorView<double> y, VectorView<double> ylast)
+  {
+    for (size_t i = 0; i < y.size(); i++)
+      if (y(i) != ylast(i)) return false;
+    return true;
+  }
+
+
+  // Explicit Runge–Kutta method
+  class ExplicitRungeKutta : public TimeStepper
+  {
+    Matrix<> m_a;
+    Vector<> m_b, m_c;
+    int m_stages;
+    int m_n;
+
+    Vector<> m_k;   // all stage derivatives
+    Vector<> m_y;   // all stage states
+
+    // last step for the dense output, y1 and f(y1) are computed on demand
+    Vector<> m_y0, m_y1, m_f1;
+    double m_tau = 0;
+    bool m_havef1 = false;
+
+  public:
+    ExplicitRungeKutta(std::shared_ptr<NonlinearFunction> rhs,
+                       const Matrix<> &a,
+                       const Vector<> &b,
+                       const Vector<> &c)
+      : TimeStepper(rhs),
+        m_a(a), m_b(b), m_c(c),
+        m_stages(int(c.size())),
+        m_n(int(rhs->dimX())),
+        m_k(m_stages * m_n),
+        m_y(m_stages * m_n),
+        m_y0(m_n), m_y1(m_n), m_f1(m_n)
+    {
+      if (m_a.rows() != m_stages || m_a.cols() != m_stages)
+        throw std::runtime_error("ExplicitRungeKutta: A must be s x s");
+      if (m_b.size() != size_t(m_stages))
+        throw std::runtime_error("ExplicitRungeKutta: b must have size s");
+    }
+
+    void DoStep(double tau, VectorView<double> y) override
+    {
+      m_y0 = y;
+      m_tau = tau;
+      m_havef1 = false;
+
+      // compute stages
+      for (int j = 0; j < m_stages; j++)
+      {
+        auto yj = m_y.range(j*m_n, (j+1)*m_n);
+        yj = y;
+
+        for (int ell = 0; ell < j; ell++)
+          yj += tau * m_a(j, ell) * m_k.range(ell*m_n, (ell+1)*m_n);
+
+        m_rhs->evaluate(yj, m_k.range(j*m_n, (j+1)*m_n));
+      }
+
+      // update solution
+      for (int j = 0; j < m_stages; j++)
+        y += tau * m_b(j) * m_k.range(j*m_n, (j+1)*m_n);
+    }
+
+    // cubic Hermite interpolation, the first stage is f(y0)
+    bool hasDenseOutput() const override { return m_c(0) == 0.0; }
+
+    void DenseOutput(double theta, VectorView<double> y) override
+    {
+      if (!m_havef1)
+        {
+          m_y1 = m_y0;
+          for (int j = 0; j < m_stages; j++)
+            m_y1 += m_tau * m_b(j) * m_k.range(j*m_n, (j+1)*m_n);
+          m_rhs->evaluate(m_y1, m_f1);
+          m_havef1 = true;
+        }
+      HermiteInterpolation(theta, m_tau, m_y0, m_k.range(0, m_n), m_y1, m_f1, y);
+    }
+  };
+
+
+
+  // Butcher tableau of an embedded pair: b gives the solution of the
+  // given order, bhat the embedded solution used for the error estimate
+  struct EmbeddedTableau
+  {
+    Matrix<> a;
+    Vector<> b, bhat, c;
+    // dense output: cubic Hermite interpolation plus tau theta^2 (1-theta)^2 sum_j dense_j k_j
+    Vector<> dense;
+    int order, embeddedOrder;
+
+    EmbeddedTableau (int stages, int _order, int _embeddedOrder)
+      : a(stages, stages), b(stages), bhat(stages), c(stages), dense(stages),
+        order(_order), embeddedOrder(_embeddedOrder)
+    {
+      a = 0.0;
+      b = 0.0;
+      bhat = 0.0;
+      c = 0.0;
+      dense = 0.0;
+    }
+
+    int stages() const { return c.size(); }
+  };
+
+
+  // Butcher tableau of a method without error estimate
+  struct ButcherTableau
+  {
+    Matrix<> a;
+    Vector<> b, c;
+  };
+
+  // classical Runge-Kutta method, order 4
+  inline ButcherTableau RK4()
+  {
+    ButcherTableau t { Matrix<>(4, 4), Vector<>(4), Vector<>(4) };
+    t.a = 0.0;
+    t.a(1,0) = 0.5;  t.a(2,1) = 0.5;  t.a(3,2) = 1;
+    t.b(0) = 1.0/6;  t.b(1) = 1.0/3;  t.b(2) = 1.0/3;  t.b(3) = 1.0/6;
+    t.c(0) = 0;  t.c(1) = 0.5;  t.c(2) = 0.5;  t.c(3) = 1;
+    return t;
+  }
+
+  // Bogacki-Shampine 3(2), FSAL
+  inline EmbeddedTableau BogackiShampine32()
+  {
+    EmbeddedTableau t(4, 3, 2);
+    t.c(1) = 1.0/2;  t.c(2) = 3.0/4;  t.c(3) = 1;
+    t.a(1,0) = 1.0/2;
+    t.a(2,1) = 3.0/4;
+    t.a(3,0) = 2.0/9;  t.a(3,1) = 1.0/3;  t.a(3,2) = 4.0/9;
+    t.b(0) = 2.0/9;  t.b(1) = 1.0/3;  t.b(2) = 4.0/9;
+    t.bhat(0) = 7.0/24;  t.bhat(1) = 1.0/4;  t.bhat(2) = 1.0/3;  t.bhat(3) = 1.0/8;
+    return t;
+  }
+
+  // Dormand-Prince 5(4), FSAL
+  inline EmbeddedTableau DormandPrince54()
+  {
+    EmbeddedTableau t(7, 5, 4);
+    t.c(1) = 1.0/5;  t.c(2) = 3.0/10;  t.c(3) = 4.0/5;  t.c(4) = 8.0/9;  t.c(5) = 1;  t.c(6) = 1;
+    t.a(1,0) = 1.0/5;
+    t.a(2,0) = 3.0/40;        t.a(2,1) = 9.0/40;
+    t.a(3,0) = 44.0/45;       t.a(3,1) = -56.0/15;       t.a(3,2) = 32.0/9;
+    t.a(4,0) = 19372.0/6561;  t.a(4,1) = -25360.0/2187;  t.a(4,2) = 64448.0/6561;
+    t.a(4,3) = -212.0/729;
+    t.a(5,0) = 9017.0/3168;   t.a(5,1) = -355.0/33;      t.a(5,2) = 46732.0/5247;
+    t.a(5,3) = 49.0/176;      t.a(5,4) = -5103.0/18656;
+    t.a(6,0) = 35.0/384;      t.a(6,2) = 500.0/1113;     t.a(6,3) = 125.0/192;
+    t.a(6,4) = -2187.0/6784;  t.a(6,5) = 11.0/84;
+    for (int j = 0; j < 7; j++)
+      t.b(j) = t.a(6,j);
+    t.bhat(0) = 5179.0/57600;    t.bhat(2) = 7571.0/16695;  t.bhat(3) = 393.0/640;
+    t.bhat(4) = -92097.0/339200; t.bhat(5) = 187.0/2100;    t.bhat(6) = 1.0/40;
+    // continuous extension of order 4 (Hairer-Norsett-Wanner, DOPRI5)
+    t.dense(0) = -12715105075.0/11282082432;   t.dense(2) = 87487479700.0/32700410799;
+    t.dense(3) = -10690763975.0/1880347072;    t.dense(4) = 701980252875.0/199316789632;
+    t.dense(5) = -1453857185.0/822651844;      t.dense(6) = 69997945.0/29380423;
+    return t;
+  }
+
+  // Verner 6(5), the pair of DVERK (Hull, Enright, Jackson)
+  inline EmbeddedTableau Verner65()
+  {
+    EmbeddedTableau t(8, 6, 5);
+    t.c(1) = 1.0/6;  t.c(2) = 4.0/15;  t.c(3) = 2.0/3;  t.c(4) = 5.0/6;
+    t.c(5) = 1;      t.c(6) = 1.0/15;  t.c(7) = 1;
+    t.a(1,0) = 1.0/6;
+    t.a(2,0) = 4.0/75;         t.a(2,1) = 16.0/75;
+    t.a(3,0) = 5.0/6;          t.a(3,1) = -8.0/3;      t.a(3,2) = 5.0/2;
+    t.a(4,0) = -165.0/64;      t.a(4,1) = 55.0/6;      t.a(4,2) = -425.0/64;
+    t.a(4,3) = 85.0/96;
+    t.a(5,0) = 12.0/5;         t.a(5,1) = -8;          t.a(5,2) = 4015.0/612;
+    t.a(5,3) = -11.0/36;       t.a(5,4) = 88.0/255;
+    t.a(6,0) = -8263.0/15000;  t.a(6,1) = 124.0/75;    t.a(6,2) = -643.0/680;
+    t.a(6,3) = -81.0/250;      t.a(6,4) = 2484.0/10625;
+    t.a(7,0) = 3501.0/1720;    t.a(7,1) = -300.0/43;   t.a(7,2) = 297275.0/52632;
+    t.a(7,3) = -319.0/2322;    t.a(7,4) = 24068.0/84065;  t.a(7,6) = 3850.0/26703;
+    t.b(0) = 3.0/40;    t.b(2) = 875.0/2244;  t.b(3) = 23.0/72;  t.b(4) = 264.0/1955;
+    t.b(6) = 125.0/11592;  t.b(7) = 43.0/616;
+    t.bhat(0) = 13.0/160;  t.bhat(2) = 2375.0/5984;  t.bhat(3) = 5.0/16;
+    t.bhat(4) = 12.0/85;   t.bhat(5) = 3.0/44;
+    return t;
+  }
+
+
+  /*
+    Explicit Runge-Kutta with embedded error estimate.
+    If the last stage is evaluated at the new solution (first same as
+    last, FSAL), its derivative is reused as first stage of the next step.
+  */
+  class EmbeddedRungeKutta : public AdaptiveTimeStepper
+  {
+    EmbeddedTableau m_tab;
+    int m_stages;
+    size_t m_n;
+    bool m_fsal;
+
+    Vector<> m_k;       // all stage derivatives
+    Vector<> m_ystage, m_ynew, m_err;
+    Vector<> m_yfsal, m_ffsal;   // state at which f is known, and f there
+    bool m_havefirst = false;
+    Vector<> m_y0;      // start of the last step, for the dense output
+    double m_tauold = 0;
+
+  public:
+    EmbeddedRungeKutta (std::shared_ptr<NonlinearFunction> rhs, const EmbeddedTableau & tab,
+                        Tolerance tol = Tolerance())
+      : AdaptiveTimeStepper(rhs, tol), m_tab(tab),
+        m_stages(tab.stages()), m_n(rhs->dimX()),
+        m_k(m_stages*m_n), m_ystage(m_n), m_ynew(m_n), m_err(m_n),
+        m_yfsal(m_n), m_ffsal(m_n), m_y0(m_n)
+    {
+      m_fsal = m_tab.c(m_stages-1) == 1.0;
+      for (int j = 0; j < m_stages; j++)
+        if (m_tab.a(m_stages-1, j) != m_tab.b(j))
+          m_fsal = false;
+    }
+
+    int order() const { return m_tab.order; }
+    int errorOrder() const override { return std::min(m_tab.order, m_tab.embeddedOrder) + 1; }
+    bool fsal() const { return m_fsal; }
+
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      computeStages(tau, y);
+      acceptStep(tau, y);
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      computeStages(tau, y);
+
+      m_err = 0.0;
+      for (int j = 0; j < m_stages; j++)
+        {
+          double e = m_tab.b(j) - m_tab.bhat(j);
+          if (e != 0.0)
+            m_err += (tau*e) * stage(j);
+        }
+      err = m_tol.errorNorm(m_err, y, m_ynew);
+      if (!(err <= 1)) return false;
+
+      acceptStep(tau, y);
+      return true;
+    }
+
+    // Hermite interpolation with the tableau's correction, f(y1) is the
+    // last stage of FSAL pairs and else evaluated here, and reused by the next step
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      if (!m_havefirst) m_yfsal = m_ynew;
+      HermiteDenseOutput(*m_rhs, theta, m_tauold, m_y0, stage(0), m_ynew, m_ffsal,
+                         m_havefirst, m_evaluations, y);
+      double fac = m_tauold * theta*theta * (1-theta)*(1-theta);
+      for (int j = 0; j < m_stages; j++)
+        if (m_tab.dense(j) != 0.0)
+          y += (fac*m_tab.dense(j)) * stage(j);
+    }
+
+  private:
+    VectorView<double> stage (int j) { return m_k.range(j*m_n, (j+1)*m_n); }
+
+    void computeStages (double tau, VectorView<double> y)
+    {
+      bool reuse = m_havefirst && SameState(y, m_yfsal);
+      if (reuse)
+        stage(0) = m_ffsal;
+      for (int j = reuse ? 1 : 0; j < m_stages; j++)
+        {
+          m_ystage = y;
+          for (int l = 0; l < j; l++)
+            if (m_tab.a(j,l) != 0.0)
+              m_ystage += (tau*m_tab.a(j,l)) * stage(l);
+          m_rhs->evaluate(m_ystage, stage(j));
+          m_evaluations++;
+        }
+
+      m_ynew = y;
+      for (int j = 0; j < m_stages; j++)
+        if (m_tab.b(j) != 0.0)
+          m_ynew += (tau*m_tab.b(j)) * stage(j);
+    }
+
+    void acceptStep (double tau, VectorView<double> y)
+    {
+      m_y0 = y;
+      m_tauold = tau;
+      y = m_ynew;
+      m_havefirst = m_fsal;
+      if (m_fsal)
+        {
+          m_ffsal = stage(m_stages-1);
+          m_yfsal = y;
+        }
+    }
+  };
+
+} // namespace ASC_ode
+
+#endif // EXPLICITRK_HPP
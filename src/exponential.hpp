@@ -0,0 +1,448 @@
+#ifndef EXPONENTIAL_HPP
+#define EXPONENTIAL_HPP
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+#include "timestepper.hpp"
+#include "explicitRK.hpp"
+#include "lu.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    phi-functions phi_0(A) e_1 .. phi_p(A) e_1 of a small dense matrix,
+    phi_0 = exp, phi_{k+1}(z) = (phi_k(z) - 1/k!) / z.
+    They are the last columns of the exponential of the augmented matrix
+    [[A, e_1 0], [0, J]] with the (p x p) shift matrix J (Sidje, Expokit),
+    computed by scaling and squaring with the (6,6) Pade approximation.
+    phi(i,k) is entry i of phi_k(A) e_1.
+  */
+  class PhiFunctions
+  {
+    size_t m_m = 0, m_size = 0;
+    std::vector<double> m_a, m_pow, m_num, m_den, m_tmp;
+    DenseLU m_lu;
+
+  public:
+    // memory for m + p up to maxsize, compute then does not allocate
+    void reserve (size_t maxsize)
+    {
+      for (auto v : { &m_a, &m_pow, &m_num, &m_den, &m_tmp })
+        v->reserve(maxsize*maxsize);
+      m_lu = DenseLU(maxsize);
+    }
+
+    void compute (size_t m, const std::vector<double> & a, double t, int p)
+    {
+      size_t n = m + p;
+      if (n != m_size)
+        {
+          m_size = n;
+          for (auto v : { &m_a, &m_pow, &m_num, &m_den, &m_tmp })
+            v->assign(n*n, 0.0);
+          m_lu.resize(n);
+        }
+      m_m = m;
+
+      // augmented matrix t*A, row major with stride n
+      std::fill(m_a.begin(), m_a.end(), 0.0);
+      for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < m; j++)
+          m_a[i*n+j] = t * a[i*m+j];
+      if (p > 0) m_a[m] = 1;
+      for (size_t k = m; k+1 < n; k++)
+        m_a[k*n+k+1] = 1;
+
+      double anorm = 0;
+      for (size_t i = 0; i < n; i++)
+        {
+          double sum = 0;
+          for (size_t j = 0; j < n; j++)
+            sum += std::fabs(m_a[i*n+j]);
+          anorm = std::max(anorm, sum);
+        }
+      int s = anorm > 0.5 ? int(std::ceil(std::log2(anorm / 0.5))) : 0;
+      double scale = std::ldexp(1.0, -s);
+      for (auto & v : m_a) v *= scale;
+
+      // Pade: N = sum c_k A^k, D = sum (-1)^k c_k A^k
+      const int q = 6;
+      std::fill(m_num.begin(), m_num.end(), 0.0);
+      std::fill(m_den.begin(), m_den.end(), 0.0);
+      std::fill(m_pow.begin(), m_pow.end(), 0.0);
+      for (size_t i = 0; i < n; i++)
+        m_num[i*n+i] = m_den[i*n+i] = m_pow[i*n+i] = 1;
+      double c = 1;
+      for (int k = 1; k <= q; k++)
+        {
+          c *= double(q-k+1) / (k * (2*q-k+1));
+          multiply(m_pow, m_a, m_tmp);
+          std::swap(m_pow, m_tmp);
+          double sign = (k % 2) ? -1 : 1;
+          for (size_t i = 0; i < n*n; i++)
+            {
+              m_num[i] += c * m_pow[i];
+              m_den[i] += sign * c * m_pow[i];
+            }
+        }
+
+      // exp = D^{-1} N, column by column
+      m_lu.refactor(n, [&](size_t i, size_t j) { return m_den[i*n+j]; });
+      std::vector<double> & col = m_tmp;
+      for (size_t j = 0; j < n; j++)
+        {
+          for (size_t i = 0; i < n; i++)
+            col[i] = m_num[i*n+j];
+          m_lu.solve(col);
+          for (size_t i = 0; i < n; i++)
+            m_pow[i*n+j] = col[i];
+        }
+      for (int k = 0; k < s; k++)
+        {
+          multiply(m_pow, m_pow, m_tmp);
+          std::swap(m_pow, m_tmp);
+        }
+    }
+
+    // entry i of phi_k(t A) e_1
+    double phi (size_t i, int k) const
+    {
+      return k == 0 ? m_pow[i*m_size] : m_pow[i*m_size + m_m + k-1];
+    }
+
+  private:
+    void multiply (const std::vector<double> & a, const std::vector<double> & b,
+                   std::vector<double> & c) const
+    {
+      size_t n = m_size;
+      std::fill(c.begin(), c.end(), 0.0);
+      for (size_t i = 0; i < n; i++)
+        for (size_t k = 0; k < n; k++)
+          {
+            double aik = a[i*n+k];
+            if (aik == 0.0) continue;
+            for (size_t j = 0; j < n; j++)
+              c[i*n+j] += aik * b[k*n+j];
+          }
+    }
+  };
+
+
+  /*
+    Krylov approximation phi_k(t J) v ~ beta V_m phi_k(t H_m) e_1 from the
+    Arnoldi process on J. The dimension grows until the a-posteriori estimate
+    beta h_{m+1,m} tau |e_m^T phi_{k+1}(tau H_m) e_1| v_{m+1} of the error of
+    phi_k(tau J) v is accepted by errnorm. The error decreases with the index,
+    so all phi_j(t J) v with j >= k and 0 <= t <= tau are then available
+    from the same basis. The approximation is exact when the Krylov space
+    is invariant under J: at a breakdown h_{m+1,m} ~ 0 relative to |H_m|,
+    or when it is the whole space.
+  */
+  class KrylovPhi
+  {
+    size_t m_n;
+    int m_maxdim;
+    Matrix<> m_V;                 // Arnoldi vectors, one per row
+    std::vector<double> m_H;      // (maxdim+1) x maxdim Hessenberg matrix
+    std::vector<double> m_Hm;     // leading m x m block
+    Vector<> m_w;
+    PhiFunctions m_phi;
+    int m_dim = 0;
+    double m_beta = 0;
+
+  public:
+    KrylovPhi (size_t n, int maxdim = 40)
+      : m_n(n), m_maxdim(std::min<int>(maxdim, n)), m_V(m_maxdim+1, n),
+        m_H((m_maxdim+1)*m_maxdim), m_w(n)
+    {
+      // phi_k with k <= 4, and one more index for the estimate
+      m_Hm.reserve(m_maxdim*m_maxdim);
+      m_phi.reserve(m_maxdim+5);
+    }
+
+    int dimension() const { return m_dim; }
+
+    // matvec(v, Jv), errnorm(e) is the scaled norm the error is measured in, accepted if <= 1.
+    // Returns false if the maximal dimension is not sufficient.
+    template <typename MATVEC, typename ERRNORM>
+    bool build (MATVEC && matvec, VectorView<double> v, double tau, int k, ERRNORM && errnorm)
+    {
+      m_beta = norm(v);
+      m_dim = 0;
+      if (m_beta == 0.0)
+        return true;
+      m_V.row(0) = (1/m_beta) * v;
+      std::fill(m_H.begin(), m_H.end(), 0.0);
+      int mx = m_maxdim;
+      double hnorm2 = 0;            // |H_m|_F^2
+
+      for (int j = 0; j < mx; j++)
+        {
+          matvec(m_V.row(j), m_w);
+          // modified Gram-Schmidt
+          for (int i = 0; i <= j; i++)
+            {
+              double h = 0;
+              for (size_t l = 0; l < m_n; l++)
+                h += m_w(l) * m_V(i,l);
+              H(i,j) = h;
+              hnorm2 += h*h;
+              m_w -= h * m_V.row(i);
+            }
+          double hnext = norm(m_w);
+          H(j+1,j) = hnext;
+          hnorm2 += hnext*hnext;
+          m_dim = j+1;
+
+          // happy breakdown: the Krylov space is invariant
+          if (hnext <= 1e-12 * std::sqrt(hnorm2) || size_t(m_dim) == m_n)
+            return true;
+          m_V.row(j+1) = (1/hnext) * m_w;
+
+          // the estimate is too optimistic below dimension 4 and cheap compared to
+          // the matvec only for small m: check at every dimension from 4 to 10,
+          // then at every even one, and at the last one
+          if (j+1 < mx && (j+1 < 4 || (j+1 > 10 && (j+1) % 2 == 1))) continue;
+          SetupH();
+          m_phi.compute(m_dim, m_Hm, tau, k+1);
+          double est = m_beta * hnext * tau * std::fabs(m_phi.phi(j, k+1));
+          if (est * errnorm(m_V.row(j+1)) <= 1)
+            return true;
+        }
+      return false;
+    }
+
+    // out = phi_k(t J) v
+    void apply (double t, int k, VectorView<double> out)
+    {
+      out = 0.0;
+      if (m_dim == 0) return;
+      SetupH();
+      m_phi.compute(m_dim, m_Hm, t, std::max(k, 1));
+      for (int i = 0; i < m_dim; i++)
+        out += (m_beta * m_phi.phi(i, k)) * m_V.row(i);
+    }
+
+  private:
+    double & H (int i, int j) { return m_H[i*m_maxdim+j]; }
+
+    // leading m x m block of the Hessenberg matrix
+    void SetupH ()
+    {
+      m_Hm.resize(m_dim*m_dim);
+      for (int i = 0; i < m_dim; i++)
+        for (int j = 0; j < m_dim; j++)
+          m_Hm[i*m_dim+j] = H(i,j);
+    }
+  };
+
+
+  /*
+    Exponential Rosenbrock methods of Hochbruck, Ostermann and Schweitzer
+    for y' = f(y) = J_n y + g_n(y), J_n = f'(y_n):
+      exprb32, order 3 with the exponential Rosenbrock-Euler method (order 2) embedded
+      exprb43, order 4 with an embedded method of order 3
+    The linear part is integrated exactly by phi-functions of tau J_n, so
+    the step size is limited by the nonlinear remainder g_n, not by the
+    fastest linear modes. phi-functions of J_n act on vectors through the
+    Krylov process, with J_n v from evaluateJacVec or, with matrixfree = false,
+    from the Jacobian evaluateDeriv at the start of the step.
+  */
+  class ExponentialRosenbrock : public AdaptiveTimeStepper
+  {
+    int m_order;
+    size_t m_n;
+    bool m_matrixfree;
+    KrylovPhi m_krylov;
+
+    Vector<> m_y0, m_f0, m_f1, m_ynew, m_u, m_d2, m_d3, m_w, m_tmp, m_err;
+    Vector<> m_ystart, m_fstart;  // start of a halved step
+    Matrix<> m_jac;
+    bool m_havef1 = false;      // f(m_ynew) is known
+    double m_tauold = 0;
+    size_t m_matvecs = 0;
+    int m_maxdim = 0;
+
+  public:
+    ExponentialRosenbrock (std::shared_ptr<NonlinearFunction> rhs, int order = 4,
+                           Tolerance tol = Tolerance(), bool matrixfree = true, int maxdim = 40)
+      : AdaptiveTimeStepper(rhs, tol), m_order(order), m_n(rhs->dimX()),
+        m_matrixfree(matrixfree), m_krylov(m_n, maxdim),
+        m_y0(m_n), m_f0(m_n), m_f1(m_n), m_ynew(m_n), m_u(m_n), m_d2(m_n), m_d3(m_n),
+        m_w(m_n), m_tmp(m_n), m_err(m_n), m_ystart(m_n), m_fstart(m_n),
+        m_jac(matrixfree ? 0 : m_n, matrixfree ? 0 : m_n)
+    {
+      if (order != 3 && order != 4)
+        throw std::invalid_argument("ExponentialRosenbrock: order must be 3 or 4");
+    }
+
+    int order() const { return m_order; }
+    int errorOrder() const override { return m_order; }
+
+    // Jacobian-vector products, and the largest Krylov dimension used so far
+    size_t matvecs() const { return m_matvecs; }
+    int maxKrylovDimension() const { return m_maxdim; }
+
+    // a step the Krylov process can not resolve is done in two halves,
+    // std::domain_error if it still fails after MAXHALVINGS halvings.
+    // The dense output then interpolates between the end points of the whole step.
+    static constexpr int MAXHALVINGS = 20;
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      double err;
+      if (Step(tau, y, err, false))
+        return;
+      m_ystart = m_y0;
+      m_fstart = m_f0;
+      HalvedStep(tau/2, y, 1);
+      HalvedStep(tau/2, y, 1);
+      m_y0 = m_ystart;
+      m_f0 = m_fstart;
+      m_tauold = tau;
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      return Step(tau, y, err, true);
+    }
+
+    // cubic Hermite interpolation over the whole step, also after halving
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      HermiteDenseOutput(*m_rhs, theta, m_tauold, m_y0, m_f0, m_ynew, m_f1, m_havef1, m_evaluations, y);
+    }
+
+  private:
+    void HalvedStep (double tau, VectorView<double> y, int depth)
+    {
+      double err;
+      if (Step(tau, y, err, false))
+        return;
+      if (depth == MAXHALVINGS)
+        throw std::domain_error("ExponentialRosenbrock: Krylov dimension too small for the step");
+      HalvedStep(tau/2, y, depth+1);
+      HalvedStep(tau/2, y, depth+1);
+    }
+
+    void MatVec (VectorView<double> v, VectorView<double> Jv)
+    {
+      m_matvecs++;
+      if (m_matrixfree)
+        m_rhs->evaluateJacVec(m_y0, m_f0, v, Jv);
+      else
+        for (size_t i = 0; i < m_n; i++)
+          {
+            double sum = 0;
+            for (size_t j = 0; j < m_n; j++)
+              sum += m_jac(i,j) * v(j);
+            Jv(i) = sum;
+          }
+    }
+
+    // Krylov basis for phi_j(tau J) v, j >= k, the result is scaled by fac
+    bool Krylov (VectorView<double> v, double tau, int k, double fac)
+    {
+      auto matvec = [this](VectorView<double> x, VectorView<double> Jx) { MatVec(x, Jx); };
+      // the Krylov error does not enter the error estimate of the step, it is kept
+      // far below the tolerance since the a-posteriori estimate is optimistic
+      // for small dimensions
+      auto errnorm = [&](VectorView<double> e) { return 1000 * fac * m_tol.errorNorm(e, m_y0, m_y0); };
+      bool ok = m_krylov.build(matvec, v, tau, k, errnorm);
+      m_maxdim = std::max(m_maxdim, m_krylov.dimension());
+      return ok;
+    }
+
+    // d = f(u) - f(y0) - J (u - y0), the nonlinear remainder
+    void Remainder (VectorView<double> u, VectorView<double> d)
+    {
+      m_rhs->evaluate(u, d);
+      m_evaluations++;
+      d -= m_f0;
+      m_tmp = u - m_y0;
+      MatVec(m_tmp, m_w);
+      d -= m_w;
+    }
+
+    bool Step (double tau, VectorView<double> y, double & err, bool adaptive)
+    {
+      bool known = m_havef1 && SameState(y, m_ynew);
+      m_y0 = y;
+      if (known)
+        m_f0 = m_f1;
+      else
+        {
+          m_rhs->evaluate(y, m_f0);
+          m_evaluations++;
+        }
+      m_havef1 = false;
+      if (!m_matrixfree)
+        m_rhs->evaluateDeriv(y, m_jac);
+
+      err = std::numeric_limits<double>::infinity();
+      if (!Krylov(m_f0, tau, 1, tau))
+        return false;
+
+      if (m_order == 3)
+        {
+          // U2 = y + tau phi_1 f0, y1 = U2 + 2 tau phi_3 D2
+          m_krylov.apply(tau, 1, m_u);
+          m_u = m_y0 + tau * m_u;
+          Remainder(m_u, m_d2);
+          if (!Krylov(m_d2, tau, 3, 2*tau))
+            return false;
+          m_krylov.apply(tau, 3, m_err);
+          m_err *= 2*tau;
+          m_ynew = m_u + m_err;
+        }
+      else
+        {
+          // U2 = y + tau/2 phi_1(tau/2 J) f0, U3 = y + tau phi_1 (f0 + D2)
+          m_krylov.apply(tau/2, 1, m_u);
+          m_u = m_y0 + (tau/2) * m_u;
+          m_krylov.apply(tau, 1, m_ynew);
+          m_ynew = m_y0 + tau * m_ynew;         // exponential Rosenbrock-Euler
+          Remainder(m_u, m_d2);
+          if (!Krylov(m_d2, tau, 1, 48*tau))
+            return false;
+          m_krylov.apply(tau, 1, m_u);
+          m_u = m_ynew + tau * m_u;
+          // y1 += tau (16 phi_3 - 48 phi_4) D2 + tau (-2 phi_3 + 12 phi_4) D3
+          m_krylov.apply(tau, 3, m_w);
+          m_ynew += (16*tau) * m_w;
+          m_krylov.apply(tau, 4, m_err);
+          m_err *= -48*tau;
+          Remainder(m_u, m_d3);
+          if (!Krylov(m_d3, tau, 3, 12*tau))
+            return false;
+          m_krylov.apply(tau, 3, m_w);
+          m_ynew += (-2*tau) * m_w;
+          m_krylov.apply(tau, 4, m_w);
+          m_err += (12*tau) * m_w;
+          // the embedded method drops the phi_4 terms
+          m_ynew += m_err;
+        }
+
+      err = m_tol.errorNorm(m_err, m_y0, m_ynew);
+      if (adaptive && !(err <= 1))
+        return false;
+
+      m_tauold = tau;
+      y = m_ynew;
+      return true;
+    }
+  };
+
+}
+
+#endif
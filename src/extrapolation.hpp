@@ -0,0 +1,387 @@
+#ifndef EXTRAPOLATION_HPP
+#define EXTRAPOLATION_HPP
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+
+#include "timestepper.hpp"
+#include "explicitRK.hpp"
+#include "threadpool.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Gragg-Bulirsch-Stoer extrapolation (Hairer-Norsett-Wanner I, II.9).
+    Column j of the table runs the modified midpoint rule with n_j = 4j+2
+    substeps over the step H, its error expands in even powers of H/n_j,
+    Aitken-Neville extrapolation gives T_jj of order 2j+2. The difference
+    T_jj - T_j,j-1 estimates the error of order 2j+1.
+
+    Order and step size are chosen together: from the work per unit step
+    A_j / H_j of the columns around the target column k, where A_j counts
+    the evaluations of T_jj and H_j is the optimal step for column j. The
+    step is accepted at column k-1, k or k+1 as soon as the error is below
+    the tolerance, and rejected early when the convergence of the lower
+    columns shows that column k+1 will not meet it.
+
+    The dense output is that of ODEX (II.9): central differences of the
+    f values of each midpoint rule around x0 + H/2 approximate the
+    derivatives there, n_j/2 odd gives them expansions in even powers
+    of H/n_j as well, so they are extrapolated like the solution. The
+    polynomial matches them and the values and slopes at both ends.
+
+    The midpoint rules of the columns are independent: with a thread pool
+    (setThreadPool) the columns 0 .. k+1 of a step are computed in
+    parallel, columns not needed for acceptance are then wasted. The
+    right hand side must allow concurrent calls of evaluate.
+  */
+  class GraggBulirschStoer : public AdaptiveTimeStepper
+  {
+    int m_kmax;                   // columns
+    size_t m_n;
+    int m_k;                      // target column
+    std::vector<size_t> m_nseq;   // substeps of the columns
+    std::vector<size_t> m_work;   // evaluations of T_jj
+
+    std::vector<std::vector<Vector<>>> m_table;   // T_jl, l <= j
+    std::vector<Vector<>> m_z0, m_z1, m_zmid;     // midpoint rule, per column
+    std::vector<std::vector<Vector<>>> m_fz;      // its f_1 .. f_n-1
+    std::vector<double> m_err, m_hopt;
+    std::vector<bool> m_done;
+
+    Vector<> m_f0, m_diff;
+    Vector<> m_y0, m_y1, m_f1;    // last step, for the dense output
+    Vector<> m_ystart, m_fstart;  // start of a DoStep split into several steps
+    bool m_havef1 = false;
+    double m_tauold = 0;
+    int m_kc = 0;                 // accepted column of the last step
+    int m_mu = 0;                 // highest derivative at the midpoint
+    std::vector<Vector<>> m_ext, m_dens, m_g;     // dense output polynomial
+    bool m_havedense = false;
+    bool m_hermite = false;       // cubic Hermite after a split DoStep
+    double m_proposed = 0;
+    bool m_lastRejected = false;
+    ThreadPool * m_pool = nullptr;
+
+  public:
+    GraggBulirschStoer (std::shared_ptr<NonlinearFunction> rhs, Tolerance tol = Tolerance(),
+                        int columns = 8)
+      : AdaptiveTimeStepper(rhs, tol), m_kmax(std::max(columns, 3)), m_n(rhs->dimX()),
+        m_f0(m_n), m_diff(m_n), m_y0(m_n), m_y1(m_n), m_f1(m_n),
+        m_ystart(m_n), m_fstart(m_n)
+    {
+      size_t work = 1;
+      for (int j = 0; j < m_kmax; j++)
+        {
+          m_nseq.push_back(4*j+2);
+          work += m_nseq[j] - 1;
+          m_work.push_back(work);
+          m_table.emplace_back();
+          for (int l = 0; l <= j; l++)
+            m_table[j].emplace_back(m_n);
+          m_z0.emplace_back(m_n);
+          m_z1.emplace_back(m_n);
+          m_zmid.emplace_back(m_n);
+          m_fz.emplace_back();
+          for (size_t i = 1; i < m_nseq[j]; i++)
+            m_fz[j].emplace_back(m_n);
+          m_ext.emplace_back(m_n);
+        }
+      for (int kappa = 0; kappa < 2*m_kmax; kappa++)
+        m_dens.emplace_back(m_n);
+      for (int i = 0; i < 4; i++)
+        m_g.emplace_back(m_n);
+      m_err.resize(m_kmax);
+      m_hopt.resize(m_kmax);
+      m_done.resize(m_kmax);
+
+      // initial order from the tolerance, as in ODEX
+      m_k = std::clamp(int(-std::log10(tol.rtol(0) + 1e-40) * 0.6 + 0.5), 1, m_kmax-2);
+    }
+
+    // the columns run serially when TryStep is called from a task of the
+    // pool itself, waiting there for the pool's own tasks could deadlock
+    void setThreadPool (ThreadPool * pool) { m_pool = pool; }
+
+    // order of the current target column, and the exponent of its error estimate
+    int order() const { return 2*m_k+2; }
+    int errorOrder() const override { return 2*m_k+1; }
+    double proposedStepSize() const override { return m_proposed; }
+
+    // steps with error control until tau is covered, after more than one
+    // the dense output is the cubic Hermite interpolant over the whole of tau
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      double t = 0, h = tau, err;
+      int parts = 0;
+      while (true)
+        {
+          bool last = h >= tau - t;
+          if (last) h = tau - t;
+          if (TryStep(h, y, err))
+            {
+              if (++parts == 1)
+                {
+                  m_ystart = m_y0;
+                  m_fstart = m_f0;
+                }
+              t += h;
+              if (last) break;
+            }
+          h = m_proposed;
+          // also catches a NaN error, which shrinks h without bound
+          if (!(h >= 1e-14 * std::max(1.0, std::fabs(tau))))
+            throw std::domain_error("GraggBulirschStoer: step size too small");
+        }
+      if (parts > 1)
+        {
+          m_y0 = m_ystart;
+          m_f0 = m_fstart;
+          m_tauold = tau;
+          m_hermite = true;
+        }
+    }
+
+    bool TryStep (double H, VectorView<double> y, double & err) override
+    {
+      if (m_havef1 && SameState(y, m_y1))
+        m_f0 = m_f1;
+      else
+        {
+          m_rhs->evaluate(y, m_f0);
+          m_evaluations++;
+        }
+
+      int k = m_k;
+      std::fill(m_done.begin(), m_done.end(), false);
+      if (m_pool && m_pool->size() > 1 && !m_pool->isWorker())
+        {
+          std::vector<size_t> evals(k+2, 0);
+          m_pool->parallelFor(k+2, [&](size_t j) { evals[j] = midpoint(j, H, y); });
+          for (int j = 0; j <= k+1; j++)
+            {
+              m_evaluations += evals[j];
+              m_done[j] = true;
+            }
+        }
+
+      int accepted = -1, last = 0;
+      for (int j = 0; j <= k+1; j++)
+        {
+          if (!m_done[j])
+            {
+              m_evaluations += midpoint(j, H, y);
+              m_done[j] = true;
+            }
+          extrapolate(j);
+          last = j;
+          if (j == 0) continue;
+
+          // error of T_j,j-1, relative to the tolerance
+          m_diff = m_table[j][j] - m_table[j][j-1];
+          m_err[j] = m_tol.errorNorm(m_diff, y, m_table[j][j]);
+          double expo = 1.0 / (2*j+1);
+          double fac = m_err[j] > 0 ? 0.94 * std::pow(0.65 / m_err[j], expo) : m_err[j] == 0 ? 4 : 0.02;
+          m_hopt[j] = H * std::clamp(fac, 0.02, 4.0);
+
+          if (j < k-1) continue;
+          if (m_err[j] <= 1)
+            {
+              accepted = j;
+              break;
+            }
+          // will column k+1 converge?
+          double r = double(m_nseq[k+1]) / m_nseq[0];
+          if (j == k-1 && m_err[j] > std::pow(r * m_nseq[k] / m_nseq[0], 2)) break;
+          if (j == k && m_err[j] > r*r) break;
+        }
+
+      if (accepted < 0)
+        {
+          err = m_err[last];
+          // continue with the best of the columns computed
+          int knew = std::min({ k, last, m_kmax-2 });
+          if (knew > 1 && cost(knew-1) < 0.8 * cost(knew)) knew--;
+          m_k = knew;
+          m_proposed = m_hopt[knew];
+          m_lastRejected = true;
+          return false;
+        }
+
+      // order selection of ODEX: decrease if the lower column is cheaper
+      // per unit step, increase if the higher column promises to be
+      int kc = accepted;
+      err = m_err[kc];
+      int knew;
+      if (kc == 1)
+        knew = m_lastRejected ? 1 : std::min(2, m_kmax-2);
+      else if (kc <= k)
+        {
+          knew = kc;
+          if (cost(kc-1) < 0.8 * cost(kc)) knew = kc-1;
+          if (cost(kc) < 0.9 * cost(kc-1)) knew = std::min(kc+1, m_kmax-2);
+        }
+      else
+        {
+          knew = kc-1;
+          if (kc > 2 && cost(kc-2) < 0.8 * cost(kc-1)) knew = kc-2;
+          if (cost(kc) < 0.9 * cost(knew)) knew = std::min(kc, m_kmax-2);
+        }
+
+      double hnew = knew <= kc ? m_hopt[knew] : m_hopt[kc] * m_work[knew] / m_work[kc];
+      if (m_lastRejected)
+        {
+          // no increase right after a rejection
+          knew = std::min(knew, kc);
+          hnew = std::min(H, m_hopt[knew]);
+        }
+      m_k = knew;
+      m_proposed = hnew;
+      m_lastRejected = false;
+
+      m_y0 = y;
+      m_tauold = H;
+      y = m_table[kc][kc];
+      m_y1 = y;
+      m_kc = kc;
+      m_havef1 = false;
+      m_havedense = false;
+      m_hermite = false;
+      return true;
+    }
+
+    // f at the end is evaluated here and reused by the next step
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      if (m_hermite)
+        {
+          HermiteDenseOutput(*m_rhs, theta, m_tauold, m_y0, m_f0, m_y1, m_f1, m_havef1, m_evaluations, y);
+          return;
+        }
+      SlopeOnDemand(*m_rhs, m_y1, m_f1, m_havef1, m_evaluations);
+      if (!m_havedense)
+        densePolynomial();
+
+      double s = theta - 0.5, sk = 1;
+      HermiteInterpolation(theta, 1, m_g[0], m_g[1], m_g[2], m_g[3], y);
+      y *= std::pow(s, m_mu+1);
+      for (int kappa = 0; kappa <= m_mu; kappa++)
+        {
+          y += sk * m_dens[kappa];
+          sk *= s;
+        }
+    }
+
+  private:
+    // work per unit step of column j
+    double cost (int j) const { return m_work[j] / m_hopt[j]; }
+
+    // T_j0 by the modified midpoint rule, returns the evaluations
+    size_t midpoint (size_t j, double H, VectorView<double> y)
+    {
+      size_t steps = m_nseq[j];
+      double h = H / steps;
+      Vector<> * zold = &m_z0[j];
+      Vector<> * z = &m_z1[j];
+
+      *zold = y;
+      *z = y + h * m_f0;
+      for (size_t i = 1; i < steps; i++)
+        {
+          Vector<> & f = m_fz[j][i-1];
+          if (i == steps/2) m_zmid[j] = *z;
+          m_rhs->evaluate(*z, f);
+          *zold += (2*h) * f;
+          std::swap(zold, z);
+        }
+      m_table[j][0] = *z;
+      return steps-1;
+    }
+
+    // T_jl = T_j,l-1 + (T_j,l-1 - T_j-1,l-1) / ((n_j/n_j-l)^2 - 1)
+    void extrapolate (int j)
+    {
+      for (int l = 1; l <= j; l++)
+        {
+          double r = double(m_nseq[j]) / m_nseq[j-l];
+          m_table[j][l] = m_table[j][l-1] + (1.0 / (r*r-1)) * (m_table[j][l-1] - m_table[j-1][l-1]);
+        }
+    }
+
+    /*
+      y(theta) = T(s) + s^(mu+1) g(s), s = theta - 1/2, with T the Taylor
+      polynomial at the midpoint of degree mu = 2 kc - 1 and g the cubic
+      which gives the values and slopes at s = -1/2 and 1/2. Derivative
+      kappa of the midpoint rule of column j is delta^(kappa-1) f_m / (2h)^(kappa-1),
+      m = n_j/2, delta f_i = f_i+1 - f_i-1, the columns kappa/2 .. kc have
+      the f_i needed and are extrapolated.
+    */
+    void densePolynomial ()
+    {
+      int kc = m_kc;
+      m_mu = 2*kc-1;
+      double H = m_tauold, fac = 1;
+      for (int kappa = 0; kappa <= m_mu; kappa++)
+        {
+          int jmin = kappa/2, q = kappa-1;
+          for (int j = jmin; j <= kc; j++)
+            {
+              if (kappa == 0)
+                {
+                  m_ext[j] = m_zmid[j];
+                  continue;
+                }
+              size_t m = m_nseq[j] / 2;
+              double scale = 1 / std::pow(2*H / m_nseq[j], q), binom = 1;
+              m_ext[j] = 0.0;
+              for (int i = 0; i <= q; i++)
+                {
+                  m_ext[j] += ((i % 2 ? -binom : binom) * scale) * m_fz[j][m+q-2*i-1];
+                  binom = binom * (q-i) / (i+1);
+                }
+            }
+          for (int l = 1; l <= kc-jmin; l++)
+            for (int j = kc; j >= jmin+l; j--)
+              {
+                double r = double(m_nseq[j]) / m_nseq[j-l];
+                m_ext[j] += (1.0 / (r*r-1)) * (m_ext[j] - m_ext[j-1]);
+              }
+          if (kappa > 0) fac *= H / kappa;
+          m_dens[kappa] = fac * m_ext[kc];
+        }
+
+      // g and g' at the ends from y and H f there, minus T
+      int p = m_mu+1;
+      for (int side = 0; side < 2; side++)
+        {
+          double s = side ? 0.5 : -0.5, sk = 1;
+          Vector<> & g = m_g[2*side];
+          Vector<> & dg = m_g[2*side+1];
+          g = side ? m_y1 : m_y0;
+          dg = H * (side ? m_f1 : m_f0);
+          for (int kappa = 0; kappa <= m_mu; kappa++)
+            {
+              g -= sk * m_dens[kappa];
+              if (kappa < m_mu)
+                dg -= ((kappa+1) * sk) * m_dens[kappa+1];
+              sk *= s;
+            }
+          g *= 1 / std::pow(s, p);
+          dg *= 1 / std::pow(s, p);
+          dg -= (p / s) * g;
+        }
+      m_havedense = true;
+    }
+  };
+
+} // namespace ASC_ode
+
+#endif // EXTRAPOLATION_HPP
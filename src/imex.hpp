@@ -0,0 +1,474 @@
+#ifndef IMEX_HPP
+#define IMEX_HPP
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+#include "timestepper.hpp"
+#include "explicitRK.hpp"
+#include "sparsematrix.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Additive Runge-Kutta tableau for y' = f_E(y) + f_I(y): an explicit
+    method (ae, be) for f_E and a diagonally implicit one (ai, bi) for f_I,
+    with common nodes c. The embedded weights bhate, bhati give the error estimate.
+  */
+  struct IMEXTableau
+  {
+    Matrix<> ae, ai;
+    Vector<> be, bi, bhate, bhati, c;
+    int order, embeddedOrder;
+
+    IMEXTableau (int stages, int _order, int _embeddedOrder)
+      : ae(stages, stages), ai(stages, stages), be(stages), bi(stages),
+        bhate(stages), bhati(stages), c(stages),
+        order(_order), embeddedOrder(_embeddedOrder)
+    {
+      ae = 0.0;
+      ai = 0.0;
+      be = 0.0;
+      bi = 0.0;
+      bhate = 0.0;
+      bhati = 0.0;
+      c = 0.0;
+    }
+
+    int stages() const { return c.size(); }
+  };
+
+
+  // ARS(2,2,2) of Ascher, Ruuth and Spiteri, L-stable implicit part, order 2.
+  // The embedded solution takes the slopes of the second stage, order 1.
+  inline IMEXTableau ARS222()
+  {
+    double g = 1 - 1/std::sqrt(2.0);
+    double d = 1 - 1/(2*g);
+    IMEXTableau t(3, 2, 1);
+    t.c(1) = g;  t.c(2) = 1;
+    t.ai(1,1) = g;
+    t.ai(2,1) = 1-g;  t.ai(2,2) = g;
+    t.ae(1,0) = g;
+    t.ae(2,0) = d;  t.ae(2,1) = 1-d;
+    t.bi(1) = 1-g;  t.bi(2) = g;
+    t.be(0) = d;  t.be(1) = 1-d;
+    t.bhati(1) = 1;
+    t.bhate(1) = 1;
+    return t;
+  }
+
+  // ARK4(3)6L[2]SA of Kennedy and Carpenter: stiffly accurate ESDIRK with
+  // gamma = 1/4 and an explicit method with the same weights, order 4, embedded order 3
+  inline IMEXTableau ARK436L()
+  {
+    IMEXTableau t(6, 4, 3);
+    t.c(1) = 0.5;  t.c(2) = 83.0/250;  t.c(3) = 31.0/50;  t.c(4) = 17.0/20;  t.c(5) = 1;
+
+    t.ai(1,0) = 0.25;
+    t.ai(2,0) = 8611.0/62500;  t.ai(2,1) = -1743.0/31250;
+    t.ai(3,0) = 5012029.0/34652500;  t.ai(3,1) = -654441.0/2922500;  t.ai(3,2) = 174375.0/388108;
+    t.ai(4,0) = 15267082809.0/155376265600;  t.ai(4,1) = -71443401.0/120774400;
+    t.ai(4,2) = 730878875.0/902184768;  t.ai(4,3) = 2285395.0/8070912;
+    t.ai(5,0) = 82889.0/524892;  t.ai(5,2) = 15625.0/83664;  t.ai(5,3) = 69875.0/102672;
+    t.ai(5,4) = -2260.0/8211;
+    for (int i = 1; i < 6; i++)
+      t.ai(i,i) = 0.25;
+
+    t.ae(1,0) = 0.5;
+    t.ae(2,0) = 13861.0/62500;  t.ae(2,1) = 6889.0/62500;
+    t.ae(3,0) = -116923316275.0/2393684061468;  t.ae(3,1) = -2731218467317.0/15368042101831;
+    t.ae(3,2) = 9408046702089.0/11113171139209;
+    t.ae(4,0) = -451086348788.0/2902428689909;  t.ae(4,1) = -2682348792572.0/7519795681897;
+    t.ae(4,2) = 12662868775082.0/11960479115383;  t.ae(4,3) = 3355817975965.0/11060851509271;
+    t.ae(5,0) = 647845179188.0/3216320057751;  t.ae(5,1) = 73281519250.0/8382639484533;
+    t.ae(5,2) = 552539513391.0/3454668386233;  t.ae(5,3) = 3354512671639.0/8306763924573;
+    t.ae(5,4) = 4040.0/17871;
+
+    for (int j = 0; j < 6; j++)
+      t.bi(j) = t.be(j) = t.ai(5,j);
+    t.bhati(0) = 4586570599.0/29645900160;  t.bhati(2) = 178811875.0/945068544;
+    t.bhati(3) = 814220225.0/1159782912;  t.bhati(4) = -3700637.0/11593932;
+    t.bhati(5) = 61727.0/225920;
+    t.bhate = t.bhati;
+    return t;
+  }
+
+
+  /*
+    Implicit-explicit additive Runge-Kutta stepper. The Newton systems
+    of the implicit stages contain only the stiff part f_I, with the matrix
+    I - tau a_ii J_I; f_E is evaluated once per stage.
+    J_I is evaluated at the start of a step and kept for up to
+    jacobianReuse().maxage steps, it is renewed when Newton fails.
+    The matrix is factored again when tau a_ii changes. With sparse = true
+    J_I comes from evaluateDerivSparse and is factored by SparseLU.
+    evaluations() counts evaluations of f_I, explicitEvaluations() those of f_E.
+    Large terms of f_E acting on stiff components (e.g. a source feeding
+    a stiff node) see only the stage order of the explicit method, the
+    accuracy then drops and the step sizes become small.
+  */
+  class IMEXRungeKutta : public AdaptiveTimeStepper
+  {
+    std::shared_ptr<NonlinearFunction> m_fi, m_fe;
+    IMEXTableau m_tab;
+    int m_stages;
+    size_t m_n;
+    bool m_sparse;
+
+    std::vector<bool> m_needke, m_needki;   // slopes that enter later stages or the weights
+    bool m_fsal;              // the last stage is the new solution
+
+    Vector<> m_ke, m_ki;      // all stage slopes of f_E and f_I
+    Vector<> m_z, m_ystage, m_yguess, m_res, m_ynew, m_err, m_y0, m_f0, m_f1, m_fe1, m_fi1;
+    bool m_haveke0 = false, m_haveki0 = false;  // slopes of the first stage at m_y0
+    bool m_havefe1 = false, m_havefi1 = false;  // f_E(m_ynew), f_I(m_ynew) are known
+    double m_tauold = 0;
+
+    // Newton matrix
+    Matrix<> m_jac;
+    DenseLU m_lu;
+    SparseMatrix m_matrix;    // I - h J_I, the first n triplets are the identity
+    SparseLU m_sparselu;
+    bool m_haveJacobian = false;
+    bool m_factored = false;
+    double m_h = 0;           // tau a_ii of the factored matrix
+    double m_hJ = 0;          // tau a_ii the sparse matrix is scaled with
+    double m_crate = 1;       // estimated Newton contraction rate
+
+    JacobianReuse m_reuse;    // age in steps since the Jacobian was evaluated
+    size_t m_jacobians = 0;
+    size_t m_explicitEvaluations = 0;
+
+  public:
+    IMEXRungeKutta (std::shared_ptr<AdditiveFunction> rhs, const IMEXTableau & tab,
+                    Tolerance tol = Tolerance(), bool sparse = false)
+      : AdaptiveTimeStepper(rhs, tol), m_fi(rhs->implicitPart()), m_fe(rhs->explicitPart()),
+        m_tab(tab), m_stages(tab.stages()), m_n(rhs->dimX()), m_sparse(sparse),
+        m_needke(m_stages, false), m_needki(m_stages, false),
+        m_ke(m_stages*m_n), m_ki(m_stages*m_n),
+        m_z(m_n), m_ystage(m_n), m_yguess(m_n), m_res(m_n), m_ynew(m_n), m_err(m_n), m_y0(m_n),
+        m_f0(m_n), m_f1(m_n), m_fe1(m_n), m_fi1(m_n),
+        m_jac(sparse ? 0 : m_n, sparse ? 0 : m_n), m_lu(sparse ? 0 : m_n)
+    {
+      int s = m_stages;
+      for (int i = 0; i < s; i++)
+        for (int j = i; j < s; j++)
+          if (m_tab.ae(i,j) != 0.0 || (j > i && m_tab.ai(i,j) != 0.0))
+            throw std::invalid_argument("IMEXRungeKutta: tableau is not diagonally implicit");
+
+      for (int j = 0; j < s; j++)
+        {
+          m_needke[j] = m_tab.be(j) != 0.0 || m_tab.bhate(j) != 0.0;
+          m_needki[j] = m_tab.bi(j) != 0.0 || m_tab.bhati(j) != 0.0;
+          for (int i = j+1; i < s; i++)
+            {
+              if (m_tab.ae(i,j) != 0.0) m_needke[j] = true;
+              if (m_tab.ai(i,j) != 0.0) m_needki[j] = true;
+            }
+        }
+
+      m_fsal = true;
+      for (int j = 0; j < s; j++)
+        if (m_tab.ae(s-1,j) != m_tab.be(j) || m_tab.ai(s-1,j) != m_tab.bi(j))
+          m_fsal = false;
+
+      m_ke = 0.0;
+      m_ki = 0.0;
+      if (m_sparse)
+        {
+          SparseMatrix pattern(m_n, m_n);
+          for (size_t i = 0; i < m_n; i++)
+            pattern.add(i, i, 1.0);
+          m_fi->sparsityPattern(pattern);
+          m_sparselu.analyze(pattern);
+        }
+    }
+
+    int order() const { return m_tab.order; }
+    int errorOrder() const override { return std::min(m_tab.order, m_tab.embeddedOrder) + 1; }
+
+    JacobianReuse & jacobianReuse() { return m_reuse; }
+    size_t jacobians() const { return m_jacobians; }
+    size_t explicitEvaluations() const { return m_explicitEvaluations; }
+
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      double err;
+      if (!Step(tau, y, err, false))
+        throw std::domain_error("IMEXRungeKutta: Newton did not converge");
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      return Step(tau, y, err, true);
+    }
+
+    // cubic Hermite interpolation, missing slopes at the end points are evaluated on demand
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      if (!m_haveke0)
+        {
+          m_fe->evaluate(m_y0, ke(0));
+          m_explicitEvaluations++;
+          m_haveke0 = true;
+        }
+      if (!m_haveki0)
+        {
+          m_fi->evaluate(m_y0, ki(0));
+          m_evaluations++;
+          m_haveki0 = true;
+        }
+      if (!m_havefe1)
+        {
+          m_fe->evaluate(m_ynew, m_fe1);
+          m_explicitEvaluations++;
+          m_havefe1 = true;
+        }
+      if (!m_havefi1)
+        {
+          m_fi->evaluate(m_ynew, m_fi1);
+          m_evaluations++;
+          m_havefi1 = true;
+        }
+      m_f0 = ke(0) + ki(0);
+      m_f1 = m_fe1 + m_fi1;
+      HermiteInterpolation(theta, m_tauold, m_y0, m_f0, m_ynew, m_f1, y);
+    }
+
+  private:
+    VectorView<double> ke (int j) { return m_ke.range(j*m_n, (j+1)*m_n); }
+    VectorView<double> ki (int j) { return m_ki.range(j*m_n, (j+1)*m_n); }
+
+    bool Step (double tau, VectorView<double> y, double & err, bool adaptive)
+    {
+      // the slopes at y are known at the end of the last step
+      bool known = (m_havefe1 || m_havefi1) && SameState(y, m_ynew);
+      // an explicit first stage keeps its slopes when a rejected step is retried
+      bool samepoint = m_tab.ai(0,0) == 0.0 && SameState(y, m_y0);
+      m_y0 = y;
+
+      if (!samepoint)
+        m_haveke0 = m_haveki0 = false;
+      if (!m_haveJacobian || m_reuse.age < 0 || m_reuse.age >= m_reuse.maxage)
+        EvaluateJacobian();
+
+      for (int i = 0; i < m_stages; i++)
+        {
+          double aii = m_tab.ai(i,i);
+          m_z = y;
+          for (int j = 0; j < i; j++)
+            {
+              if (m_tab.ae(i,j) != 0.0) m_z += (tau*m_tab.ae(i,j)) * ke(j);
+              if (m_tab.ai(i,j) != 0.0) m_z += (tau*m_tab.ai(i,j)) * ki(j);
+            }
+
+          if (aii == 0.0)
+            {
+              m_ystage = m_z;
+              EvaluateStage(i, known && i == 0);
+              continue;
+            }
+
+          // predictor from the slope of the previous stage
+          m_ystage = m_z;
+          if (i > 0)
+            m_ystage += (tau*aii) * ki(i-1);
+          if (!SolveStage(tau*aii))
+            {
+              m_havefe1 = m_havefi1 = false;
+              err = std::numeric_limits<double>::infinity();
+              return false;
+            }
+          // f_I(Y_i) from the stage equation, without amplifying the Newton error
+          ki(i) = (1/(tau*aii)) * (m_ystage - m_z);
+          if (m_needke[i] || (m_fsal && i == m_stages-1))
+            {
+              m_fe->evaluate(m_ystage, ke(i));
+              m_explicitEvaluations++;
+            }
+        }
+
+      m_ynew = y;
+      m_err = 0.0;
+      for (int j = 0; j < m_stages; j++)
+        {
+          if (m_tab.be(j) != 0.0) m_ynew += (tau*m_tab.be(j)) * ke(j);
+          if (m_tab.bi(j) != 0.0) m_ynew += (tau*m_tab.bi(j)) * ki(j);
+          double de = m_tab.be(j) - m_tab.bhate(j);
+          double di = m_tab.bi(j) - m_tab.bhati(j);
+          if (de != 0.0) m_err += (tau*de) * ke(j);
+          if (di != 0.0) m_err += (tau*di) * ki(j);
+        }
+      // filtered by the Newton matrix, as for Radau IIA, stiff components
+      // of the estimate would otherwise force tiny steps
+      if (m_factored)
+        {
+          if (m_sparse)
+            m_sparselu.solve(m_err);
+          else
+            m_lu.solve(m_err);
+        }
+      err = m_tol.errorNorm(m_err, y, m_ynew);
+      if (adaptive && !(err <= 1))
+        {
+          m_havefe1 = m_havefi1 = false;
+          return false;
+        }
+
+      m_tauold = tau;
+      m_reuse.age++;
+      // the last stage is y1, its slopes start the next step
+      m_havefe1 = m_havefi1 = m_fsal;
+      if (m_fsal)
+        {
+          m_fe1 = ke(m_stages-1);
+          m_fi1 = ki(m_stages-1);
+        }
+      y = m_ynew;
+      return true;
+    }
+
+    // slopes of an explicit stage at m_ystage, taken from the last step if known,
+    // the first stage ones also from a rejected attempt at the same point
+    void EvaluateStage (int i, bool known)
+    {
+      bool needke = m_needke[i], needki = m_needki[i];
+      bool keptke = false, keptki = false;
+      if (i == 0)
+        {
+          keptke = m_haveke0;
+          keptki = m_haveki0;
+          m_haveke0 = needke || (known && m_havefe1) || keptke;
+          m_haveki0 = needki || (known && m_havefi1) || keptki;
+          needke = m_haveke0 && !keptke;
+          needki = m_haveki0 && !keptki;
+        }
+      if (needke)
+        {
+          if (known && m_havefe1)
+            ke(i) = m_fe1;
+          else
+            {
+              m_fe->evaluate(m_ystage, ke(i));
+              m_explicitEvaluations++;
+            }
+        }
+      if (needki)
+        {
+          if (known && m_havefi1)
+            ki(i) = m_fi1;
+          else
+            {
+              m_fi->evaluate(m_ystage, ki(i));
+              m_evaluations++;
+            }
+        }
+      else if (!keptki)
+        ki(i) = 0.0;
+    }
+
+    // Y - z - h f_I(Y) = 0 for Y = m_ystage, z = m_z
+    bool SolveStage (double h)
+    {
+      bool fresh = m_reuse.age == 0;
+      if (!m_factored || h != m_h)
+        Factor(h);
+
+      for (int attempt = 0; attempt < 2; attempt++)
+        {
+          if (Newton(h))
+            return true;
+          if (fresh) break;
+          // an old Jacobian may be the reason
+          EvaluateJacobian();
+          Factor(h);
+          fresh = true;
+        }
+      return false;
+    }
+
+    bool Newton (double h)
+    {
+      const int maxit = 7;
+      const double tol = 0.05;      // relative to the error tolerance
+      double olddel = 0;
+      m_yguess = m_ystage;          // to restart from after a failure
+      for (int it = 0; it < maxit; it++)
+        {
+          m_fi->evaluate(m_ystage, m_res);
+          m_evaluations++;
+          m_res *= -h;
+          m_res += m_ystage;
+          m_res -= m_z;
+          if (m_sparse)
+            m_sparselu.solve(m_res);
+          else
+            m_lu.solve(m_res);
+          m_ystage -= m_res;
+          m_reuse.iterations++;
+
+          double del = m_tol.errorNorm(m_res, m_y0, m_ystage);
+          if (it > 0)
+            {
+              if (del > 2*olddel) break;     // diverges
+              m_crate = std::max(0.3*m_crate, del/olddel);
+            }
+          if (del * std::min(1.0, m_crate) <= tol)
+            return true;
+          olddel = del;
+        }
+      m_ystage = m_yguess;
+      return false;
+    }
+
+    // J_I at the start of the step
+    void EvaluateJacobian ()
+    {
+      if (m_sparse)
+        {
+          m_matrix.setSize(m_n, m_n);
+          for (size_t i = 0; i < m_n; i++)
+            m_matrix.add(i, i, 1.0);
+          m_fi->evaluateDerivSparse(m_y0, m_matrix);
+          m_matrix.scaleFrom(m_n, -1);
+          m_hJ = 1;
+        }
+      else
+        m_fi->evaluateDeriv(m_y0, m_jac);
+      m_haveJacobian = true;
+      m_reuse.age = 0;
+      m_jacobians++;
+      m_factored = false;
+    }
+
+    void Factor (double h)
+    {
+      if (m_sparse)
+        {
+          m_matrix.scaleFrom(m_n, h / m_hJ);
+          m_hJ = h;
+          m_sparselu.factor(m_matrix);
+        }
+      else
+        m_lu.refactor(m_n, [&](size_t i, size_t j)
+        { return (i == j ? 1.0 : 0.0) - h * m_jac(i,j); });
+      m_h = h;
+      m_factored = true;
+      m_crate = 1;
+      m_reuse.factorizations++;
+    }
+  };
+
+}
+
+#endif
@@ -5,10 +5,240 @@
 #include <matrix.hpp>
 #include <inverse.hpp>
 
+#include <limits>
+#include <memory>
+#include <complex>
+
+#include "timestepper.hpp"
+#include "eigen.hpp"
+
 namespace ASC_ode {
   using namespace nanoblas;
 
 
+  /*
+    Simplified Newton for the stage equations k - F(y + tau (A x I) k) = 0
+    with the Jacobian J = f'(y) at the beginning of the step.
+    With A^{-1} = T Lambda T^{-1} the (sn)x(sn) Newton matrix
+    I - tau A x J decouples into the n x n systems (lambda_e I - tau J),
+    one real for every real eigenvalue and one complex for every conjugate
+    pair (Hairer-Wanner, IV.8). The constructor throws std::domain_error
+    if A is singular or A^{-1} is not diagonalizable.
+  */
+  class TransformedStageSolver
+  {
+    using Complex = std::complex<double>;
+    size_t m_stages, m_n;
+    std::vector<Complex> m_lambda, m_t, m_tinv;      // s x s, row major
+    std::vector<size_t> m_real, m_pairs;             // indices of real eigenvalues / pairs
+    std::vector<DenseLU> m_realLU;
+    std::vector<ComplexLU> m_complexLU;
+    Matrix<double> m_jac;
+    Vector<double> m_res, m_wreal;
+    std::vector<Complex> m_w;                        // s x n transformed increments
+    JacobianReuse m_reuse;
+
+  public:
+    TransformedStageSolver (const Matrix<> & a, size_t n)
+      : m_stages(a.rows()), m_n(n), m_t(m_stages*m_stages), m_tinv(m_stages*m_stages),
+        m_jac(n, n), m_res(m_stages*n), m_wreal(n), m_w(m_stages*n)
+    {
+      size_t s = m_stages;
+      DenseLU lua(a);
+      Matrix<double> ainv(s, s);
+      std::vector<double> col(s);
+      for (size_t j = 0; j < s; j++)
+        {
+          std::fill(col.begin(), col.end(), 0.0);
+          col[j] = 1;
+          lua.solve(col);
+          for (size_t i = 0; i < s; i++)
+            ainv(i,j) = col[i];
+        }
+
+      EigenSystem eig(ainv);
+      for (size_t e = 0; e < s; e++)
+        {
+          m_lambda.push_back(eig.value(e));
+          for (size_t i = 0; i < s; i++)
+            m_t[i*s+e] = eig.vector(i,e);
+        }
+      ComplexLU lut(s);
+      lut.refactor(s, [&](size_t i, size_t j) { return m_t[i*s+j]; });
+      std::vector<Complex> ccol(s);
+      for (size_t j = 0; j < s; j++)
+        {
+          std::fill(ccol.begin(), ccol.end(), 0.0);
+          ccol[j] = 1;
+          lut.solve(ccol);
+          for (size_t i = 0; i < s; i++)
+            m_tinv[i*s+j] = ccol[i];
+        }
+
+      // repeated eigenvalues give (nearly) dependent eigenvectors
+      double defect = 0;
+      for (size_t i = 0; i < s; i++)
+        for (size_t j = 0; j < s; j++)
+          {
+            Complex sum = 0;
+            for (size_t e = 0; e < s; e++)
+              sum += m_t[i*s+e] * m_lambda[e] * m_tinv[e*s+j];
+            defect = std::max(defect, std::abs(sum - ainv(i,j)) / (1+std::fabs(ainv(i,j))));
+          }
+      if (!(defect < 1e-8))
+        throw std::domain_error("TransformedStageSolver: A^{-1} is not diagonalizable");
+
+      for (size_t e = 0; e < s; e++)
+        if (m_lambda[e].imag() == 0)
+          {
+            m_real.push_back(e);
+            m_realLU.emplace_back(n);
+          }
+        else
+          {
+            m_pairs.push_back(e);
+            m_complexLU.emplace_back(n);
+            e++;
+          }
+    }
+
+    JacobianReuse & jacobianReuse() { return m_reuse; }
+    Complex eigenvalue (size_t e) const { return m_lambda[e]; }
+    // n x n LU factorizations per Jacobian, one per real eigenvalue and per pair
+    size_t systems() const { return m_realLU.size() + m_complexLU.size(); }
+
+    // the Jacobian behind the current factors, evaluated at y if there are none
+    const Matrix<double> & jacobian (NonlinearFunction & rhs, VectorView<double> y, double tau)
+    {
+      if (m_reuse.age < 0 || !valid())
+        refresh(rhs, y, tau);
+      return m_jac;
+    }
+
+    // the first real eigenvalue of A^{-1}, 0 if there is none
+    double realEigenvalue () const { return m_real.empty() ? 0.0 : m_lambda[m_real[0]].real(); }
+
+    // v <- (lambda I - tau J)^{-1} v for lambda = realEigenvalue(),
+    // with the factors of the last solve or of jacobian()
+    void solveReal (VectorView<double> v) const { m_realLU[0].solve(v); }
+
+    // equ(k) is the stage residual, rhs is evaluated at y for the Jacobian
+    void solve (std::shared_ptr<NonlinearFunction> equ, NonlinearFunction & rhs,
+                VectorView<double> y, double tau, VectorView<double> k,
+                double tol = 1e-8, int maxsteps = 20)
+    {
+      size_t s = m_stages, n = m_n;
+
+      if (!m_reuse.simplified || m_reuse.age >= m_reuse.maxage || !valid())
+        m_reuse.invalidate();
+
+      double olddx = 0;
+      for (int it = 0; it < maxsteps; it++)
+        {
+          equ->evaluate(k, m_res);
+          double err = norm(m_res);
+          if (err < tol)
+            {
+              // converged without factors: there are none to age
+              if (m_reuse.age >= 0) m_reuse.age++;
+              return;
+            }
+          if (m_reuse.age < 0)
+            refresh(rhs, y, tau);
+
+          // w_e = (lambda_e - tau J)^{-1} lambda_e (T^{-1} x I) res,
+          // only the first member of a conjugate pair is needed
+          auto transform = [&](size_t e)
+          {
+            for (size_t l = 0; l < n; l++)
+              {
+                Complex sum = 0;
+                for (size_t i = 0; i < s; i++)
+                  sum += m_tinv[e*s+i] * m_res(i*n+l);
+                m_w[e*n+l] = m_lambda[e] * sum;
+              }
+          };
+          for (size_t r = 0; r < m_real.size(); r++)
+            {
+              size_t e = m_real[r];
+              transform(e);
+              for (size_t l = 0; l < n; l++)
+                m_wreal(l) = m_w[e*n+l].real();
+              m_realLU[r].solve(m_wreal);
+              for (size_t l = 0; l < n; l++)
+                m_w[e*n+l] = m_wreal(l);
+            }
+          for (size_t p = 0; p < m_pairs.size(); p++)
+            {
+              transform(m_pairs[p]);
+              m_complexLU[p].solve(&m_w[m_pairs[p]*n]);
+            }
+
+          // dk = (T x I) w, the conjugate of a pair contributes the conjugate
+          double dx2 = 0;
+          for (size_t i = 0; i < s; i++)
+            for (size_t l = 0; l < n; l++)
+              {
+                double dk = 0;
+                for (size_t e : m_real)
+                  dk += m_t[i*s+e].real() * m_w[e*n+l].real();
+                for (size_t e : m_pairs)
+                  dk += 2 * (m_t[i*s+e] * m_w[e*n+l]).real();
+                k(i*n+l) -= dk;
+                dx2 += dk*dk;
+              }
+          m_reuse.iterations++;
+
+          // a Jacobian from an earlier step is refreshed if convergence is slow
+          double newdx = std::sqrt(dx2);
+          if (it > 0 && newdx > m_reuse.maxcontraction * olddx && m_reuse.age > 0)
+            m_reuse.invalidate();
+          olddx = newdx;
+        }
+
+      m_reuse.invalidate();
+      throw std::domain_error("Newton did not converge");
+    }
+
+  private:
+    void refresh (NonlinearFunction & rhs, VectorView<double> y, double tau)
+    {
+      size_t n = m_n;
+      rhs.evaluateDeriv(y, m_jac);
+      for (size_t r = 0; r < m_real.size(); r++)
+        {
+          double lam = m_lambda[m_real[r]].real();
+          m_realLU[r].refactor(n, [&](size_t i, size_t j)
+          { return (i == j ? lam : 0.0) - tau*m_jac(i,j); });
+        }
+      for (size_t p = 0; p < m_pairs.size(); p++)
+        {
+          Complex lam = m_lambda[m_pairs[p]];
+          m_complexLU[p].refactor(n, [&](size_t i, size_t j)
+          { return (i == j ? lam : 0.0) - tau*m_jac(i,j); });
+        }
+      m_reuse.age = 0;
+      m_reuse.factorizations++;
+    }
+
+    bool valid() const
+    {
+      for (auto & lu : m_realLU) if (!lu.valid()) return false;
+      for (auto & lu : m_complexLU) if (!lu.valid()) return false;
+      return true;
+    }
+  };
+
+  /*
+    initial guess for the stage derivatives of an implicit Runge-Kutta step:
+      ZERO          k_j = 0
+      LAST_STAGE    k_j = last stage of the previous step
+      EXTRAPOLATED  the polynomial through the previous stages k_j(c_j),
+                    which is the derivative of the collocation polynomial,
+                    evaluated at the new stage times
+  */
+  enum class StagePredictor { ZERO, LAST_STAGE, EXTRAPOLATED };
+
 
   class ImplicitRungeKutta : public TimeStepper
   {
@@ -20,31 +250,176 @@ namespace ASC_ode {
     int m_stages;
     int m_n;
     Vector<> m_k, m_y;
+
+    StagePredictor m_predictor = StagePredictor::EXTRAPOLATED;
+    Vector<> m_kold;          // stages of the last solve
+    double m_tauold = 0;
+    double m_shift = 0;       // start of the next step relative to the last one
+    bool m_history = false;
+    size_t m_solves = 0, m_iterations = 0;
+
+    // dense output from the collocation polynomial, needs distinct nodes
+    DenseLU m_vandermonde;
+    Vector<> m_weights;
+    bool m_dense = false;
+
+    std::unique_ptr<TransformedStageSolver> m_transformed;
+    std::unique_ptr<NewtonSolverContext> m_newton;   // fallback for singular A
   public:
     ImplicitRungeKutta(std::shared_ptr<NonlinearFunction> rhs,
       const Matrix<> &a, const Vector<> &b, const Vector<> &c) 
     : TimeStepper(rhs), m_a(a), m_b(b), m_c(c),
     m_tau(std::make_shared<Parameter>(0.0)),
-    m_stages(c.size()), m_n(rhs->dimX()), m_k(m_stages*m_n), m_y(m_stages*m_n)
+    m_stages(c.size()), m_n(rhs->dimX()), m_k(m_stages*m_n), m_y(m_stages*m_n),
+    m_kold(m_stages*m_n), m_weights(m_stages)
     {
       auto multiple_rhs = make_shared<MultipleFunc>(rhs, m_stages);
       m_yold = std::make_shared<ConstantFunction>(m_stages*m_n);
       auto knew = std::make_shared<IdentityFunction>(m_stages*m_n);
       m_equ = knew - Compose(multiple_rhs, m_yold+m_tau*std::make_shared<MatVecFunc>(a, m_n));
+
+      try
+        {
+          m_transformed = std::make_unique<TransformedStageSolver>(m_a, m_n);
+        }
+      catch (std::domain_error &)
+        {
+          m_newton = std::make_unique<NewtonSolverContext>(m_stages*m_n, m_stages*m_n);
+        }
+
+      Matrix<> v(m_stages, m_stages);
+      for (int i = 0; i < m_stages; i++)
+        for (int j = 0; j < m_stages; j++)
+          v(i,j) = std::pow(m_c(j), i);
+      try
+        {
+          m_vandermonde.factor(v);
+          m_dense = true;
+        }
+      catch (std::domain_error &) { }
     }
 
     void DoStep(double tau, VectorView<double> y) override
+    {
+      SolveStages(tau, y);
+      for (int j = 0; j < m_stages; j++)
+        y += tau * m_b(j) * stage(j);
+      Advance();
+    }
+
+    // solves the stage equations for the stage derivatives k_j up to a
+    // residual norm tol, y is not changed
+    void SolveStages(double tau, VectorView<double> y, double tol = 1e-8)
     {
       for (int j = 0; j < m_stages; j++)
         m_y.range(j*m_n, (j+1)*m_n) = y;
       m_yold->set(m_y);
 
       m_tau->set(tau);
-      m_k = 0.0;  
-      NewtonSolver(m_equ, m_k);
+      jacobianReuse().setStepSize(tau);
+      Predict(tau);
+
+      size_t its = jacobianReuse().iterations;
+      m_history = false;
+      m_solves++;
+      try
+        {
+          if (m_transformed)
+            m_transformed->solve(m_equ, *m_rhs, y, tau, m_k, tol);
+          else
+            m_newton->solve(m_equ, m_k, tol);
+        }
+      catch (std::domain_error &)
+        {
+          m_iterations += jacobianReuse().iterations - its;
+          throw;
+        }
+      m_iterations += jacobianReuse().iterations - its;
+
+      m_kold = m_k;
+      m_tauold = tau;
+      m_shift = 0;
+      m_history = true;
+    }
+
+    // the step of the last SolveStages was taken, the next one starts at its end
+    void Advance() { m_shift = m_tauold; }
 
+    // y0 + tau sum_j int_0^theta L_j(s) ds k_j, with the Lagrange polynomials
+    // L_j of the nodes. For collocation methods (Gauss, Radau IIA) this is the
+    // collocation polynomial, continuous across steps.
+    bool hasDenseOutput() const override { return m_dense; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      if (!m_dense)
+        throw std::logic_error("ImplicitRungeKutta: dense output needs distinct nodes");
+      double p = theta;
+      for (int i = 0; i < m_stages; i++, p *= theta)
+        m_weights(i) = p / (i+1);
+      m_vandermonde.solve(m_weights);
+
+      y = m_y.range(0, m_n);
       for (int j = 0; j < m_stages; j++)
-        y += tau * m_b(j) * m_k.range(j*m_n, (j+1)*m_n);
+        y += (m_tauold*m_weights(j)) * m_kold.range(j*m_n, (j+1)*m_n);
+    }
+
+    void setPredictor (StagePredictor predictor) { m_predictor = predictor; }
+    StagePredictor predictor() const { return m_predictor; }
+
+    // Newton iterations per stage solve
+    size_t solves() const { return m_solves; }
+    double averageIterations() const { return m_solves ? double(m_iterations)/m_solves : 0.0; }
+
+    VectorView<double> stage(int j) { return m_k.range(j*m_n, (j+1)*m_n); }
+    int stages() const { return m_stages; }
+    const Matrix<> & a() const { return m_a; }
+    const Vector<> & b() const { return m_b; }
+    const Vector<> & c() const { return m_c; }
+
+    // false if A is singular and the full stage system is solved
+    bool transformed() const { return bool(m_transformed); }
+    TransformedStageSolver * transformedSolver() { return m_transformed.get(); }
+
+    JacobianReuse & jacobianReuse()
+    { return m_transformed ? m_transformed->jacobianReuse() : m_newton->jacobianReuse(); }
+
+  private:
+    void Predict (double tau)
+    {
+      StagePredictor predictor = m_history ? m_predictor : StagePredictor::ZERO;
+      if (predictor == StagePredictor::EXTRAPOLATED)
+        for (int i = 0; i < m_stages; i++)
+          for (int j = 0; j < i; j++)
+            if (m_c(i) == m_c(j))
+              predictor = StagePredictor::LAST_STAGE;   // no interpolation through equal nodes
+
+      switch (predictor)
+        {
+        case StagePredictor::ZERO:
+          m_k = 0.0;
+          break;
+        case StagePredictor::LAST_STAGE:
+          for (int i = 0; i < m_stages; i++)
+            stage(i) = m_kold.range((m_stages-1)*m_n, m_stages*m_n);
+          break;
+        case StagePredictor::EXTRAPOLATED:
+          for (int i = 0; i < m_stages; i++)
+            {
+              // new stage time in units of the last step
+              double theta = (m_shift + m_c(i)*tau) / m_tauold;
+              stage(i) = 0.0;
+              for (int j = 0; j < m_stages; j++)
+                {
+                  double lagrange = 1;
+                  for (int l = 0; l < m_stages; l++)
+                    if (l != j)
+                      lagrange *= (theta-m_c(l)) / (m_c(j)-m_c(l));
+                  stage(i) += lagrange * m_kold.range(j*m_n, (j+1)*m_n);
+                }
+            }
+          break;
+        }
     }
   };
 
@@ -95,7 +470,7 @@ void GaussLegendre(VectorView<> x, VectorView<> w)
         pp=n*(z*p1-p2)/(z*z-1.0);
         z1=z;
         z=z1-p1/pp;   // Newton’s method.
-      } while (abs(z-z1) > EPS);
+      } while (std::fabs(z-z1) > EPS);
       x[i]=xm-xl*z;      // Scale the root to the desired interval,
       x[n-1-i]=xm+xl*z;  //  and put in its symmetric counterpart.
       w[i]=2.0*xl/((1.0-z*z)*pp*pp);  // Compute the weight
@@ -124,7 +499,7 @@ void GaussJacobi (VectorView<> x, VectorView<> w, const double alf, const double
     } else if (i == 1) { // Initial guess for the second largest root.
       r1=(4.1+alf)/((1.0+alf)*(1.0+0.156*alf));
       r2=1.0+0.06*(n-8.0)*(1.0+0.12*alf)/n;
-      r3=1.0+0.012*bet*(1.0+0.25*abs(alf))/n;
+      r3=1.0+0.012*bet*(1.0+0.25*std::fabs(alf))/n;
       z -= (1.0-z)*r1*r2*r3;
     } else if (i == 2) { // Initial guess for the third largest root.
       r1=(1.67+0.28*alf)/(1.0+0.37*alf);
@@ -164,7 +539,7 @@ void GaussJacobi (VectorView<> x, VectorView<> w, const double alf, const double
       //  a standard relation involving also p2, the polynomial of one lower order.
       z1=z;
       z=z1-p1/pp; // Newton’s formula.
-      if (abs(z-z1) <= EPS) break;
+      if (std::fabs(z-z1) <= EPS) break;
     }
     if (its > MAXIT) throw("too many iterations in gaujac");
     x[i]=z;    // Store the root and the weight.
@@ -215,6 +590,12 @@ void GaussRadau (VectorView<> x, VectorView<> w)
 {
   GaussJacobi (x.range(0, x.size()-1),
                w.range(0, w.size()-1), 1, 0);
+  // GaussJacobi returns the largest root first
+  for (size_t i = 0; i < (x.size()-1)/2; i++)
+    {
+      std::swap (x(i), x(x.size()-2-i));
+      std::swap (w(i), w(w.size()-2-i));
+    }
   for (int i = 0; i < x.size()-1; i++)
     {
       x(i) = 0.5*(x(i)+1);
@@ -226,6 +607,173 @@ void GaussRadau (VectorView<> x, VectorView<> w)
     sum += w(i);
   w(x.size()-1) = 1-sum;
 }
+
+
+
+  /*
+    Radau IIA with s stages (order 2s-1) and step size control.
+    The error is estimated by the embedded solution of order s
+      yhat = y0 + tau (gamma0 f(y0) + sum bhat_j k_j),
+    filtered by (I - tau gamma0 J)^{-1} for stiff components
+    (Hairer-Wanner, IV.8). For odd s gamma0 is the inverse of the real
+    eigenvalue of A^{-1} and the filter uses the real factors of the stage
+    solver, for even s it is the geometric mean of the eigenvalues and the
+    filter factors the Jacobian of the stage solver once per factorization
+    there. The Newton iteration stops relative to the error tolerance.
+    A step whose Newton iteration or filter fails is rejected.
+  */
+  class RadauIIA : public AdaptiveTimeStepper
+  {
+    ImplicitRungeKutta m_irk;
+    int m_stages;
+    size_t m_n;
+    double m_gamma0;
+    Vector<> m_e;              // bhat - b
+    Vector<> m_f0, m_err, m_ynew;
+    Matrix<> m_jac;
+    DenseLU m_lu;              // I - tau gamma0 J for even s
+    size_t m_lufactorizations = 0;
+
+  public:
+    RadauIIA (std::shared_ptr<NonlinearFunction> rhs, int stages = 3, Tolerance tol = Tolerance())
+      : AdaptiveTimeStepper(rhs, tol), m_irk(makeStepper(rhs, stages)),
+        m_stages(stages), m_n(rhs->dimX()), m_e(stages),
+        m_f0(m_n), m_err(m_n), m_ynew(m_n), m_jac(m_n, m_n), m_lu(m_n)
+    {
+      int s = m_stages;
+      auto solver = m_irk.transformedSolver();
+      if (solver && solver->realEigenvalue() != 0)
+        m_gamma0 = 1 / solver->realEigenvalue();
+      else
+        m_gamma0 = std::pow(std::fabs(DenseLU(m_irk.a()).determinant()), -1.0/s);
+
+      // embedded weights: sum_j bhat_j c_j^k = 1/(k+1) - gamma0 delta_k0
+      Matrix<> v(s, s);
+      for (int k = 0; k < s; k++)
+        {
+          for (int j = 0; j < s; j++)
+            v(k,j) = std::pow(m_irk.c()(j), k);
+          m_e(k) = 1.0/(k+1);
+        }
+      m_e(0) -= m_gamma0;
+      DenseLU(v).solve(m_e);
+      m_e -= m_irk.b();
+
+      m_irk.jacobianReuse().simplified = true;
+    }
+
+    int order() const { return 2*m_stages-1; }
+    int errorOrder() const override { return m_stages+1; }
+    JacobianReuse & jacobianReuse() { return m_irk.jacobianReuse(); }
+    ImplicitRungeKutta & stepper() { return m_irk; }
+
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      m_irk.DoStep(tau, y);
+    }
+
+    bool hasDenseOutput() const override { return m_irk.hasDenseOutput(); }
+    void DenseOutput (double theta, VectorView<double> y) override { m_irk.DenseOutput(theta, y); }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      size_t its = m_irk.jacobianReuse().iterations;
+      bool converged = true;
+      try
+        {
+          m_irk.SolveStages(tau, y, NewtonTolerance(tau, y));
+        }
+      catch (std::domain_error &)
+        {
+          converged = false;
+        }
+      // every Newton residual evaluates the right hand side at all stages
+      m_evaluations += m_stages * (m_irk.jacobianReuse().iterations - its + 1);
+      if (!converged)
+        {
+          err = std::numeric_limits<double>::infinity();
+          return false;
+        }
+
+      m_ynew = y;
+      for (int j = 0; j < m_stages; j++)
+        m_ynew += (tau*m_irk.b()(j)) * m_irk.stage(j);
+
+      m_rhs->evaluate(y, m_f0);
+      m_evaluations++;
+      m_err = (tau*m_gamma0) * m_f0;
+      for (int j = 0; j < m_stages; j++)
+        m_err += (tau*m_e(j)) * m_irk.stage(j);
+      try
+        {
+          Filter(tau, y);
+        }
+      catch (std::domain_error &)
+        {
+          err = std::numeric_limits<double>::infinity();
+          return false;
+        }
+
+      err = m_tol.errorNorm(m_err, y, m_ynew);
+      if (!(err <= 1)) return false;
+      y = m_ynew;
+      m_irk.Advance();
+      return true;
+    }
+
+  private:
+    // the residual is in units of f and tau k is the increment of y:
+    // stop when tau |res| is 0.05 of the smallest component tolerance,
+    // in the RMS sense over the s n stage derivatives, as in IMEX
+    double NewtonTolerance (double tau, VectorView<double> y) const
+    {
+      const double kappa = 0.05;
+      double scale = std::numeric_limits<double>::infinity();
+      for (size_t i = 0; i < m_n; i++)
+        {
+          double sc = m_tol.atol(i) + m_tol.rtol(i) * std::fabs(y(i));
+          if (sc > 0) scale = std::min(scale, sc);
+        }
+      return kappa * scale * std::sqrt(double(m_stages*m_n)) / tau;
+    }
+
+    // m_err <- (I - tau gamma0 J)^{-1} m_err with the Jacobian of the stage solver
+    void Filter (double tau, VectorView<double> y)
+    {
+      auto solver = m_irk.transformedSolver();
+      if (solver && solver->realEigenvalue() != 0)
+        {
+          // gamma0 = 1/lambda: (I - tau gamma0 J)^{-1} = lambda (lambda I - tau J)^{-1}
+          solver->jacobian(*m_rhs, y, tau);
+          solver->solveReal(m_err);
+          m_err *= solver->realEigenvalue();
+          return;
+        }
+
+      const Matrix<> * jac = &m_jac;
+      if (solver)
+        jac = &solver->jacobian(*m_rhs, y, tau);
+      else
+        m_rhs->evaluateDeriv(y, m_jac);
+      size_t factorizations = m_irk.jacobianReuse().factorizations;
+      if (!solver || !m_lu.valid() || factorizations != m_lufactorizations)
+        {
+          m_lu.refactor(m_n, [&](size_t i, size_t j)
+          { return (i == j ? 1.0 : 0.0) - tau*m_gamma0*(*jac)(i,j); });
+          m_lufactorizations = factorizations;
+        }
+      m_lu.solve(m_err);
+    }
+
+    static ImplicitRungeKutta makeStepper (std::shared_ptr<NonlinearFunction> rhs, int stages)
+    {
+      Vector<> c(stages), w(stages);
+      GaussRadau(c, w);
+      auto [a, b] = ComputeABfromC(c);
+      return ImplicitRungeKutta(rhs, a, b, c);
+    }
+  };
+
 }
 
 #endif // IMPLICITRK_HPP
\ No newline at end of file
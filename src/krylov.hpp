@@ -0,0 +1,187 @@
+#ifndef KRYLOV_HPP
+#define KRYLOV_HPP
+
+#include <cmath>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+#include "nonlinfunc.hpp"
+
+namespace ASC_ode
+{
+
+  // approximate inverse M^{-1}, set up at the current Newton iterate
+  class Preconditioner
+  {
+  public:
+    virtual ~Preconditioner() = default;
+    virtual void setup (std::shared_ptr<NonlinearFunction> func, VectorView<double> x) { }
+    // r <- M^{-1} r
+    virtual void apply (VectorView<double> r) const = 0;
+  };
+
+
+  // inverse diagonal of the Jacobian, taken from the sparse Jacobian
+  class JacobiPreconditioner : public Preconditioner
+  {
+    std::vector<double> m_invdiag;
+    SparseMatrix m_jac;
+  public:
+    void setup (std::shared_ptr<NonlinearFunction> func, VectorView<double> x) override
+    {
+      m_jac.setSize(func->dimF(), func->dimX());
+      func->evaluateDerivSparse(x, m_jac);
+      m_jac.compress();
+
+      m_invdiag.assign(func->dimF(), 1.0);
+      for (size_t i = 0; i < m_jac.height(); i++)
+        for (size_t j = m_jac.firstInRow()[i]; j < m_jac.firstInRow()[i+1]; j++)
+          if (m_jac.colInd()[j] == i && m_jac.data()[j] != 0.0)
+            m_invdiag[i] = 1.0 / m_jac.data()[j];
+    }
+
+    void apply (VectorView<double> r) const override
+    {
+      for (size_t i = 0; i < r.size(); i++)
+        r(i) *= m_invdiag[i];
+    }
+  };
+
+
+  /*
+    Restarted GMRES with right preconditioning for A x = b.
+    A is given by its action matvec(v, Av), x is the initial guess
+    and is overwritten by the solution.
+    Iterates until ||b - A x|| < tol, returns the number of iterations.
+  */
+  inline int GMRES (std::function<void(VectorView<double>,VectorView<double>)> matvec,
+                    const Preconditioner * precond,
+                    VectorView<double> b, VectorView<double> x,
+                    double tol, int maxit = 200, int restart = 30)
+  {
+    size_t n = b.size();
+    int m = restart;
+    Matrix<> V(m+1, n);          // Krylov basis, one vector per row
+    Matrix<> Z(m, n);            // preconditioned basis vectors
+    Matrix<> H(m+1, m);
+    std::vector<double> cs(m), sn(m), g(m+1), y(m);
+    Vector<> r(n), w(n);
+
+    int its = 0;
+    while (true)
+      {
+        matvec(x, w);
+        r = b - w;
+        double beta = norm(r);
+        if (beta < tol || its >= maxit) return its;
+
+        V.row(0) = (1/beta) * r;
+        std::fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+
+        int k = 0;
+        for ( ; k < m && its < maxit; k++, its++)
+          {
+            Z.row(k) = V.row(k);
+            if (precond) precond->apply(Z.row(k));
+            matvec(Z.row(k), w);
+
+            // modified Gram-Schmidt
+            for (int i = 0; i <= k; i++)
+              {
+                double h = 0;
+                for (size_t l = 0; l < n; l++)
+                  h += w(l) * V(i,l);
+                H(i,k) = h;
+                w -= h * V.row(i);
+              }
+            H(k+1,k) = norm(w);
+            if (H(k+1,k) != 0.0)
+              V.row(k+1) = (1/H(k+1,k)) * w;
+
+            // apply the previous Givens rotations and compute a new one
+            for (int i = 0; i < k; i++)
+              {
+                double tmp = cs[i]*H(i,k) + sn[i]*H(i+1,k);
+                H(i+1,k) = -sn[i]*H(i,k) + cs[i]*H(i+1,k);
+                H(i,k) = tmp;
+              }
+            double rho = std::hypot(H(k,k), H(k+1,k));
+            cs[k] = H(k,k) / rho;
+            sn[k] = H(k+1,k) / rho;
+            H(k,k) = rho;
+            H(k+1,k) = 0.0;
+            g[k+1] = -sn[k]*g[k];
+            g[k] = cs[k]*g[k];
+
+            if (std::fabs(g[k+1]) < tol)
+              {
+                k++; its++;
+                break;
+              }
+          }
+
+        // x += Z y, with H y = g
+        for (int i = k; i-- > 0; )
+          {
+            double sum = g[i];
+            for (int j = i+1; j < k; j++)
+              sum -= H(i,j) * y[j];
+            y[i] = sum / H(i,i);
+          }
+        for (int i = 0; i < k; i++)
+          x += y[i] * Z.row(i);
+      }
+  }
+
+
+  /*
+    Inexact Newton-Krylov method: the Newton systems are solved by GMRES
+    using only Jacobian-vector products, up to a relative accuracy eta
+    chosen by the Eisenstat-Walker rule.
+  */
+  inline void NewtonKrylovSolver (std::shared_ptr<NonlinearFunction> func, VectorView<double> x,
+                                  double tol = 1e-8, int maxsteps = 50,
+                                  std::shared_ptr<Preconditioner> precond = nullptr,
+                                  int restart = 30)
+  {
+    Vector<double> res(func->dimF());
+    Vector<double> dx(func->dimX());
+
+    // res = f(x) is known during the linear solve, a difference
+    // quotient then costs one evaluation per product
+    auto matvec = [&](VectorView<double> v, VectorView<double> Jv)
+    {
+      func->evaluateJacVec(x, res, v, Jv);
+    };
+
+    double eta = 0.5;
+    double olderr = 0;
+    for (int i = 0; i < maxsteps; i++)
+      {
+        func->evaluate(x, res);
+        double err = norm(res);
+        if (err < tol) return;
+
+        if (i > 0)
+          {
+            // Eisenstat-Walker, choice 2, with safeguard
+            double etanew = 0.9 * (err/olderr) * (err/olderr);
+            if (0.9*eta*eta > 0.1) etanew = std::max(etanew, 0.9*eta*eta);
+            eta = std::min(etanew, 0.9);
+          }
+        olderr = err;
+
+        if (precond) precond->setup(func, x);
+        dx = 0.0;
+        GMRES (matvec, precond.get(), res, dx, std::max(eta*err, 0.5*tol), 10*restart, restart);
+        x -= dx;
+      }
+
+    throw std::domain_error("Newton-Krylov did not converge");
+  }
+
+}
+
+#endif
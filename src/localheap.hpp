@@ -0,0 +1,81 @@
+#ifndef LOCALHEAP_HPP
+#define LOCALHEAP_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace ASC_ode
+{
+
+  /*
+    Bump allocator for temporaries of function evaluations.
+    Memory is taken from a list of blocks and given back in stack order
+    by HeapReset. Blocks are kept, so once the largest evaluation has
+    been seen no more heap allocations happen.
+  */
+  class LocalHeap
+  {
+    struct Block
+    {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;   // current block
+    size_t m_pos = 0;     // first free byte in the current block
+
+  public:
+    struct Mark { size_t block, pos; };
+
+    Mark mark() const { return { m_block, m_pos }; }
+    void reset (Mark m) { m_block = m.block; m_pos = m.pos; }
+
+    template <typename T = double>
+    T * alloc (size_t n)
+    {
+      size_t bytes = n * sizeof(T);
+      size_t align = alignof(std::max_align_t);
+      size_t pos = (m_pos + align-1) / align * align;
+
+      if (m_block >= m_blocks.size() || pos + bytes > m_blocks[m_block].size)
+        {
+          // use the next block which is large enough, or append a new one
+          if (m_block < m_blocks.size()) m_block++;
+          while (m_block < m_blocks.size() && m_blocks[m_block].size < bytes)
+            m_block++;
+          if (m_block == m_blocks.size())
+            {
+              size_t size = std::max(bytes, m_blocks.empty() ? size_t(1<<16) : 2*m_blocks.back().size);
+              m_blocks.push_back( { std::make_unique<char[]>(size), size } );
+            }
+          pos = 0;
+        }
+      m_pos = pos + bytes;
+      return reinterpret_cast<T*> (m_blocks[m_block].data.get() + pos);
+    }
+  };
+
+
+  // one heap per thread, evaluations in different threads do not interfere
+  inline LocalHeap & threadLocalHeap()
+  {
+    thread_local LocalHeap lh;
+    return lh;
+  }
+
+
+  // releases all allocations made during its lifetime
+  class HeapReset
+  {
+    LocalHeap & m_lh;
+    LocalHeap::Mark m_mark;
+  public:
+    HeapReset (LocalHeap & lh) : m_lh(lh), m_mark(lh.mark()) { }
+    ~HeapReset() { m_lh.reset(m_mark); }
+  };
+
+}
+
+#endif
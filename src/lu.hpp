@@ -0,0 +1,159 @@
+#ifndef LU_HPP
+#define LU_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <stdexcept>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Dense LU factorization with partial pivoting, P A = L U.
+    The factors are kept, so one factorization can serve many solves.
+    refactor() reuses the memory of the previous factorization.
+    T is double or std::complex<double>.
+  */
+  template <typename T>
+  class LUFactorization
+  {
+    std::vector<T> m_lu;          // row major, L below and U on and above the diagonal
+    std::vector<size_t> m_pivot;
+    size_t m_n = 0;
+    bool m_valid = false;
+
+  public:
+    LUFactorization () = default;
+
+    template <typename MAT> requires requires (const MAT & a) { a.rows(); }
+    LUFactorization (const MAT & a) { factor(a); }
+
+    // reserve memory for matrices of size n
+    LUFactorization (size_t n) : m_lu(n*n), m_pivot(n), m_n(n) { }
+
+    size_t size() const { return m_n; }
+
+    // matrices of size n from now on, allocates only beyond the largest size so far
+    void resize (size_t n)
+    {
+      m_n = n;
+      m_lu.resize(n*n);
+      m_pivot.resize(n);
+      m_valid = false;
+    }
+    bool valid() const { return m_valid; }
+    void invalidate() { m_valid = false; }
+
+    template <typename MAT>
+    void factor (const MAT & a)
+    {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("DenseLU: matrix must be square");
+      if (a.rows() != m_n)
+        {
+          m_n = a.rows();
+          m_lu.resize(m_n*m_n);
+          m_pivot.resize(m_n);
+        }
+      refactor(a);
+    }
+
+    // factor a matrix of the same size as before, without allocation
+    template <typename MAT>
+    void refactor (const MAT & a)
+    {
+      if (a.rows() != m_n || a.cols() != m_n)
+        throw std::invalid_argument("DenseLU: refactor needs a matrix of the factored size");
+      refactor(m_n, [&a](size_t i, size_t j) -> T { return a(i,j); });
+    }
+
+    // factor the n x n matrix with entries entry(i,j)
+    template <typename ENTRY>
+    void refactor (size_t n, ENTRY entry)
+    {
+      if (n != m_n)
+        throw std::invalid_argument("DenseLU: refactor needs a matrix of the factored size");
+      m_valid = false;
+      auto lu = [this](size_t i, size_t j) -> T & { return m_lu[i*m_n+j]; };
+      for (size_t i = 0; i < m_n; i++)
+        for (size_t j = 0; j < m_n; j++)
+          lu(i,j) = entry(i,j);
+
+      for (size_t k = 0; k < m_n; k++)
+        {
+          size_t piv = k;
+          double maxval = std::abs(lu(k,k));
+          for (size_t i = k+1; i < m_n; i++)
+            if (std::abs(lu(i,k)) > maxval)
+              {
+                maxval = std::abs(lu(i,k));
+                piv = i;
+              }
+          if (maxval == 0.0)
+            throw std::domain_error("DenseLU: matrix is singular");
+
+          m_pivot[k] = piv;
+          if (piv != k)
+            for (size_t j = 0; j < m_n; j++)
+              std::swap(lu(k,j), lu(piv,j));
+
+          T inv = T(1.0) / lu(k,k);
+          for (size_t i = k+1; i < m_n; i++)
+            {
+              T fac = (lu(i,k) *= inv);
+              if (fac == T(0.0)) continue;
+              for (size_t j = k+1; j < m_n; j++)
+                lu(i,j) -= fac * lu(k,j);
+            }
+        }
+      m_valid = true;
+    }
+
+    T determinant () const
+    {
+      T det = 1;
+      for (size_t k = 0; k < m_n; k++)
+        det *= (m_pivot[k] != k) ? -m_lu[k*m_n+k] : m_lu[k*m_n+k];
+      return det;
+    }
+
+    // overwrites the right hand side by the solution of A x = b,
+    // b is a VectorView or a std::vector
+    template <typename VEC>
+    void solve (VEC && b) const
+    {
+      auto lu = [this](size_t i, size_t j) { return m_lu[i*m_n+j]; };
+      for (size_t k = 0; k < m_n; k++)
+        if (m_pivot[k] != k)
+          std::swap(b[k], b[m_pivot[k]]);
+
+      for (size_t i = 1; i < m_n; i++)
+        {
+          T sum = b[i];
+          for (size_t j = 0; j < i; j++)
+            sum -= lu(i,j) * b[j];
+          b[i] = sum;
+        }
+
+      for (size_t i = m_n; i-- > 0; )
+        {
+          T sum = b[i];
+          for (size_t j = i+1; j < m_n; j++)
+            sum -= lu(i,j) * b[j];
+          b[i] = sum / lu(i,i);
+        }
+    }
+  };
+
+  using DenseLU = LUFactorization<double>;
+  using ComplexLU = LUFactorization<std::complex<double>>;
+
+}
+
+#endif
@@ -2,15 +2,76 @@
 #define NONLINFUNC_H
 
 #include <cstddef>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 
 #include <vector.hpp>
 #include <matrix.hpp>
 
+#include "sparsematrix.hpp"
+#include "localheap.hpp"
+
 namespace ASC_ode
 {
   using namespace nanoblas;
 
+  /*
+    Structure of a Jacobian, known without evaluating it.
+    IDENTITY and KRONECKER (kron (x) I_blocksize) have a constant pattern
+    and carry a scale factor read at run time. For DIAGONAL, BLOCKDIAGONAL
+    and GENERAL the values come from evaluateDeriv / evaluateDerivDiag.
+  */
+  struct JacobianStructure
+  {
+    enum Type { ZERO, IDENTITY, DIAGONAL, KRONECKER, BLOCKDIAGONAL, GENERAL };
+    Type type = GENERAL;
+    double scale = 1;
+    size_t blocks = 1;                       // BLOCKDIAGONAL: number of blocks
+    size_t blocksize = 1;                    // KRONECKER: size of the identity factor
+    const Matrix<double> * kron = nullptr;   // KRONECKER: the small factor
+
+    bool isDiagonal() const { return type == ZERO || type == IDENTITY || type == DIAGONAL; }
+
+    JacobianStructure scaled (double fac) const
+    {
+      JacobianStructure s = *this;
+      s.scale *= fac;
+      return s;
+    }
+
+    // structure of faca*A + facb*B
+    static JacobianStructure sum (JacobianStructure a, double faca,
+                                  JacobianStructure b, double facb)
+    {
+      if (b.type == ZERO) return a.scaled(faca);
+      if (a.type == ZERO) return b.scaled(facb);
+      if (a.type == IDENTITY && b.type == IDENTITY)
+        return { IDENTITY, faca*a.scale + facb*b.scale };
+      if (a.isDiagonal() && b.isDiagonal())
+        return { DIAGONAL };
+      if (a.type == BLOCKDIAGONAL && (b.isDiagonal() || (b.type == BLOCKDIAGONAL && b.blocks == a.blocks)))
+        return { BLOCKDIAGONAL, 1, a.blocks };
+      if (b.type == BLOCKDIAGONAL && a.isDiagonal())
+        return { BLOCKDIAGONAL, 1, b.blocks };
+      return { GENERAL };
+    }
+
+    // structure of A*B
+    static JacobianStructure product (JacobianStructure a, JacobianStructure b)
+    {
+      if (a.type == ZERO || b.type == ZERO) return { ZERO };
+      if (a.type == IDENTITY) return b.scaled(a.scale);
+      if (b.type == IDENTITY) return a.scaled(b.scale);
+      if (a.isDiagonal() && b.isDiagonal()) return { DIAGONAL };
+      if (a.type == BLOCKDIAGONAL && b.type == DIAGONAL) return a;
+      if (b.type == BLOCKDIAGONAL && a.type == DIAGONAL) return b;
+      return { GENERAL };
+    }
+  };
+
+
   class NonlinearFunction
   {
   public:
@@ -19,6 +80,99 @@ namespace ASC_ode
     virtual size_t dimF() const = 0;
     virtual void evaluate (VectorView<double> x, VectorView<double> f) const = 0;
     virtual void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const = 0;
+
+    // value and Jacobian at the same point. Functions sharing intermediate
+    // results between evaluate and evaluateDeriv should override it.
+    virtual void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                                    MatrixView<double> df) const
+    {
+      evaluate(x, f);
+      evaluateDeriv(x, df);
+    }
+
+    // Structure of the Jacobian, used by the combinators to avoid
+    // dense products and sums. Functions overriding it with DIAGONAL
+    // should also provide evaluateDerivDiag.
+    virtual JacobianStructure derivStructure() const { return { JacobianStructure::GENERAL }; }
+
+    // diagonal of the Jacobian, the default goes through the dense Jacobian
+    virtual void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      MatrixView<double> dense(dimF(), dimX(), dimX(), lh.alloc(dimF()*dimX()));
+      evaluateDeriv(x, dense);
+      for (size_t i = 0; i < d.size(); i++)
+        d(i) = dense(i,i);
+    }
+
+    // Sparse Jacobian: the entries are added as triplets to df.
+    // The defaults go through the dense Jacobian, functions with
+    // few non-zeros should override both.
+    virtual void sparsityPattern (SparseMatrix & pattern) const
+    {
+      for (size_t i = 0; i < dimF(); i++)
+        for (size_t j = 0; j < dimX(); j++)
+          pattern.add(i, j, 1.0);
+    }
+
+    virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const
+    {
+      Matrix<double> dense(dimF(), dimX());
+      evaluateDeriv(x, dense);
+      for (size_t i = 0; i < dimF(); i++)
+        for (size_t j = 0; j < dimX(); j++)
+          if (dense(i,j) != 0.0)
+            df.add(i, j, dense(i,j));
+    }
+
+    // Jacobian-vector product Jv = df(x) v without forming the Jacobian.
+    // The default is a forward difference quotient.
+    virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                                 VectorView<double> Jv) const
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> fx(dimF(), lh.alloc(dimF()));
+      evaluate(x, fx);
+      differenceJacVec(x, fx, v, Jv);
+    }
+
+    // true if evaluateJacVec does not difference f, functions overriding
+    // it by an exact product should override this as well
+    virtual bool exactJacVec() const { return false; }
+
+    // forward difference quotient with the known value fx = f(x), saves
+    // the evaluation at x when many products at the same x are needed
+    void differenceJacVec (VectorView<double> x, VectorView<double> fx,
+                           VectorView<double> v, VectorView<double> Jv) const
+    {
+      double nv = norm(v);
+      if (nv == 0.0)
+        {
+          Jv = 0.0;
+          return;
+        }
+      double h = std::sqrt(std::numeric_limits<double>::epsilon()) * (1+norm(x)) / nv;
+
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> xh(dimX(), lh.alloc(dimX()));
+      VectorView<double> fh(dimF(), lh.alloc(dimF()));
+      xh = x + h*v;
+      evaluate(xh, fh);
+      Jv = (1/h) * (fh - fx);
+    }
+
+    // Jv = df(x) v, exact if available, else by differences with fx = f(x)
+    void evaluateJacVec (VectorView<double> x, VectorView<double> fx,
+                         VectorView<double> v, VectorView<double> Jv) const
+    {
+      if (exactJacVec())
+        evaluateJacVec(x, v, Jv);
+      else
+        differenceJacVec(x, fx, v, Jv);
+    }
   };
 
 
@@ -39,6 +193,31 @@ namespace ASC_ode
       df = 0.0;
       df.diag() = 1.0;
     }
+
+    JacobianStructure derivStructure() const override { return { JacobianStructure::IDENTITY }; }
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      d = 1.0;
+    }
+
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      for (size_t i = 0; i < m_n; i++)
+        pattern.add(i, i, 1.0);
+    }
+
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      for (size_t i = 0; i < m_n; i++)
+        df.add(i, i, 1.0);
+    }
+
+    bool exactJacVec() const override { return true; }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      Jv = v;
+    }
   };
 
 
@@ -61,6 +240,19 @@ namespace ASC_ode
     {
       df = 0.0;
     }
+    JacobianStructure derivStructure() const override { return { JacobianStructure::ZERO }; }
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      d = 0.0;
+    }
+    void sparsityPattern (SparseMatrix & pattern) const override { }
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override { }
+    bool exactJacVec() const override { return true; }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      Jv = 0.0;
+    }
   };
 
   
@@ -75,24 +267,146 @@ namespace ASC_ode
                  double faca, double facb)
       : m_fa(fa), m_fb(fb), m_faca(faca), m_facb(facb) { }
 
+    auto fa() const { return m_fa; }
+    auto fb() const { return m_fb; }
+    double faca() const { return m_faca; }
+    double facb() const { return m_facb; }
+
     size_t dimX() const override { return m_fa->dimX(); }
     size_t dimF() const override { return m_fa->dimF(); }
     void evaluate (VectorView<double> x, VectorView<double> f) const override
     {
       m_fa->evaluate(x, f);
       f *= m_faca;
-      Vector<> tmp(dimF());
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(dimF(), lh.alloc(dimF()));
       m_fb->evaluate(x, tmp);
       f += m_facb*tmp;
     }
     void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
     {
+      auto sa = m_fa->derivStructure();
+      auto sb = m_fb->derivStructure();
+      // evaluate the general part into df, add the diagonal part on the diagonal
+      if (sa.isDiagonal() && !sb.isDiagonal())
+        {
+          m_fb->evaluateDeriv(x, df);
+          df *= m_facb;
+          addDiagonal(m_fa, sa, m_faca, x, df);
+          return;
+        }
+
       m_fa->evaluateDeriv(x, df);
       df *= m_faca;
-      Matrix<double> tmp(dimF(), dimX());
+      if (sb.isDiagonal())
+        {
+          addDiagonal(m_fb, sb, m_facb, x, df);
+          return;
+        }
+
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      MatrixView<double> tmp(dimF(), dimX(), dimX(), lh.alloc(dimF()*dimX()));
       m_fb->evaluateDeriv(x, tmp);
       df += m_facb*tmp;
     }
+    void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                            MatrixView<double> df) const override
+    {
+      auto sa = m_fa->derivStructure();
+      auto sb = m_fb->derivStructure();
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(dimF(), lh.alloc(dimF()));
+
+      if (sa.isDiagonal() && !sb.isDiagonal())
+        {
+          m_fb->evaluateWithDeriv(x, tmp, df);
+          df *= m_facb;
+          addDiagonal(m_fa, sa, m_faca, x, df);
+          m_fa->evaluate(x, f);
+          f *= m_faca;
+          f += m_facb*tmp;
+          return;
+        }
+
+      m_fa->evaluateWithDeriv(x, f, df);
+      f *= m_faca;
+      df *= m_faca;
+      if (sb.isDiagonal())
+        {
+          m_fb->evaluate(x, tmp);
+          addDiagonal(m_fb, sb, m_facb, x, df);
+        }
+      else
+        {
+          MatrixView<double> jac(dimF(), dimX(), dimX(), lh.alloc(dimF()*dimX()));
+          m_fb->evaluateWithDeriv(x, tmp, jac);
+          df += m_facb*jac;
+        }
+      f += m_facb*tmp;
+    }
+    JacobianStructure derivStructure() const override
+    {
+      return JacobianStructure::sum(m_fa->derivStructure(), m_faca,
+                                    m_fb->derivStructure(), m_facb);
+    }
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      m_fa->evaluateDerivDiag(x, d);
+      d *= m_faca;
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(d.size(), lh.alloc(d.size()));
+      m_fb->evaluateDerivDiag(x, tmp);
+      d += m_facb*tmp;
+    }
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      m_fa->sparsityPattern(pattern);
+      m_fb->sparsityPattern(pattern);
+    }
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      size_t first = df.numTriplets();
+      m_fa->evaluateDerivSparse(x, df);
+      df.scaleFrom(first, m_faca);
+      first = df.numTriplets();
+      m_fb->evaluateDerivSparse(x, df);
+      df.scaleFrom(first, m_facb);
+    }
+    bool exactJacVec() const override { return m_fa->exactJacVec() && m_fb->exactJacVec(); }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      m_fa->evaluateJacVec(x, v, Jv);
+      Jv *= m_faca;
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(dimF(), lh.alloc(dimF()));
+      m_fb->evaluateJacVec(x, v, tmp);
+      Jv += m_facb*tmp;
+    }
+
+  private:
+    // df += fac * df(x), for a function with diagonal Jacobian
+    static void addDiagonal (const std::shared_ptr<NonlinearFunction> & f, JacobianStructure s,
+                             double fac, VectorView<double> x, MatrixView<double> df)
+    {
+      if (s.type == JacobianStructure::ZERO) return;
+      if (s.type == JacobianStructure::IDENTITY)
+        {
+          for (size_t i = 0; i < df.rows(); i++)
+            df(i,i) += fac*s.scale;
+          return;
+        }
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> d(f->dimF(), lh.alloc(f->dimF()));
+      f->evaluateDerivDiag(x, d);
+      df.diag() += fac*d;
+    }
   };
 
 
@@ -106,6 +420,31 @@ namespace ASC_ode
     return std::make_shared<SumFunction>(fa, fb, 1, 1);
   }
 
+
+  // the part of a split right hand side f = f_I + f_E a function evaluates
+  enum class SplitPart { ALL, IMPLICIT, EXPLICIT };
+
+  /*
+    Right hand side split into a stiff part f_I, treated implicitly by
+    IMEX methods, and a non-stiff part f_E, treated explicitly.
+    As a function it is the sum, so every other stepper can use it as well.
+  */
+  class AdditiveFunction : public SumFunction
+  {
+  public:
+    AdditiveFunction (std::shared_ptr<NonlinearFunction> implicitPart,
+                      std::shared_ptr<NonlinearFunction> explicitPart)
+      : SumFunction(implicitPart, explicitPart, 1, 1)
+    {
+      if (implicitPart->dimX() != explicitPart->dimX() ||
+          implicitPart->dimF() != explicitPart->dimF())
+        throw std::invalid_argument("AdditiveFunction: parts of different size");
+    }
+
+    auto implicitPart() const { return fa(); }
+    auto explicitPart() const { return fb(); }
+  };
+
   class Parameter 
   {
     double m_value;
@@ -124,6 +463,9 @@ namespace ASC_ode
                    std::shared_ptr<Parameter> fac)
       : m_fa(fa), m_fac(fac) { }
 
+    auto fa() const { return m_fa; }
+    auto parameter() const { return m_fac; }
+
     size_t dimX() const override { return m_fa->dimX(); }
     size_t dimF() const override { return m_fa->dimF(); }
     void evaluate (VectorView<double> x, VectorView<double> f) const override
@@ -137,6 +479,45 @@ namespace ASC_ode
       m_fa->evaluateDeriv(x, df);
       df *= m_fac->get();
     }
+
+    void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                            MatrixView<double> df) const override
+    {
+      m_fa->evaluateWithDeriv(x, f, df);
+      f *= m_fac->get();
+      df *= m_fac->get();
+    }
+
+    JacobianStructure derivStructure() const override
+    {
+      return m_fa->derivStructure().scaled(m_fac->get());
+    }
+
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      m_fa->evaluateDerivDiag(x, d);
+      d *= m_fac->get();
+    }
+
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      m_fa->sparsityPattern(pattern);
+    }
+
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      size_t first = df.numTriplets();
+      m_fa->evaluateDerivSparse(x, df);
+      df.scaleFrom(first, m_fac->get());
+    }
+
+    bool exactJacVec() const override { return m_fa->exactJacVec(); }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      m_fa->evaluateJacVec(x, v, Jv);
+      Jv *= m_fac->get();
+    }
   };
 
   inline auto operator* (std::shared_ptr<Parameter> parama, 
@@ -162,24 +543,189 @@ namespace ASC_ode
                      std::shared_ptr<NonlinearFunction> fb)
       : m_fa(fa), m_fb(fb) { }
 
+    auto fa() const { return m_fa; }
+    auto fb() const { return m_fb; }
+
     size_t dimX() const override { return m_fb->dimX(); }
     size_t dimF() const override { return m_fa->dimF(); }
     void evaluate (VectorView<double> x, VectorView<double> f) const override
     {
-      Vector<> tmp(m_fb->dimF());
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(m_fb->dimF(), lh.alloc(m_fb->dimF()));
       m_fb->evaluate (x, tmp);
       m_fa->evaluate (tmp, f);
     }
     void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
     {
-      Vector<> tmp(m_fb->dimF());
+      derivImpl (x, nullptr, df);
+    }
+
+    // the inner function is evaluated once for the value and the Jacobian
+    void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                            MatrixView<double> df) const override
+    {
+      derivImpl (x, &f, df);
+    }
+
+    JacobianStructure derivStructure() const override
+    {
+      return JacobianStructure::product(m_fa->derivStructure(), m_fb->derivStructure());
+    }
+
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      if (!m_fa->derivStructure().isDiagonal() || !m_fb->derivStructure().isDiagonal())
+        {
+          NonlinearFunction::evaluateDerivDiag(x, d);
+          return;
+        }
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+      VectorView<double> db(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+      m_fb->evaluate (x, tmp);
+      m_fb->evaluateDerivDiag (x, db);
+      m_fa->evaluateDerivDiag (tmp, d);
+      for (size_t i = 0; i < d.size(); i++)
+        d(i) *= db(i);
+    }
+
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      SparseMatrix pata(m_fa->dimF(), m_fa->dimX());
+      SparseMatrix patb(m_fb->dimF(), m_fb->dimX());
+      m_fa->sparsityPattern(pata);
+      m_fb->sparsityPattern(patb);
+      pata.compress();
+      patb.compress();
+      addProduct(pata, patb, pattern);
+    }
+
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(m_fb->dimF(), lh.alloc(m_fb->dimF()));
       m_fb->evaluate (x, tmp);
 
-      Matrix<double> jaca(m_fa->dimF(), m_fa->dimX());
-      Matrix<double> jacb(m_fb->dimF(), m_fb->dimX());
+      SparseMatrix jaca(m_fa->dimF(), m_fa->dimX());
+      SparseMatrix jacb(m_fb->dimF(), m_fb->dimX());
+      m_fb->evaluateDerivSparse(x, jacb);
+      m_fa->evaluateDerivSparse(tmp, jaca);
+      jaca.compress();
+      jacb.compress();
+      addProduct(jaca, jacb, df);
+    }
 
-      m_fb->evaluateDeriv(x, jacb);
-      m_fa->evaluateDeriv(tmp, jaca);
+    bool exactJacVec() const override { return m_fa->exactJacVec() && m_fb->exactJacVec(); }
+    // chain rule: Jv = dfa(fb(x)) (dfb(x) v)
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+      VectorView<double> jbv(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+      m_fb->evaluate (x, tmp);
+      m_fb->evaluateJacVec (x, v, jbv);
+      m_fa->evaluateJacVec (tmp, jbv, Jv);
+    }
+  private:
+    // Jacobian, and the value if f is given
+    void derivImpl (VectorView<double> x, VectorView<double> * f, MatrixView<double> df) const
+    {
+      auto sa = m_fa->derivStructure();
+      auto sb = m_fb->derivStructure();
+
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> tmp(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+
+      // outer Jacobian at tmp, together with the outer value if requested
+      auto derivA = [&](MatrixView<double> jac)
+      {
+        if (f) m_fa->evaluateWithDeriv(tmp, *f, jac);
+        else m_fa->evaluateDeriv(tmp, jac);
+      };
+      auto valueA = [&]()
+      {
+        if (f) m_fa->evaluate(tmp, *f);
+      };
+
+      if (sa.type == JacobianStructure::ZERO || sb.type == JacobianStructure::ZERO)
+        {
+          if (f)
+            {
+              m_fb->evaluate (x, tmp);
+              valueA();
+            }
+          df = 0.0;
+          return;
+        }
+
+      // products with identities and diagonals are scalings of rows or columns
+      if (sb.type == JacobianStructure::IDENTITY)
+        {
+          m_fb->evaluate (x, tmp);
+          derivA(df);
+          df *= sb.scale;
+          return;
+        }
+      if (sa.type == JacobianStructure::IDENTITY)
+        {
+          m_fb->evaluateWithDeriv(x, tmp, df);
+          df *= sa.scale;
+          valueA();
+          return;
+        }
+      if (sa.type == JacobianStructure::DIAGONAL)
+        {
+          VectorView<double> d(m_fa->dimF(), lh.alloc(m_fa->dimF()));
+          m_fb->evaluateWithDeriv(x, tmp, df);
+          m_fa->evaluateDerivDiag(tmp, d);
+          for (size_t i = 0; i < df.rows(); i++)
+            df.row(i) *= d(i);
+          valueA();
+          return;
+        }
+      if (sb.type == JacobianStructure::DIAGONAL)
+        {
+          VectorView<double> d(m_fb->dimF(), lh.alloc(m_fb->dimF()));
+          m_fb->evaluate (x, tmp);
+          m_fb->evaluateDerivDiag(x, d);
+          derivA(df);
+          for (size_t i = 0; i < df.rows(); i++)
+            for (size_t j = 0; j < df.cols(); j++)
+              df(i,j) *= d(j);
+          return;
+        }
+
+      // block-diagonal times Kronecker, the stage equations of implicit RK:
+      // block (i,j) = scale * kron(i,j) * J_i
+      if (sa.type == JacobianStructure::BLOCKDIAGONAL && sb.type == JacobianStructure::KRONECKER &&
+          sa.blocks == sb.kron->rows() && sb.blocksize*sa.blocks == m_fa->dimX())
+        {
+          size_t s = sa.blocks, n = sb.blocksize, nf = m_fa->dimF()/s;
+          m_fb->evaluate (x, tmp);
+          derivA(df);
+          MatrixView<double> block(nf, n, n, lh.alloc(nf*n));
+          for (size_t i = 0; i < s; i++)
+            {
+              block = df.rows(i*nf, (i+1)*nf).cols(i*n, (i+1)*n);
+              for (size_t j = 0; j < s; j++)
+                df.rows(i*nf, (i+1)*nf).cols(j*n, (j+1)*n) = (sb.scale * (*sb.kron)(i,j)) * block;
+            }
+          return;
+        }
+
+      MatrixView<double> jaca(m_fa->dimF(), m_fa->dimX(), m_fa->dimX(),
+                              lh.alloc(m_fa->dimF()*m_fa->dimX()));
+      MatrixView<double> jacb(m_fb->dimF(), m_fb->dimX(), m_fb->dimX(),
+                              lh.alloc(m_fb->dimF()*m_fb->dimX()));
+
+      m_fb->evaluateWithDeriv(x, tmp, jacb);
+      derivA(jaca);
 
       df = jaca*jacb;
     }
@@ -218,6 +764,34 @@ namespace ASC_ode
       m_fa->evaluateDeriv(x.range(m_firstx, m_nextx),
                         df.rows(m_firstf, m_nextf).cols(m_firstx, m_nextx));
     }
+    void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                            MatrixView<double> df) const override
+    {
+      f = 0.0;
+      df = 0;
+      m_fa->evaluateWithDeriv(x.range(m_firstx, m_nextx), f.range(m_firstf, m_nextf),
+                              df.rows(m_firstf, m_nextf).cols(m_firstx, m_nextx));
+    }
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      size_t first = pattern.numTriplets();
+      m_fa->sparsityPattern(pattern);
+      pattern.shiftFrom(first, m_firstf, m_firstx);
+    }
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      size_t first = df.numTriplets();
+      m_fa->evaluateDerivSparse(x.range(m_firstx, m_nextx), df);
+      df.shiftFrom(first, m_firstf, m_firstx);
+    }
+    bool exactJacVec() const override { return m_fa->exactJacVec(); }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      Jv = 0.0;
+      m_fa->evaluateJacVec(x.range(m_firstx, m_nextx), v.range(m_firstx, m_nextx),
+                           Jv.range(m_firstf, m_nextf));
+    }
   };
 
   
@@ -241,6 +815,29 @@ namespace ASC_ode
       df = 0.0;
       df.diag().range(m_first, m_next) = 1;
     }
+    JacobianStructure derivStructure() const override { return { JacobianStructure::DIAGONAL }; }
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      d = 0.0;
+      d.range(m_first, m_next) = 1;
+    }
+    void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      for (size_t i = m_first; i < m_next; i++)
+        pattern.add(i, i, 1.0);
+    }
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      for (size_t i = m_first; i < m_next; i++)
+        df.add(i, i, 1.0);
+    }
+    bool exactJacVec() const override { return true; }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                         VectorView<double> Jv) const override
+    {
+      Jv = 0.0;
+      Jv.range(m_first, m_next) = v.range(m_first, m_next);
+    }
   };
 
   
@@ -271,6 +868,54 @@ namespace ASC_ode
         func->evaluateDeriv(x.range(i*fdimx, (i+1)*fdimx),
                             df.rows(i*fdimf, (i+1)*fdimf).cols(i*fdimx, (i+1)*fdimx));
     }
+    virtual void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                                    MatrixView<double> df) const override
+    {
+      df = 0.0;
+      for (size_t i = 0; i < num; i++)
+        func->evaluateWithDeriv(x.range(i*fdimx, (i+1)*fdimx),
+                                f.range(i*fdimf, (i+1)*fdimf),
+                                df.rows(i*fdimf, (i+1)*fdimf).cols(i*fdimx, (i+1)*fdimx));
+    }
+    virtual JacobianStructure derivStructure() const override
+    {
+      auto s = func->derivStructure();
+      if (s.isDiagonal()) return s;
+      return { JacobianStructure::BLOCKDIAGONAL, 1, num };
+    }
+    virtual void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    {
+      for (size_t i = 0; i < num; i++)
+        func->evaluateDerivDiag(x.range(i*fdimx, (i+1)*fdimx),
+                                d.range(i*fdimf, (i+1)*fdimf));
+    }
+    virtual void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      for (size_t i = 0; i < num; i++)
+        {
+          size_t first = pattern.numTriplets();
+          func->sparsityPattern(pattern);
+          pattern.shiftFrom(first, i*fdimf, i*fdimx);
+        }
+    }
+    virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      for (size_t i = 0; i < num; i++)
+        {
+          size_t first = df.numTriplets();
+          func->evaluateDerivSparse(x.range(i*fdimx, (i+1)*fdimx), df);
+          df.shiftFrom(first, i*fdimf, i*fdimx);
+        }
+    }
+    bool exactJacVec() const override { return func->exactJacVec(); }
+    virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                                 VectorView<double> Jv) const override
+    {
+      for (size_t i = 0; i < num; i++)
+        func->evaluateJacVec(x.range(i*fdimx, (i+1)*fdimx),
+                             v.range(i*fdimx, (i+1)*fdimx),
+                             Jv.range(i*fdimf, (i+1)*fdimf));
+    }
   };
 
 
@@ -297,6 +942,35 @@ namespace ASC_ode
         for (size_t j = 0; j < m_a.cols(); j++)
           df.rows(i*m_n, (i+1)*m_n).cols(j*m_n, (j+1)*m_n).diag() = m_a(i,j);
     }
+    virtual JacobianStructure derivStructure() const override
+    {
+      JacobianStructure s { JacobianStructure::KRONECKER };
+      s.blocksize = m_n;
+      s.kron = &m_a;
+      return s;
+    }
+    virtual void sparsityPattern (SparseMatrix & pattern) const override
+    {
+      for (size_t i = 0; i < m_a.rows(); i++)
+        for (size_t j = 0; j < m_a.cols(); j++)
+          for (size_t k = 0; k < m_n; k++)
+            pattern.add(i*m_n+k, j*m_n+k, 1.0);
+    }
+    virtual void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    {
+      for (size_t i = 0; i < m_a.rows(); i++)
+        for (size_t j = 0; j < m_a.cols(); j++)
+          if (m_a(i,j) != 0.0)
+            for (size_t k = 0; k < m_n; k++)
+              df.add(i*m_n+k, j*m_n+k, m_a(i,j));
+    }
+    bool exactJacVec() const override { return true; }
+    // the function is linear
+    virtual void evaluateJacVec (VectorView<double> x, VectorView<double> v,
+                                 VectorView<double> Jv) const override
+    {
+      evaluate(v, Jv);
+    }
   };
 
 }
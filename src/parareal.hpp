@@ -0,0 +1,160 @@
+#ifndef PARAREAL_HPP
+#define PARAREAL_HPP
+
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+
+#include "timestepper.hpp"
+#include "threadpool.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  // creates an independent stepper, every fine propagation gets a new one
+  using StepperFactory = std::function<std::unique_ptr<TimeStepper>()>;
+
+  struct PararealOptions
+  {
+    size_t slices = 0;          // time slices, 0: one per thread of the pool
+    size_t coarseSteps = 1;     // coarse steps per slice
+    size_t fineSteps = 100;     // fine steps per slice
+    size_t maxIterations = 0;   // 0: slices, the sequential fine solution up to its nonlinear solves
+    double tol = 1e-10;         // on the relative change of the slice end values
+  };
+
+  struct PararealStatistics
+  {
+    size_t iterations = 0;
+    double change = 0;          // relative change in the last iteration
+    double time = 0;            // wall time [s]
+    double coarseTime = 0;      // sequential coarse sweeps [s]
+    double sequentialEstimate = 0;  // sum of the fine slices of the first iteration [s]
+    double criticalPath = 0;    // coarse sweeps plus the slowest slice of every iteration [s]
+
+    // speedup against a measured sequential fine integration
+    double speedup (double sequentialTime) const { return time > 0 ? sequentialTime / time : 0; }
+    // with one thread per slice, from the estimate: the slices of the first
+    // iteration ran concurrently, contention on the pool makes it too large
+    double idealSpeedup() const { return criticalPath > 0 ? sequentialEstimate / criticalPath : 0; }
+  };
+
+
+  /*
+    Parareal (Lions, Maday, Turinici): the interval [0,tend] is cut into
+    slices, a cheap coarse propagator G runs sequentially over all slices
+    and the accurate fine propagator F runs on all slices in parallel.
+    Iteration k corrects
+      U_{n+1} = G(U_n^new) + F(U_n^old) - G(U_n^old),
+    after k iterations the first k slices agree with the sequential fine
+    solution, up to the tolerance of the fine stepper's nonlinear solves:
+    every fine propagation starts a new stepper, which has no history to
+    predict from, where the sequential one continues from its last step.
+    The iteration stops when the slice end values change less than tol
+    relative to their size. y is overwritten by the value at tend.
+  */
+  inline PararealStatistics SolveParareal (double tend, VectorView<double> y,
+                                           StepperFactory coarse, StepperFactory fine,
+                                           ThreadPool & pool, PararealOptions options = PararealOptions())
+  {
+    using clock = std::chrono::steady_clock;
+    auto seconds = [](clock::time_point start)
+    {
+      return std::chrono::duration<double>(clock::now()-start).count();
+    };
+    auto start = clock::now();
+
+    size_t N = options.slices ? options.slices : pool.size();
+    size_t maxit = options.maxIterations ? std::min(options.maxIterations, N) : N;
+    size_t n = y.size();
+    double dt = tend / N;
+
+    std::vector<Vector<>> U, Fvals, Gvals;
+    for (size_t i = 0; i <= N; i++)
+      {
+        U.emplace_back(n);
+        Fvals.emplace_back(n);
+        Gvals.emplace_back(n);
+      }
+    std::vector<double> fineTimes(N, 0.0), sliceTimes(N, 0.0);
+    auto coarseStepper = coarse();
+
+    PararealStatistics stats;
+    auto propagate = [](TimeStepper & stepper, double tau, size_t steps, VectorView<double> v)
+    {
+      for (size_t i = 0; i < steps; i++)
+        stepper.DoStep(tau/steps, v);
+    };
+    auto coarseSweep = [&](size_t first)
+    {
+      auto cstart = clock::now();
+      for (size_t i = first; i < N; i++)
+        {
+          // Gvals[i+1] = G(U_i), the corrected U_{i+1} follows from it
+          Vector<> g(n);
+          g = U[i];
+          propagate(*coarseStepper, dt, options.coarseSteps, g);
+          if (stats.iterations == 0)
+            U[i+1] = g;
+          else
+            U[i+1] = g + Fvals[i+1] - Gvals[i+1];
+          Gvals[i+1] = g;
+        }
+      stats.coarseTime += seconds(cstart);
+    };
+
+    U[0] = y;
+    coarseSweep(0);
+
+    for (size_t k = 0; k < maxit; k++)
+      {
+        // slices before k already carry the fine solution
+        pool.parallelFor(N-k, [&](size_t j)
+        {
+          size_t i = k+j;
+          auto stepper = fine();
+          auto fstart = clock::now();
+          Fvals[i+1] = U[i];
+          propagate(*stepper, dt, options.fineSteps, Fvals[i+1]);
+          sliceTimes[i] = seconds(fstart);
+          if (k == 0) fineTimes[i] = sliceTimes[i];
+        });
+        stats.criticalPath += *std::max_element(sliceTimes.begin()+k, sliceTimes.end());
+
+        std::vector<Vector<>> Uold(U.begin()+k+1, U.end());
+        stats.iterations++;
+        U[k+1] = Fvals[k+1];
+        coarseSweep(k+1);
+
+        stats.change = 0;
+        for (size_t i = k+1; i <= N; i++)
+          {
+            double diff = 0, size = 0;
+            for (size_t l = 0; l < n; l++)
+              {
+                diff = std::max(diff, std::fabs(U[i](l) - Uold[i-k-1](l)));
+                size = std::max(size, std::fabs(U[i](l)));
+              }
+            stats.change = std::max(stats.change, diff / std::max(size, 1e-300));
+          }
+        if (stats.change < options.tol) break;
+      }
+
+    y = U[N];
+    stats.time = seconds(start);
+    stats.criticalPath += stats.coarseTime;
+    for (double t : fineTimes)
+      stats.sequentialEstimate += t;
+    return stats;
+  }
+
+} // namespace ASC_ode
+
+#endif // PARAREAL_HPP
@@ -0,0 +1,281 @@
+#ifndef RKC_HPP
+#define RKC_HPP
+
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+
+#include "timestepper.hpp"
+#include "explicitRK.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Runge-Kutta-Chebyshev method RKC2 of Sommeijer, Shampine and Verwer:
+    an explicit second order method with s stages, built from shifted and
+    damped Chebyshev polynomials, stable for tau*rho <= 0.65 s^2 on a
+    narrow strip around the negative real axis. The number of stages is
+    chosen per step from the spectral radius rho of the Jacobian, so
+    moderately stiff problems with (nearly) real spectrum - diffusion,
+    RC networks, heavily damped spring systems - need only right hand side
+    evaluations and a few vectors of storage. Undamped oscillations have
+    imaginary eigenvalues and are outside the stability region.
+    rho is estimated by power iteration on differences of f, again every
+    25 steps and after rejections, or comes from setSpectralRadius.
+    The error estimate of Shampine uses f at both ends of the step, f at
+    the new solution is reused as first stage of the next step.
+  */
+  class RungeKuttaChebyshev : public AdaptiveTimeStepper
+  {
+    size_t m_n;
+    int m_maxstages;
+
+    Vector<> m_y0, m_f0, m_ynew, m_f1, m_yjm1, m_yjm2, m_fj, m_err;
+    Vector<> m_ystart, m_fstart;  // start of a split step
+    Vector<> m_eigvec;          // start vector of the power iteration
+    bool m_haveeigvec = false;
+    bool m_havef0 = false;      // f(m_y0) is known
+    bool m_havef1 = false;      // f(m_ynew) is known
+    double m_tauold = 0;
+
+    std::function<double(VectorView<double>)> m_spectralradius;
+    double m_rho = 0;
+    bool m_rhovalid = false;
+    size_t m_stepssincerho = 0;
+    size_t m_rhoestimates = 0;
+
+    int m_stages = 0, m_maxstagesused = 0;
+    double m_proposed = 0;
+
+    static constexpr double m_eps = 2.0/13;   // damping
+
+  public:
+    RungeKuttaChebyshev (std::shared_ptr<NonlinearFunction> rhs, Tolerance tol = Tolerance(),
+                         int maxstages = 250)
+      : AdaptiveTimeStepper(rhs, tol), m_n(rhs->dimX()), m_maxstages(maxstages),
+        m_y0(m_n), m_f0(m_n), m_ynew(m_n), m_f1(m_n), m_yjm1(m_n), m_yjm2(m_n),
+        m_fj(m_n), m_err(m_n), m_ystart(m_n), m_fstart(m_n), m_eigvec(m_n)
+    {
+      if (maxstages < 2)
+        throw std::invalid_argument("RungeKuttaChebyshev: at least 2 stages");
+    }
+
+    // an upper bound of the spectral radius of f'(y) replaces the power iteration
+    void setSpectralRadius (std::function<double(VectorView<double>)> rho)
+    {
+      m_spectralradius = rho;
+      m_rhovalid = false;
+    }
+
+    int errorOrder() const override { return 3; }
+
+    double spectralRadius() const { return m_rho; }
+    size_t spectralRadiusEstimates() const { return m_rhoestimates; }
+    int stages() const { return m_stages; }
+    int maxStagesUsed() const { return m_maxstagesused; }
+
+    // the largest step size with maxstages stages, known after the first step
+    double maxStepSize() const
+    {
+      double s1 = m_maxstages - 1;
+      return m_rho > 0 ? (s1*s1 - 1) / (1.54 * m_rho) : HUGE_VAL;
+    }
+
+    // steps beyond the stability bound of maxstages are split, the dense
+    // output then interpolates between the end points of the whole step
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      prepare(y);
+      int parts = std::max(1, int(std::ceil(tau / maxStepSize())));
+      if (parts > 1)
+        {
+          m_ystart = m_y0;
+          m_fstart = m_f0;
+        }
+      for (int i = 0; i < parts; i++)
+        {
+          if (i > 0) prepare(y);
+          computeStages(tau/parts);
+          acceptStep(tau/parts, y);
+        }
+      if (parts > 1)
+        {
+          m_y0 = m_ystart;
+          m_f0 = m_fstart;
+          m_tauold = tau;
+        }
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      m_proposed = 0;
+      prepare(y);
+      if (tau > maxStepSize())
+        {
+          m_proposed = maxStepSize();
+          err = HUGE_VAL;
+          return false;
+        }
+
+      computeStages(tau);
+      m_rhs->evaluate(m_ynew, m_f1);
+      m_evaluations++;
+      for (size_t i = 0; i < m_n; i++)
+        m_err(i) = 0.8 * (m_y0(i) - m_ynew(i)) + 0.4 * tau * (m_f0(i) + m_f1(i));
+      err = m_tol.errorNorm(m_err, y, m_ynew);
+      if (!(err <= 1))
+        {
+          m_rhovalid = false;
+          return false;
+        }
+
+      acceptStep(tau, y);
+      m_havef1 = true;
+      return true;
+    }
+
+    double proposedStepSize() const override { return m_proposed; }
+
+    // cubic Hermite interpolation over the whole step, also after a split
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      HermiteDenseOutput(*m_rhs, theta, m_tauold, m_y0, m_f0, m_ynew, m_f1, m_havef1, m_evaluations, y);
+    }
+
+  private:
+    // y0 = y and f(y0), from the last step if possible, and the spectral radius
+    void prepare (VectorView<double> y)
+    {
+      if (m_havef1 && SameState(y, m_ynew))
+        {
+          m_y0 = m_ynew;
+          m_f0 = m_f1;
+        }
+      else if (!m_havef0 || !SameState(y, m_y0))
+        {
+          m_y0 = y;
+          m_rhs->evaluate(m_y0, m_f0);
+          m_evaluations++;
+        }
+      m_havef0 = true;
+      m_havef1 = false;
+      if (!m_rhovalid || m_stepssincerho >= 25)
+        {
+          m_rho = m_spectralradius ? m_spectralradius(m_y0) : estimateSpectralRadius();
+          m_rhovalid = true;
+          m_stepssincerho = 0;
+          m_rhoestimates++;
+        }
+    }
+
+    // power iteration with J v ~ (f(y0 + delta v) - f(y0)) / delta, as in RKC
+    double estimateSpectralRadius ()
+    {
+      auto nrm = [](VectorView<double> v)
+      {
+        double sum = 0;
+        for (size_t i = 0; i < v.size(); i++) sum += v(i)*v(i);
+        return std::sqrt(sum);
+      };
+
+      if (!m_haveeigvec)
+        m_eigvec = m_f0;
+      double ynorm = nrm(m_y0);
+      double delta = std::sqrt(1e-16) * (ynorm > 0 ? ynorm : 1);
+      double vnorm = nrm(m_eigvec);
+      if (vnorm == 0)
+        {
+          m_eigvec = 0.0;
+          for (size_t i = 0; i < m_n; i += 2)
+            m_eigvec(i) = 1;
+          vnorm = nrm(m_eigvec);
+        }
+
+      double sigma = 0;
+      for (int it = 0; it < 50; it++)
+        {
+          m_yjm1 = m_y0 + (delta/vnorm) * m_eigvec;
+          m_rhs->evaluate(m_yjm1, m_fj);
+          m_evaluations++;
+          m_fj -= m_f0;
+          double dfnorm = nrm(m_fj);
+          double sigmaold = sigma;
+          sigma = dfnorm / delta;
+          if (dfnorm == 0)
+            {
+              // f is locally constant in direction v, try a perturbed one
+              m_eigvec(it % m_n) += 1;
+              vnorm = nrm(m_eigvec);
+              continue;
+            }
+          m_eigvec = m_fj;
+          vnorm = dfnorm;
+          m_haveeigvec = true;
+          if (it > 0 && std::fabs(sigma-sigmaold) <= 0.01 * sigma)
+            break;
+        }
+      return 1.2 * sigma;
+    }
+
+    // RKC2 stages, y_s -> m_ynew; uses m_y0, m_f0
+    void computeStages (double tau)
+    {
+      int s = 1 + int(std::sqrt(1 + 1.54 * tau * m_rho));
+      s = std::clamp(s, 2, m_maxstages);
+      m_stages = s;
+      m_maxstagesused = std::max(m_maxstagesused, s);
+
+      double w0 = 1 + m_eps / (s*s);
+      double temp1 = w0*w0 - 1, temp2 = std::sqrt(temp1);
+      double arg = s * std::log(w0 + temp2);
+      double w1 = std::sinh(arg) * temp1 / (std::cosh(arg) * s * temp2 - w0 * std::sinh(arg));
+
+      // Chebyshev polynomials T_j(w0) and derivatives by their recursion
+      double bjm1 = 1 / (4*w0*w0), bjm2 = bjm1;
+      double zjm1 = w0, zjm2 = 1, dzjm1 = 1, dzjm2 = 0, d2zjm1 = 0, d2zjm2 = 0;
+
+      m_yjm2 = m_y0;
+      m_yjm1 = m_y0 + (tau * w1 * bjm1) * m_f0;
+      for (int j = 2; j <= s; j++)
+        {
+          double zj = 2*w0*zjm1 - zjm2;
+          double dzj = 2*w0*dzjm1 - dzjm2 + 2*zjm1;
+          double d2zj = 2*w0*d2zjm1 - d2zjm2 + 4*dzjm1;
+          double bj = d2zj / (dzj*dzj);
+          double ajm1 = 1 - zjm1*bjm1;
+          double mu = 2*w0*bj/bjm1, nu = -bj/bjm2, mus = mu*w1/w0;
+
+          m_rhs->evaluate(m_yjm1, m_fj);
+          m_evaluations++;
+          // y_j = mu y_{j-1} + nu y_{j-2} + (1-mu-nu) y_0 + tau mus (f_{j-1} - a_{j-1} f_0)
+          for (size_t i = 0; i < m_n; i++)
+            m_ynew(i) = mu*m_yjm1(i) + nu*m_yjm2(i) + (1-mu-nu)*m_y0(i)
+              + tau*mus * (m_fj(i) - ajm1*m_f0(i));
+          m_yjm2 = m_yjm1;
+          m_yjm1 = m_ynew;
+
+          bjm2 = bjm1; bjm1 = bj;
+          zjm2 = zjm1; zjm1 = zj;
+          dzjm2 = dzjm1; dzjm1 = dzj;
+          d2zjm2 = d2zjm1; d2zjm1 = d2zj;
+        }
+    }
+
+    void acceptStep (double tau, VectorView<double> y)
+    {
+      m_tauold = tau;
+      m_stepssincerho++;
+      y = m_ynew;
+    }
+  };
+
+} // namespace ASC_ode
+
+#endif // RKC_HPP
@@ -0,0 +1,299 @@
+#ifndef ROSENBROCK_HPP
+#define ROSENBROCK_HPP
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+#include "timestepper.hpp"
+#include "explicitRK.hpp"
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Rosenbrock method in the form without matrix-vector products
+    (Hairer-Wanner, IV.7):
+      (I/(gamma tau) - J) u_i = f(y + sum_j a_ij u_j) + sum_j c_ij/tau u_j
+      y1 = y + sum_i m_i u_i,  embedded y1hat = y + sum_i mhat_i u_i
+    For W-methods the order does not depend on J being the exact Jacobian.
+  */
+  struct RosenbrockTableau
+  {
+    Matrix<> a, c;
+    Vector<> m, mhat;
+    double gamma;
+    int order, embeddedOrder;
+    bool wmethod = false;
+
+    RosenbrockTableau (int stages, double _gamma, int _order, int _embeddedOrder)
+      : a(stages, stages), c(stages, stages), m(stages), mhat(stages),
+        gamma(_gamma), order(_order), embeddedOrder(_embeddedOrder)
+    {
+      a = 0.0;
+      c = 0.0;
+      m = 0.0;
+      mhat = 0.0;
+    }
+
+    int stages() const { return m.size(); }
+
+    // from the standard form with coefficients alpha_ij, gamma_ij (gamma_ii = gamma), b, bhat
+    static RosenbrockTableau FromStandardForm (const Matrix<> & alpha, const Matrix<> & Gamma,
+                                               const Vector<> & b, const Vector<> & bhat,
+                                               int order, int embeddedOrder)
+    {
+      int s = b.size();
+      RosenbrockTableau t(s, Gamma(0,0), order, embeddedOrder);
+      // inverse of the lower triangular Gamma
+      Matrix<> ginv(s, s);
+      ginv = 0.0;
+      for (int j = 0; j < s; j++)
+        for (int i = j; i < s; i++)
+          {
+            double sum = (i == j) ? 1 : 0;
+            for (int k = j; k < i; k++)
+              sum -= Gamma(i,k) * ginv(k,j);
+            ginv(i,j) = sum / Gamma(i,i);
+          }
+      for (int i = 0; i < s; i++)
+        for (int j = 0; j < i; j++)
+          {
+            double sum = 0;
+            for (int k = j; k < i; k++)
+              sum += alpha(i,k) * ginv(k,j);
+            t.a(i,j) = sum;
+            t.c(i,j) = -ginv(i,j);
+          }
+      for (int j = 0; j < s; j++)
+        for (int i = j; i < s; i++)
+          {
+            t.m(j) += b(i) * ginv(i,j);
+            t.mhat(j) += bhat(i) * ginv(i,j);
+          }
+      return t;
+    }
+  };
+
+
+  // ROS2 of Verwer et al., order 2 for any J, embedded order 1
+  inline RosenbrockTableau ROS2()
+  {
+    double g = 1 + 1/std::sqrt(2.0);
+    RosenbrockTableau t(2, g, 2, 1);
+    t.a(1,0) = 1/g;
+    t.c(1,0) = -2/g;
+    t.m(0) = 3/(2*g);  t.m(1) = 1/(2*g);
+    t.mhat(0) = 1/g;
+    t.wmethod = true;
+    return t;
+  }
+
+  // ROS3P of Lang and Verwer, order 3, embedded order 2
+  inline RosenbrockTableau ROS3P()
+  {
+    double g = 0.5 + std::sqrt(3.0)/6;
+    Matrix<> alpha(3, 3), Gamma(3, 3);
+    alpha = 0.0;
+    Gamma = 0.0;
+    alpha(1,0) = 1;  alpha(2,0) = 1;
+    Gamma(0,0) = g;  Gamma(1,1) = g;  Gamma(2,2) = g;
+    Gamma(1,0) = -1;  Gamma(2,0) = -g;  Gamma(2,1) = 0.5-2*g;
+    Vector<> b(3), bhat(3);
+    b(0) = 2.0/3;  b(1) = 0;  b(2) = 1.0/3;
+    bhat(0) = 1.0/3;  bhat(1) = 1.0/3;  bhat(2) = 1.0/3;
+    return RosenbrockTableau::FromStandardForm(alpha, Gamma, b, bhat, 3, 2);
+  }
+
+  // RODAS of Hairer and Wanner, order 4, embedded order 3, stiffly accurate
+  inline RosenbrockTableau RODAS()
+  {
+    RosenbrockTableau t(6, 0.25, 4, 3);
+    t.a(1,0) = 1.544;
+    t.a(2,0) = 0.9466785280815826;  t.a(2,1) = 0.2557011698983284;
+    t.a(3,0) = 3.314825187068521;   t.a(3,1) = 2.896124015972201;   t.a(3,2) = 0.9986419139977817;
+    t.a(4,0) = 1.221224509226641;   t.a(4,1) = 6.019134481288629;   t.a(4,2) = 12.53708332932087;
+    t.a(4,3) = -0.6878860361058950;
+    for (int j = 0; j < 4; j++)
+      t.a(5,j) = t.a(4,j);
+    t.a(5,4) = 1;
+    t.c(1,0) = -5.6688;
+    t.c(2,0) = -2.430093356833875;  t.c(2,1) = -0.2063599157091915;
+    t.c(3,0) = -0.1073529058151375; t.c(3,1) = -9.594562251023355;  t.c(3,2) = -20.47028614809616;
+    t.c(4,0) = 7.496443313967647;   t.c(4,1) = -10.24680431464352;  t.c(4,2) = -33.99990352819905;
+    t.c(4,3) = 11.70890893206160;
+    t.c(5,0) = 8.083246795921522;   t.c(5,1) = -7.981132988064893;  t.c(5,2) = -31.52159432874371;
+    t.c(5,3) = 16.31930543123136;   t.c(5,4) = -6.058818238834054;
+    // the solution is the argument of the last stage plus u_6
+    for (int j = 0; j < 5; j++)
+      {
+        t.m(j) = t.a(5,j);
+        t.mhat(j) = t.a(5,j);
+      }
+    t.m(5) = 1;
+    return t;
+  }
+
+
+  /*
+    Linearly implicit Runge-Kutta (Rosenbrock) stepper: one Jacobian and
+    one LU factorization per step, shared by all stages, no Newton iteration.
+    With wmethod = true the Jacobian is kept for jacobianReuse().maxage
+    steps and only renewed after a rejected step, the matrix is factored
+    again when the step size changes. The order is then only guaranteed
+    for W-method tableaus (ROS2), the constructor throws
+    std::invalid_argument for others.
+  */
+  class Rosenbrock : public AdaptiveTimeStepper
+  {
+    RosenbrockTableau m_tab;
+    int m_stages;
+    size_t m_n;
+    bool m_wmethod;
+
+    Vector<> m_u;           // all stage increments
+    Vector<> m_ystage, m_ynew, m_err, m_f0, m_f1, m_y0, m_yf0;
+    Matrix<> m_jac;
+    DenseLU m_lu;
+    double m_factoredTau = 0;
+    double m_tauold = 0;
+    bool m_havef0 = false;  // f(m_yf0) is known
+    bool m_havef1 = false;  // f(m_ynew) is known
+    JacobianReuse m_reuse;
+    size_t m_jacobians = 0;
+
+  public:
+    Rosenbrock (std::shared_ptr<NonlinearFunction> rhs, const RosenbrockTableau & tab,
+                Tolerance tol = Tolerance(), bool wmethod = false)
+      : AdaptiveTimeStepper(rhs, tol), m_tab(tab), m_stages(tab.stages()),
+        m_n(rhs->dimX()), m_wmethod(wmethod),
+        m_u(m_stages*m_n), m_ystage(m_n), m_ynew(m_n), m_err(m_n),
+        m_f0(m_n), m_f1(m_n), m_y0(m_n), m_yf0(m_n), m_jac(m_n, m_n), m_lu(m_n)
+    {
+      if (wmethod && !tab.wmethod)
+        throw std::invalid_argument("Rosenbrock: Jacobian reuse needs a W-method tableau");
+    }
+
+    int order() const { return m_tab.order; }
+    int errorOrder() const override { return std::min(m_tab.order, m_tab.embeddedOrder) + 1; }
+    JacobianReuse & jacobianReuse() { return m_reuse; }
+    size_t jacobians() const { return m_jacobians; }
+
+    void DoStep (double tau, VectorView<double> y) override
+    {
+      ComputeStages(tau, y);
+      Accept(tau, y);
+    }
+
+    bool TryStep (double tau, VectorView<double> y, double & err) override
+    {
+      ComputeStages(tau, y);
+      m_err = 0.0;
+      for (int j = 0; j < m_stages; j++)
+        {
+          double e = m_tab.m(j) - m_tab.mhat(j);
+          if (e != 0.0)
+            m_err += e * stage(j);
+        }
+      err = m_tol.errorNorm(m_err, y, m_ynew);
+      if (!(err <= 1))
+        {
+          // a stale Jacobian may be the reason
+          if (m_wmethod) m_reuse.invalidate();
+          return false;
+        }
+      Accept(tau, y);
+      return true;
+    }
+
+    // cubic Hermite interpolation
+    bool hasDenseOutput() const override { return true; }
+
+    void DenseOutput (double theta, VectorView<double> y) override
+    {
+      HermiteDenseOutput(*m_rhs, theta, m_tauold, m_y0, m_f0, m_ynew, m_f1, m_havef1, m_evaluations, y);
+    }
+
+  private:
+    VectorView<double> stage (int j) { return m_u.range(j*m_n, (j+1)*m_n); }
+
+    void ComputeStages (double tau, VectorView<double> y)
+    {
+      // f(y) is the first stage, it is known after a rejected step
+      // or from the dense output of the last step
+      bool samepoint = m_havef0 && SameState(y, m_yf0);
+      bool known = m_havef1 && SameState(y, m_ynew);
+
+      bool newjac = m_reuse.age < 0 || m_reuse.age >= m_reuse.maxage || (!m_wmethod && !samepoint);
+      if (!samepoint && !known && newjac)
+        {
+          m_rhs->evaluateWithDeriv(y, m_f0, m_jac);
+          m_evaluations++;
+        }
+      else
+        {
+          if (!samepoint && known)
+            m_f0 = m_f1;
+          else if (!samepoint)
+            {
+              m_rhs->evaluate(y, m_f0);
+              m_evaluations++;
+            }
+          if (newjac)
+            m_rhs->evaluateDeriv(y, m_jac);
+        }
+      if (newjac)
+        {
+          m_reuse.age = 0;
+          m_jacobians++;
+        }
+      m_yf0 = y;
+      m_havef0 = true;
+      m_havef1 = false;
+
+      if (newjac || tau != m_factoredTau)
+        {
+          double fac = 1 / (m_tab.gamma * tau);
+          m_lu.refactor(m_n, [&](size_t i, size_t j) { return (i == j ? fac : 0.0) - m_jac(i,j); });
+          m_factoredTau = tau;
+          m_reuse.factorizations++;
+        }
+
+      for (int i = 0; i < m_stages; i++)
+        {
+          auto ui = stage(i);
+          if (i == 0)
+            ui = m_f0;
+          else
+            {
+              m_ystage = y;
+              for (int j = 0; j < i; j++)
+                if (m_tab.a(i,j) != 0.0)
+                  m_ystage += m_tab.a(i,j) * stage(j);
+              m_rhs->evaluate(m_ystage, ui);
+              m_evaluations++;
+            }
+          for (int j = 0; j < i; j++)
+            if (m_tab.c(i,j) != 0.0)
+              ui += (m_tab.c(i,j)/tau) * stage(j);
+          m_lu.solve(ui);
+        }
+
+      m_ynew = y;
+      for (int j = 0; j < m_stages; j++)
+        if (m_tab.m(j) != 0.0)
+          m_ynew += m_tab.m(j) * stage(j);
+    }
+
+    void Accept (double tau, VectorView<double> y)
+    {
+      m_y0 = y;
+      m_tauold = tau;
+      y = m_ynew;
+      m_reuse.age++;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef SPARSEMATRIX_HPP
+#define SPARSEMATRIX_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+
+namespace ASC_ode
+{
+  using namespace nanoblas;
+
+  /*
+    Sparse matrix assembled from (row, col, value) triplets.
+    Jacobians are accumulated with add(), duplicate entries are summed
+    when the matrix is compressed to CSR format.
+  */
+  class SparseMatrix
+  {
+    size_t m_height = 0, m_width = 0;
+
+    // triplets
+    std::vector<size_t> m_tripletrows, m_tripletcols;
+    std::vector<double> m_tripletvals;
+
+    // compressed row storage
+    std::vector<size_t> m_firstinrow, m_colind;
+    std::vector<double> m_data;
+    bool m_compressed = false;
+
+  public:
+    SparseMatrix (size_t height = 0, size_t width = 0)
+      : m_height(height), m_width(width) { }
+
+    size_t height() const { return m_height; }
+    size_t width() const { return m_width; }
+
+    // drop all entries, keeps the allocated memory
+    void setSize (size_t height, size_t width)
+    {
+      m_height = height;
+      m_width = width;
+      clear();
+    }
+
+    void clear()
+    {
+      m_tripletrows.clear();
+      m_tripletcols.clear();
+      m_tripletvals.clear();
+      m_compressed = false;
+    }
+
+    size_t numTriplets() const { return m_tripletvals.size(); }
+
+    void add (size_t row, size_t col, double val)
+    {
+      m_tripletrows.push_back(row);
+      m_tripletcols.push_back(col);
+      m_tripletvals.push_back(val);
+      m_compressed = false;
+    }
+
+    // scale all triplets added after position 'first'
+    void scaleFrom (size_t first, double fac)
+    {
+      for (size_t i = first; i < m_tripletvals.size(); i++)
+        m_tripletvals[i] *= fac;
+      m_compressed = false;
+    }
+
+    // shift row and column indices of all triplets added after position 'first'
+    void shiftFrom (size_t first, size_t rowoffset, size_t coloffset)
+    {
+      for (size_t i = first; i < m_tripletvals.size(); i++)
+        {
+          m_tripletrows[i] += rowoffset;
+          m_tripletcols[i] += coloffset;
+        }
+      m_compressed = false;
+    }
+
+    // sort triplets into CSR format, duplicates are summed up
+    void compress()
+    {
+      if (m_compressed) return;
+
+      m_firstinrow.assign(m_height+1, 0);
+      for (size_t r : m_tripletrows)
+        m_firstinrow[r+1]++;
+      for (size_t i = 0; i < m_height; i++)
+        m_firstinrow[i+1] += m_firstinrow[i];
+
+      std::vector<size_t> pos(m_firstinrow.begin(), m_firstinrow.end()-1);
+      std::vector<size_t> cols(m_tripletvals.size());
+      std::vector<double> vals(m_tripletvals.size());
+      for (size_t i = 0; i < m_tripletvals.size(); i++)
+        {
+          size_t p = pos[m_tripletrows[i]]++;
+          cols[p] = m_tripletcols[i];
+          vals[p] = m_tripletvals[i];
+        }
+
+      // sort every row by column and merge duplicates
+      m_colind.clear();
+      m_data.clear();
+      std::vector<size_t> order;
+      size_t first = 0;
+      for (size_t r = 0; r < m_height; r++)
+        {
+          size_t next = m_firstinrow[r+1];
+          order.resize(next-first);
+          for (size_t j = 0; j < order.size(); j++)
+            order[j] = first+j;
+          std::sort(order.begin(), order.end(),
+                    [&](size_t a, size_t b) { return cols[a] < cols[b]; });
+
+          m_firstinrow[r] = m_colind.size();
+          for (size_t j : order)
+            {
+              if (m_colind.size() > m_firstinrow[r] && m_colind.back() == cols[j])
+                m_data.back() += vals[j];
+              else
+                {
+                  m_colind.push_back(cols[j]);
+                  m_data.push_back(vals[j]);
+                }
+            }
+          first = next;
+        }
+      m_firstinrow[m_height] = m_colind.size();
+      m_compressed = true;
+    }
+
+    // CSR access, valid after compress()
+    const std::vector<size_t> & firstInRow() const { return m_firstinrow; }
+    const std::vector<size_t> & colInd() const { return m_colind; }
+    const std::vector<double> & data() const { return m_data; }
+    size_t nze() const { return m_colind.size(); }
+
+    // y = A x
+    void mult (VectorView<double> x, VectorView<double> y) const
+    {
+      y = 0.0;
+      for (size_t i = 0; i < m_tripletvals.size(); i++)
+        y(m_tripletrows[i]) += m_tripletvals[i] * x(m_tripletcols[i]);
+    }
+
+    void addTo (MatrixView<double> dense, double fac = 1) const
+    {
+      for (size_t i = 0; i < m_tripletvals.size(); i++)
+        dense(m_tripletrows[i], m_tripletcols[i]) += fac * m_tripletvals[i];
+    }
+  };
+
+
+  // c += fac * a * b, a and b must be compressed
+  inline void addProduct (const SparseMatrix & a, const SparseMatrix & b,
+                          SparseMatrix & c, double fac = 1)
+  {
+    std::vector<double> rowvals(b.width(), 0.0);
+    std::vector<size_t> rowcols;
+    std::vector<bool> used(b.width(), false);
+
+    for (size_t i = 0; i < a.height(); i++)
+      {
+        for (size_t ja = a.firstInRow()[i]; ja < a.firstInRow()[i+1]; ja++)
+          {
+            size_t k = a.colInd()[ja];
+            double aik = a.data()[ja];
+            for (size_t jb = b.firstInRow()[k]; jb < b.firstInRow()[k+1]; jb++)
+              {
+                size_t j = b.colInd()[jb];
+                if (!used[j])
+                  {
+                    used[j] = true;
+                    rowcols.push_back(j);
+                  }
+                rowvals[j] += aik * b.data()[jb];
+              }
+          }
+        for (size_t j : rowcols)
+          {
+            c.add(i, j, fac*rowvals[j]);
+            rowvals[j] = 0.0;
+            used[j] = false;
+          }
+        rowcols.clear();
+      }
+  }
+
+
+
+  /*
+    Sparse LU factorization with threshold partial pivoting.
+    The rows and columns are first reordered by reverse Cuthill-McKee
+    to keep the fill-in local, then Gaussian elimination works on
+    dynamically growing sparse rows.
+  */
+  class SparseLU
+  {
+    size_t m_n = 0;
+    std::vector<size_t> m_perm;       // new index -> original index
+    std::vector<size_t> m_pivotrow;   // elimination step -> row
+    std::vector<std::vector<std::pair<size_t,double>>> m_rows;   // U rows, permuted column numbers
+    std::vector<std::vector<std::pair<size_t,double>>> m_lower;  // per step: (row, factor)
+    std::vector<double> m_tmp;
+
+  public:
+    SparseLU () = default;
+
+    // compute the fill-reducing ordering from a sparsity pattern
+    void analyze (SparseMatrix & pattern)
+    {
+      pattern.compress();
+      m_n = pattern.height();
+
+      // symmetrized adjacency
+      std::vector<std::vector<size_t>> adj(m_n);
+      for (size_t i = 0; i < m_n; i++)
+        for (size_t j = pattern.firstInRow()[i]; j < pattern.firstInRow()[i+1]; j++)
+          {
+            size_t c = pattern.colInd()[j];
+            if (c == i) continue;
+            adj[i].push_back(c);
+            adj[c].push_back(i);
+          }
+      for (auto & a : adj)
+        {
+          std::sort(a.begin(), a.end());
+          a.erase(std::unique(a.begin(), a.end()), a.end());
+        }
+
+      // Cuthill-McKee, starting every component at a vertex of minimal degree
+      std::vector<size_t> order;
+      std::vector<bool> visited(m_n, false);
+      std::vector<size_t> bydegree(m_n);
+      for (size_t i = 0; i < m_n; i++) bydegree[i] = i;
+      std::stable_sort(bydegree.begin(), bydegree.end(),
+                       [&](size_t a, size_t b) { return adj[a].size() < adj[b].size(); });
+
+      for (size_t start : bydegree)
+        {
+          if (visited[start]) continue;
+          size_t head = order.size();
+          order.push_back(start);
+          visited[start] = true;
+          while (head < order.size())
+            {
+              size_t v = order[head++];
+              size_t first = order.size();
+              for (size_t w : adj[v])
+                if (!visited[w])
+                  {
+                    visited[w] = true;
+                    order.push_back(w);
+                  }
+              std::stable_sort(order.begin()+first, order.end(),
+                               [&](size_t a, size_t b) { return adj[a].size() < adj[b].size(); });
+            }
+        }
+      std::reverse(order.begin(), order.end());
+      m_perm = order;
+    }
+
+    void factor (SparseMatrix & a)
+    {
+      a.compress();
+      if (a.height() != a.width())
+        throw std::invalid_argument("SparseLU: matrix must be square");
+      if (m_perm.size() != a.height())
+        analyze(a);
+
+      std::vector<size_t> inv(m_n);
+      for (size_t i = 0; i < m_n; i++)
+        inv[m_perm[i]] = i;
+
+      // permuted rows, and for every column the rows touching it
+      m_rows.assign(m_n, {});
+      std::vector<std::vector<size_t>> colrows(m_n);
+      for (size_t i = 0; i < m_n; i++)
+        {
+          size_t orig = m_perm[i];
+          auto & row = m_rows[i];
+          for (size_t j = a.firstInRow()[orig]; j < a.firstInRow()[orig+1]; j++)
+            row.emplace_back(inv[a.colInd()[j]], a.data()[j]);
+          std::sort(row.begin(), row.end());
+          for (auto [c, v] : row)
+            colrows[c].push_back(i);
+        }
+
+      auto entry = [](const std::vector<std::pair<size_t,double>> & row, size_t col) -> const std::pair<size_t,double>*
+      {
+        auto it = std::lower_bound(row.begin(), row.end(), std::pair<size_t,double>(col, -HUGE_VAL));
+        if (it != row.end() && it->first == col) return &*it;
+        return nullptr;
+      };
+
+      std::vector<bool> pivoted(m_n, false);
+      m_pivotrow.assign(m_n, 0);
+      m_lower.assign(m_n, {});
+      std::vector<std::pair<size_t,double>> merged;
+
+      for (size_t k = 0; k < m_n; k++)
+        {
+          // threshold pivoting: among large enough candidates take the shortest row
+          double maxval = 0;
+          for (size_t r : colrows[k])
+            if (!pivoted[r])
+              if (auto e = entry(m_rows[r], k))
+                maxval = std::max(maxval, std::fabs(e->second));
+          if (maxval == 0)
+            throw std::domain_error("SparseLU: matrix is singular");
+
+          size_t piv = m_n;
+          for (size_t r : colrows[k])
+            if (!pivoted[r])
+              if (auto e = entry(m_rows[r], k))
+                if (std::fabs(e->second) >= 0.1*maxval &&
+                    (piv == m_n || m_rows[r].size() < m_rows[piv].size()))
+                  piv = r;
+
+          pivoted[piv] = true;
+          m_pivotrow[k] = piv;
+          const auto & prow = m_rows[piv];
+          double pval = entry(prow, k)->second;
+
+          std::sort(colrows[k].begin(), colrows[k].end());
+          colrows[k].erase(std::unique(colrows[k].begin(), colrows[k].end()), colrows[k].end());
+
+          for (size_t r : colrows[k])
+            {
+              if (pivoted[r]) continue;
+              auto e = entry(m_rows[r], k);
+              if (!e) continue;
+              double fac = e->second / pval;
+              m_lower[k].emplace_back(r, fac);
+
+              // row r -= fac * pivot row, restricted to columns > k
+              auto & row = m_rows[r];
+              merged.clear();
+              size_t ir = 0, ip = 0;
+              while (ir < row.size() || ip < prow.size())
+                {
+                  if (ip == prow.size() || (ir < row.size() && row[ir].first < prow[ip].first))
+                    {
+                      if (row[ir].first != k) merged.push_back(row[ir]);
+                      ir++;
+                    }
+                  else if (ir == row.size() || prow[ip].first < row[ir].first)
+                    {
+                      if (prow[ip].first > k)
+                        {
+                          merged.emplace_back(prow[ip].first, -fac*prow[ip].second);
+                          colrows[prow[ip].first].push_back(r);
+                        }
+                      ip++;
+                    }
+                  else
+                    {
+                      if (row[ir].first > k)
+                        merged.emplace_back(row[ir].first, row[ir].second-fac*prow[ip].second);
+                      ir++; ip++;
+                    }
+                }
+              row.swap(merged);
+            }
+          colrows[k].clear();
+          colrows[k].shrink_to_fit();
+        }
+      m_tmp.resize(m_n);
+    }
+
+    // overwrites the right hand side by the solution
+    void solve (VectorView<double> b)
+    {
+      auto & y = m_tmp;
+      for (size_t i = 0; i < m_n; i++)
+        y[i] = b(m_perm[i]);
+
+      // forward substitution
+      for (size_t k = 0; k < m_n; k++)
+        {
+          double yk = y[m_pivotrow[k]];
+          for (auto [r, fac] : m_lower[k])
+            y[r] -= fac * yk;
+        }
+
+      // backward substitution, unknowns are the permuted columns
+      for (size_t k = m_n; k-- > 0; )
+        {
+          const auto & prow = m_rows[m_pivotrow[k]];
+          double sum = y[m_pivotrow[k]];
+          double diag = 0;
+          for (auto [c, v] : prow)
+            {
+              if (c == k) diag = v;
+              else if (c > k) sum -= v * b(m_perm[c]);
+            }
+          b(m_perm[k]) = sum / diag;
+        }
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,553 @@
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "nonlinfunc.hpp"
+#include "localheap.hpp"
+
+namespace ASC_ode
+{
+
+  /*
+    A NonlinearFunction tree lowered into a linear instruction tape.
+
+    Sums, scalings, identities and constants are flattened into linear
+    combinations of slots, which are evaluated in one fused pass.
+    Compositions connect slots, all other functions (MSS_Function,
+    MultipleFunc, ...) become opaque kernel calls. A node shared in the
+    tree is lowered once per input slot, so common sub-expressions like
+    the same kernel applied to the same argument are evaluated once.
+    Derivatives are propagated forward through the tape. A slot knows
+    statically whether its derivative is zero, a scaled identity, a
+    diagonal, a Kronecker product kron (x) I or a general matrix, from
+    the JacobianStructure of the kernels, so products with identities
+    and diagonals are scalings and block-diagonal kernels after Kronecker
+    slots (the stage equations of implicit RK) are assembled block-wise.
+    Parameters are read at evaluation time, the tape stays valid when
+    they change. Slot memory is taken from the thread-local heap.
+  */
+  class CompiledFunction : public NonlinearFunction
+  {
+  public:
+    struct Coefficient
+    {
+      double val = 1;
+      std::vector<const Parameter*> params;
+      double get() const
+      {
+        double c = val;
+        for (auto p : params) c *= p->get();
+        return c;
+      }
+    };
+
+    struct Term
+    {
+      Coefficient coef;
+      int slot;
+    };
+
+  private:
+    using Structure = JacobianStructure::Type;
+
+    struct Slot
+    {
+      size_t size;
+      Structure deriv;         // of the slot with respect to x
+      const ConstantFunction * constant = nullptr;
+      size_t offset = 0;       // in the value storage of temporary slots
+      int uses = 0;            // as kernel input or term
+    };
+
+    struct Instruction
+    {
+      enum { KERNEL, LINCOMB } type;
+      int out;
+      const NonlinearFunction * func = nullptr;   // KERNEL
+      int in = -1;                                // KERNEL
+      std::vector<Term> terms;                    // LINCOMB
+    };
+
+    std::shared_ptr<NonlinearFunction> m_root;
+    std::vector<Slot> m_slots;           // slot 0 is the input x
+    std::vector<Instruction> m_tape;
+    std::vector<Term> m_output;
+    size_t m_dimx, m_dimf;
+    size_t m_valuesize = 0;
+    // lowered nodes, by node and input slot, used while compiling
+    std::map<std::pair<const NonlinearFunction*,int>, std::vector<Term>> m_lowered;
+
+  public:
+    CompiledFunction (std::shared_ptr<NonlinearFunction> root)
+      : m_root(root), m_dimx(root->dimX()), m_dimf(root->dimF())
+    {
+      m_slots.push_back( { m_dimx, JacobianStructure::IDENTITY } );
+      m_output = lower (root.get(), 0);
+      m_lowered.clear();
+      for (auto & t : m_output)
+        m_slots[t.slot].uses++;
+    }
+
+    size_t dimX() const override { return m_dimx; }
+    size_t dimF() const override { return m_dimf; }
+    size_t numInstructions() const { return m_tape.size(); }
+    size_t numSlots() const { return m_slots.size(); }
+
+    void evaluate (VectorView<double> x, VectorView<double> f) const override
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      double * values = lh.alloc(m_valuesize);
+
+      for (auto & instr : m_tape)
+        {
+          if (instr.type == Instruction::KERNEL)
+            instr.func->evaluate (slotValue(instr.in, x, values),
+                                  slotValue(instr.out, x, values));
+          else
+            linearCombination (instr.terms, x, values, slotValue(instr.out, x, values));
+        }
+      linearCombination (m_output, x, values, f);
+    }
+
+    void evaluateDeriv (VectorView<double> x, MatrixView<double> df) const override
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      VectorView<double> f(m_dimf, lh.alloc(m_dimf));
+      evaluateWithDeriv(x, f, df);
+    }
+
+    void evaluateWithDeriv (VectorView<double> x, VectorView<double> f,
+                            MatrixView<double> df) const override
+    {
+      LocalHeap & lh = threadLocalHeap();
+      HeapReset hr(lh);
+      double * values = lh.alloc(m_valuesize);
+      SlotDerivs derivs(m_slots.size(), lh);
+      derivs.factor[0] = 1;
+
+      for (auto & instr : m_tape)
+        {
+          if (instr.type == Instruction::KERNEL)
+            kernelDeriv (instr, x, values, derivs, lh);
+          else
+            {
+              linearCombination (instr.terms, x, values, slotValue(instr.out, x, values));
+              combinationDeriv (instr.terms, instr.out, derivs, lh);
+            }
+        }
+      linearCombination (m_output, x, values, f);
+      derivCombination (m_output, derivs, df);
+    }
+
+    // structure, sparse and matrix-free derivatives are taken from the tree
+    JacobianStructure derivStructure() const override
+    { return m_root->derivStructure(); }
+    void evaluateDerivDiag (VectorView<double> x, VectorView<double> d) const override
+    { m_root->evaluateDerivDiag(x, d); }
+    void sparsityPattern (SparseMatrix & pattern) const override
+    { m_root->sparsityPattern(pattern); }
+    void evaluateDerivSparse (VectorView<double> x, SparseMatrix & df) const override
+    { m_root->evaluateDerivSparse(x, df); }
+    bool exactJacVec() const override { return m_root->exactJacVec(); }
+    void evaluateJacVec (VectorView<double> x, VectorView<double> v, VectorView<double> Jv) const override
+    { m_root->evaluateJacVec(x, v, Jv); }
+
+  private:
+    // derivatives of the slots during evaluateWithDeriv: the scale of
+    // identities and Kronecker products, diagonals, general matrices
+    struct SlotDerivs
+    {
+      double * factor;
+      double ** diag;
+      double ** jac;
+      const Matrix<double> ** kron;
+      size_t * blocksize;
+
+      SlotDerivs (size_t n, LocalHeap & lh)
+        : factor(lh.alloc(n)), diag(lh.alloc<double*>(n)), jac(lh.alloc<double*>(n)),
+          kron(lh.alloc<const Matrix<double>*>(n)), blocksize(lh.alloc<size_t>(n))
+      {
+        for (size_t i = 0; i < n; i++)
+          {
+            factor[i] = 0;
+            diag[i] = jac[i] = nullptr;
+            kron[i] = nullptr;
+            blocksize[i] = 1;
+          }
+      }
+    };
+
+    MatrixView<double> jacobian (int s, const SlotDerivs & derivs) const
+    {
+      return MatrixView<double> (m_slots[s].size, m_dimx, m_dimx, derivs.jac[s]);
+    }
+
+    // value and derivative of a kernel slot, by the structures of kernel and input
+    void kernelDeriv (const Instruction & instr, VectorView<double> x, double * values,
+                      SlotDerivs & derivs, LocalHeap & lh) const
+    {
+      auto in = slotValue(instr.in, x, values);
+      auto out = slotValue(instr.out, x, values);
+      const NonlinearFunction & func = *instr.func;
+      Structure tin = m_slots[instr.in].deriv, tout = m_slots[instr.out].deriv;
+      int s = instr.out, sin = instr.in;
+      size_t nout = m_slots[s].size, nin = m_slots[sin].size;
+
+      if (tout == JacobianStructure::ZERO)
+        {
+          func.evaluate(in, out);
+          return;
+        }
+      if (tout != JacobianStructure::GENERAL)
+        {
+          // identities, diagonals and Kronecker products are scaled only
+          func.evaluate(in, out);
+          auto sk = func.derivStructure();
+          double fac = sk.type == JacobianStructure::DIAGONAL ? 1 : sk.scale;
+          derivs.factor[s] = fac * derivs.factor[sin];
+          derivs.kron[s] = derivs.kron[sin];
+          derivs.blocksize[s] = derivs.blocksize[sin];
+          if (sk.type == JacobianStructure::KRONECKER)
+            {
+              derivs.kron[s] = sk.kron;
+              derivs.blocksize[s] = sk.blocksize;
+            }
+          if (tout == JacobianStructure::DIAGONAL)
+            {
+              VectorView<double> d(nout, lh.alloc(nout));
+              if (sk.type == JacobianStructure::DIAGONAL)
+                func.evaluateDerivDiag(in, d);
+              else
+                d = fac;
+              if (tin == JacobianStructure::DIAGONAL)
+                for (size_t i = 0; i < nout; i++)
+                  d(i) *= derivs.diag[sin][i];
+              else
+                d *= derivs.factor[sin];
+              derivs.diag[s] = d.data();
+            }
+          return;
+        }
+
+      auto sk = func.derivStructure();
+
+      // identity or diagonal kernel: scaled rows of the input derivative,
+      // in place if the kernel is the only use of its input
+      if (sk.isDiagonal() && tin == JacobianStructure::GENERAL)
+        {
+          func.evaluate(in, out);
+          if (m_slots[sin].uses == 1)
+            derivs.jac[s] = derivs.jac[sin];
+          else
+            {
+              derivs.jac[s] = lh.alloc(nout*m_dimx);
+              jacobian(s, derivs) = jacobian(sin, derivs);
+            }
+          auto jac = jacobian(s, derivs);
+          if (sk.type == JacobianStructure::DIAGONAL)
+            {
+              HeapReset hrd(lh);
+              VectorView<double> d(nout, lh.alloc(nout));
+              func.evaluateDerivDiag(in, d);
+              for (size_t i = 0; i < nout; i++)
+                jac.row(i) *= d(i);
+            }
+          else
+            jac *= sk.scale;
+          return;
+        }
+
+      derivs.jac[s] = lh.alloc(nout*m_dimx);
+      auto jac = jacobian(s, derivs);
+
+      // kernel Jacobian times the identity or diagonal derivative of its input
+      if (tin == JacobianStructure::IDENTITY || tin == JacobianStructure::DIAGONAL)
+        {
+          func.evaluateWithDeriv(in, out, jac);
+          if (tin == JacobianStructure::IDENTITY)
+            jac *= derivs.factor[sin];
+          else
+            for (size_t i = 0; i < nout; i++)
+              for (size_t j = 0; j < m_dimx; j++)
+                jac(i,j) *= derivs.diag[sin][j];
+          return;
+        }
+
+      HeapReset hrk(lh);
+      MatrixView<double> jk(nout, nin, nin, lh.alloc(nout*nin));
+      func.evaluateWithDeriv(in, out, jk);
+
+      // block-diagonal kernel after a Kronecker slot:
+      // block (i,j) = scale * kron(i,j) * J_i
+      if (tin == JacobianStructure::KRONECKER && sk.type == JacobianStructure::BLOCKDIAGONAL &&
+          sk.blocks == derivs.kron[sin]->rows() && nout % sk.blocks == 0)
+        {
+          const Matrix<double> & kron = *derivs.kron[sin];
+          size_t bs = derivs.blocksize[sin], nf = nout / sk.blocks;
+          for (size_t i = 0; i < kron.rows(); i++)
+            for (size_t j = 0; j < kron.cols(); j++)
+              jac.rows(i*nf, (i+1)*nf).cols(j*bs, (j+1)*bs) =
+                (derivs.factor[sin] * kron(i,j)) * jk.rows(i*nf, (i+1)*nf).cols(i*bs, (i+1)*bs);
+          return;
+        }
+
+      if (tin == JacobianStructure::KRONECKER)
+        {
+          MatrixView<double> jin(nin, m_dimx, m_dimx, lh.alloc(nin*m_dimx));
+          jin = 0.0;
+          addDeriv (sin, 1, derivs, jin);
+          jac = jk * jin;
+        }
+      else
+        jac = jk * jacobian(sin, derivs);
+    }
+
+    // derivative of a linear combination stored in slot s
+    void combinationDeriv (const std::vector<Term> & terms, int s,
+                           SlotDerivs & derivs, LocalHeap & lh) const
+    {
+      size_t n = m_slots[s].size;
+      switch (m_slots[s].deriv)
+        {
+        case JacobianStructure::ZERO:
+          return;
+        case JacobianStructure::IDENTITY:
+        case JacobianStructure::KRONECKER:
+          // a sum of identities, or a single Kronecker term
+          derivs.factor[s] = 0;
+          for (auto & t : terms)
+            {
+              Structure ts = m_slots[t.slot].deriv;
+              if (ts == JacobianStructure::ZERO) continue;
+              derivs.factor[s] += t.coef.get() * derivs.factor[t.slot];
+              derivs.kron[s] = derivs.kron[t.slot];
+              derivs.blocksize[s] = derivs.blocksize[t.slot];
+            }
+          return;
+        case JacobianStructure::DIAGONAL:
+          {
+            VectorView<double> d(n, lh.alloc(n));
+            d = 0.0;
+            for (auto & t : terms)
+              {
+                double c = t.coef.get();
+                if (m_slots[t.slot].deriv == JacobianStructure::IDENTITY)
+                  for (size_t i = 0; i < n; i++)
+                    d(i) += c * derivs.factor[t.slot];
+                else if (m_slots[t.slot].deriv == JacobianStructure::DIAGONAL)
+                  d += c * VectorView<double>(n, derivs.diag[t.slot]);
+              }
+            derivs.diag[s] = d.data();
+            return;
+          }
+        default:
+          derivs.jac[s] = lh.alloc(n*m_dimx);
+          derivCombination (terms, derivs, jacobian(s, derivs));
+        }
+    }
+
+    // df = derivative of a linear combination, the first general term is
+    // assigned instead of added to a zero matrix
+    void derivCombination (const std::vector<Term> & terms, const SlotDerivs & derivs,
+                           MatrixView<double> df) const
+    {
+      const Term * first = nullptr;
+      for (auto & t : terms)
+        if (m_slots[t.slot].deriv == JacobianStructure::GENERAL)
+          {
+            first = &t;
+            break;
+          }
+      if (first)
+        df = first->coef.get() * jacobian(first->slot, derivs);
+      else
+        df = 0.0;
+      for (auto & t : terms)
+        if (&t != first)
+          addDeriv (t.slot, t.coef.get(), derivs, df);
+    }
+
+    // df += c * derivative of slot s
+    void addDeriv (int s, double c, const SlotDerivs & derivs, MatrixView<double> df) const
+    {
+      size_t n = m_slots[s].size;
+      switch (m_slots[s].deriv)
+        {
+        case JacobianStructure::ZERO:
+          break;
+        case JacobianStructure::IDENTITY:
+          for (size_t i = 0; i < n; i++)
+            df(i,i) += c * derivs.factor[s];
+          break;
+        case JacobianStructure::DIAGONAL:
+          for (size_t i = 0; i < n; i++)
+            df(i,i) += c * derivs.diag[s][i];
+          break;
+        case JacobianStructure::KRONECKER:
+          {
+            const Matrix<double> & kron = *derivs.kron[s];
+            size_t bs = derivs.blocksize[s];
+            for (size_t i = 0; i < kron.rows(); i++)
+              for (size_t j = 0; j < kron.cols(); j++)
+                for (size_t k = 0; k < bs; k++)
+                  df(i*bs+k, j*bs+k) += c * derivs.factor[s] * kron(i,j);
+            break;
+          }
+        default:
+          df += c * jacobian(s, derivs);
+        }
+    }
+
+    VectorView<double> slotValue (int s, VectorView<double> x, double * values) const
+    {
+      const Slot & slot = m_slots[s];
+      if (s == 0) return x;
+      if (slot.constant) return slot.constant->get();
+      return VectorView<double> (slot.size, values+slot.offset);
+    }
+
+    void linearCombination (const std::vector<Term> & terms, VectorView<double> x,
+                            double * values, VectorView<double> f) const
+    {
+      f = 0.0;
+      for (auto & t : terms)
+        f += t.coef.get() * slotValue(t.slot, x, values);
+    }
+
+    int newSlot (size_t size, Structure deriv)
+    {
+      Slot slot { size, deriv };
+      slot.offset = m_valuesize;
+      m_valuesize += size;
+      m_slots.push_back(slot);
+      return m_slots.size()-1;
+    }
+
+    // store a linear combination in a slot, emits no code for a single plain slot
+    int materialize (const std::vector<Term> & terms, size_t size)
+    {
+      if (terms.size() == 1 && terms[0].coef.val == 1 && terms[0].coef.params.empty())
+        return terms[0].slot;
+
+      int out = newSlot(size, combinationStructure(terms));
+      m_tape.push_back( { Instruction::LINCOMB, out, nullptr, -1, terms } );
+      for (auto & t : terms)
+        m_slots[t.slot].uses++;
+      return out;
+    }
+
+    // structure of the derivative of a kernel with structure sk applied to a slot of structure tin
+    static Structure kernelStructure (Structure sk, Structure tin)
+    {
+      if (sk == JacobianStructure::ZERO || tin == JacobianStructure::ZERO)
+        return JacobianStructure::ZERO;
+      if (sk == JacobianStructure::IDENTITY)
+        return tin;
+      if (tin == JacobianStructure::IDENTITY &&
+          (sk == JacobianStructure::DIAGONAL || sk == JacobianStructure::KRONECKER))
+        return sk;
+      if (tin == JacobianStructure::DIAGONAL && sk == JacobianStructure::DIAGONAL)
+        return JacobianStructure::DIAGONAL;
+      return JacobianStructure::GENERAL;
+    }
+
+    // structure of a linear combination: sums of identities and diagonals
+    // keep theirs, a single Kronecker term as well, all else is general
+    Structure combinationStructure (const std::vector<Term> & terms) const
+    {
+      Structure s = JacobianStructure::ZERO;
+      int nonzero = 0;
+      for (auto & t : terms)
+        {
+          Structure ts = m_slots[t.slot].deriv;
+          if (ts == JacobianStructure::ZERO) continue;
+          nonzero++;
+          if (s == JacobianStructure::ZERO || s == ts)
+            s = ts;
+          else if ((s == JacobianStructure::IDENTITY || s == JacobianStructure::DIAGONAL) &&
+                   (ts == JacobianStructure::IDENTITY || ts == JacobianStructure::DIAGONAL))
+            s = JacobianStructure::DIAGONAL;
+          else
+            s = JacobianStructure::GENERAL;
+        }
+      if (s == JacobianStructure::KRONECKER && nonzero > 1)
+        return JacobianStructure::GENERAL;
+      if (s == JacobianStructure::BLOCKDIAGONAL)
+        return JacobianStructure::GENERAL;
+      return s;
+    }
+
+    // returns f(input) as linear combination of slots
+    std::vector<Term> lower (const NonlinearFunction * f, int input)
+    {
+      auto key = std::make_pair(f, input);
+      auto known = m_lowered.find(key);
+      if (known != m_lowered.end())
+        return known->second;
+      auto terms = lowerNode (f, input);
+      m_lowered[key] = terms;
+      return terms;
+    }
+
+    std::vector<Term> lowerNode (const NonlinearFunction * f, int input)
+    {
+      if (dynamic_cast<const IdentityFunction*>(f))
+        return { Term{ Coefficient(), input } };
+
+      if (auto cf = dynamic_cast<const ConstantFunction*>(f))
+        {
+          Slot slot { cf->dimF(), JacobianStructure::ZERO, cf };
+          m_slots.push_back(slot);
+          return { Term{ Coefficient(), int(m_slots.size()-1) } };
+        }
+
+      if (auto sf = dynamic_cast<const SumFunction*>(f))
+        {
+          auto terms = lower (sf->fa().get(), input);
+          for (auto & t : terms) t.coef.val *= sf->faca();
+          auto termsb = lower (sf->fb().get(), input);
+          for (auto & t : termsb)
+            {
+              t.coef.val *= sf->facb();
+              terms.push_back(t);
+            }
+          return terms;
+        }
+
+      if (auto sf = dynamic_cast<const ScaleFunction*>(f))
+        {
+          auto terms = lower (sf->fa().get(), input);
+          for (auto & t : terms)
+            t.coef.params.push_back(sf->parameter().get());
+          return terms;
+        }
+
+      if (auto cf = dynamic_cast<const ComposeFunction*>(f))
+        {
+          auto inner = lower (cf->fb().get(), input);
+          int slot = materialize (inner, cf->fb()->dimF());
+          return lower (cf->fa().get(), slot);
+        }
+
+      // opaque kernel
+      int out = newSlot(f->dimF(), kernelStructure(f->derivStructure().type, m_slots[input].deriv));
+      m_slots[input].uses++;
+      m_tape.push_back( { Instruction::KERNEL, out, f, input, {} } );
+      return { Term{ Coefficient(), out } };
+    }
+  };
+
+
+  inline std::shared_ptr<CompiledFunction> compile (std::shared_ptr<NonlinearFunction> f)
+  {
+    return std::make_shared<CompiledFunction> (f);
+  }
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+
+namespace ASC_ode
+{
+
+  /*
+    Fixed set of worker threads taking tasks from a common queue.
+    submit returns a future, exceptions of the task are rethrown by its get().
+    parallelFor submits every index as a task, parallelForStealing one task
+    per worker which balance the load by stealing index ranges. Both wait
+    for their tasks and must not be called from a task of the same pool:
+    with all workers waiting, nothing runs the tasks (see isWorker).
+  */
+  class ThreadPool
+  {
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+
+  public:
+    explicit ThreadPool (size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+      for (size_t i = 0; i < threads; i++)
+        m_workers.emplace_back([this] { work(); });
+    }
+
+    ThreadPool (const ThreadPool &) = delete;
+    ThreadPool & operator= (const ThreadPool &) = delete;
+
+    ~ThreadPool ()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      for (auto & w : m_workers)
+        w.join();
+    }
+
+    size_t size() const { return m_workers.size(); }
+
+    // is the calling thread one of the workers of this pool
+    bool isWorker() const { return current() == this; }
+
+    std::future<void> submit (std::function<void()> task)
+    {
+      auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+      auto future = packaged->get_future();
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back([packaged] { (*packaged)(); });
+      }
+      m_cv.notify_one();
+      return future;
+    }
+
+    // func(i) for i = 0 .. n-1, waits for all of them, the first exception is rethrown
+    void parallelFor (size_t n, std::function<void(size_t)> func)
+    {
+      std::vector<std::future<void>> futures;
+      futures.reserve(n);
+      for (size_t i = 0; i < n; i++)
+        futures.push_back(submit([&func, i] { func(i); }));
+      for (auto & f : futures)
+        f.wait();
+      for (auto & f : futures)
+        f.get();
+    }
+
+    /*
+      func(i, worker) for i = 0 .. n-1 with one task per worker: every worker
+      owns a contiguous range of indices and takes them from the front, an
+      idle worker steals the upper half of the largest remaining range.
+      worker < size() identifies the task, e.g. for per worker scratch memory.
+    */
+    void parallelForStealing (size_t n, std::function<void(size_t,size_t)> func)
+    {
+      struct Range
+      {
+        std::mutex mutex;
+        size_t begin = 0, end = 0;
+      };
+      size_t p = std::min(size(), n);
+      std::vector<Range> ranges(p);
+      for (size_t w = 0; w < p; w++)
+        {
+          ranges[w].begin = w*n/p;
+          ranges[w].end = (w+1)*n/p;
+        }
+
+      auto next = [&ranges, p](size_t w, size_t & i)
+      {
+        while (true)
+          {
+            {
+              std::lock_guard<std::mutex> lock(ranges[w].mutex);
+              if (ranges[w].begin < ranges[w].end)
+                {
+                  i = ranges[w].begin++;
+                  return true;
+                }
+            }
+
+            size_t victim = p, most = 0;
+            for (size_t v = 0; v < p; v++)
+              if (v != w)
+                {
+                  std::lock_guard<std::mutex> lock(ranges[v].mutex);
+                  if (ranges[v].end - ranges[v].begin > most)
+                    {
+                      most = ranges[v].end - ranges[v].begin;
+                      victim = v;
+                    }
+                }
+            if (victim == p) return false;
+
+            size_t first, last;
+            {
+              std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+              if (ranges[victim].begin == ranges[victim].end) continue;
+              last = ranges[victim].end;
+              first = ranges[victim].begin + (last - ranges[victim].begin) / 2;
+              ranges[victim].end = first;
+            }
+            std::lock_guard<std::mutex> lock(ranges[w].mutex);
+            ranges[w].begin = first;
+            ranges[w].end = last;
+          }
+      };
+
+      std::vector<std::future<void>> futures;
+      futures.reserve(p);
+      for (size_t w = 0; w < p; w++)
+        futures.push_back(submit([&func, &next, w]
+        {
+          size_t i;
+          while (next(w, i))
+            func(i, w);
+        }));
+      for (auto & f : futures)
+        f.wait();
+      for (auto & f : futures)
+        f.get();
+    }
+
+  private:
+    static const ThreadPool *& current ()
+    {
+      thread_local const ThreadPool * pool = nullptr;
+      return pool;
+    }
+
+    void work ()
+    {
+      current() = this;
+      while (true)
+        {
+          std::function<void()> task;
+          {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty()) return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+          }
+          task();
+        }
+    }
+  };
+
+} // namespace ASC_ode
+
+#endif // THREADPOOL_HPP
@@ -3,6 +3,10 @@
 
 #include <functional>
 #include <exception>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <algorithm>
 
 #include "Newton.hpp"
 
@@ -18,6 +22,14 @@ namespace ASC_ode
     TimeStepper(std::shared_ptr<NonlinearFunction> rhs) : m_rhs(rhs) {}
     virtual ~TimeStepper() = default;
     virtual void DoStep(double tau, VectorView<double> y) = 0;
+
+    // continuous extension of the last step taken, valid until the next step:
+    // y is set to the solution at t_old + theta*tau, 0 <= theta <= 1
+    virtual bool hasDenseOutput() const { return false; }
+    virtual void DenseOutput(double theta, VectorView<double> y)
+    {
+      throw std::logic_error("TimeStepper: no dense output for this method");
+    }
   };
 
   class ExplicitEuler : public TimeStepper
@@ -38,9 +50,11 @@ namespace ASC_ode
     std::shared_ptr<NonlinearFunction> m_equ;
     std::shared_ptr<Parameter> m_tau;
     std::shared_ptr<ConstantFunction> m_yold;
+    NewtonSolverContext m_newton;
   public:
     ImplicitEuler(std::shared_ptr<NonlinearFunction> rhs) 
-    : TimeStepper(rhs), m_tau(std::make_shared<Parameter>(0.0)) 
+    : TimeStepper(rhs), m_tau(std::make_shared<Parameter>(0.0)),
+      m_newton(rhs->dimX(), rhs->dimX())
     {
       m_yold = std::make_shared<ConstantFunction>(rhs->dimX());
       auto ynew = std::make_shared<IdentityFunction>(rhs->dimX());
@@ -51,12 +65,275 @@ namespace ASC_ode
     {
       m_yold->set(y);
       m_tau->set(tau);
-      NewtonSolver(m_equ, y);
+      m_newton.jacobianReuse().setStepSize(tau);
+      m_newton.solve(m_equ, y);
     }
+
+    JacobianReuse & jacobianReuse() { return m_newton.jacobianReuse(); }
   };
 
 
-  
+
+  // error tolerances, either one value for all components or one per component
+  class Tolerance
+  {
+    std::vector<double> m_rtol, m_atol;
+  public:
+    Tolerance (double rtol = 1e-6, double atol = 1e-8)
+      : m_rtol{rtol}, m_atol{atol} { }
+    Tolerance (std::vector<double> rtol, std::vector<double> atol)
+      : m_rtol(rtol), m_atol(atol) { }
+
+    double rtol (size_t i) const { return m_rtol.size() == 1 ? m_rtol[0] : m_rtol[i]; }
+    double atol (size_t i) const { return m_atol.size() == 1 ? m_atol[0] : m_atol[i]; }
+
+    // RMS norm of err, scaled by atol + rtol*max(|yold|,|ynew|) per component
+    double errorNorm (VectorView<double> err, VectorView<double> yold, VectorView<double> ynew) const
+    {
+      double sum = 0;
+      for (size_t i = 0; i < err.size(); i++)
+        {
+          double sc = atol(i) + rtol(i) * std::max(std::fabs(yold(i)), std::fabs(ynew(i)));
+          sum += (err(i)/sc) * (err(i)/sc);
+        }
+      return std::sqrt(sum / err.size());
+    }
+  };
+
+
+  /*
+    PI step size controller (Gustafsson), the new step size is
+    tau * safety * err^(-0.7/k) * errold^(0.4/k), where k is the order of the
+    error estimate plus one. After a rejection the step size is not increased.
+  */
+  class PIController
+  {
+    double m_safety, m_facmin, m_facmax;
+    double m_errold = 1e-4;
+    bool m_rejected = false;
+  public:
+    PIController (double safety = 0.9, double facmin = 0.2, double facmax = 5)
+      : m_safety(safety), m_facmin(facmin), m_facmax(facmax) { }
+
+    double accept (double tau, double err, int k)
+    {
+      err = std::max(err, 1e-10);
+      double fac = m_safety * std::pow(err, -0.7/k) * std::pow(m_errold, 0.4/k);
+      fac = std::clamp(fac, m_facmin, m_rejected ? 1.0 : m_facmax);
+      m_errold = err;
+      m_rejected = false;
+      return tau * fac;
+    }
+
+    double reject (double tau, double err, int k)
+    {
+      m_rejected = true;
+      if (!std::isfinite(err)) return tau * m_facmin;
+      return tau * std::max(m_facmin, m_safety * std::pow(err, -1.0/k));
+    }
+  };
+
+
+  /*
+    Time stepper with an error estimate. TryStep attempts a step of
+    size tau and returns the scaled error norm in err. If the step is
+    accepted (err <= 1) y is advanced, otherwise y is not changed.
+  */
+  class AdaptiveTimeStepper : public TimeStepper
+  {
+  protected:
+    Tolerance m_tol;
+    size_t m_evaluations = 0;    // right hand side evaluations
+  public:
+    AdaptiveTimeStepper (std::shared_ptr<NonlinearFunction> rhs, Tolerance tol = Tolerance())
+      : TimeStepper(rhs), m_tol(tol) { }
+
+    void setTolerance (Tolerance tol) { m_tol = tol; }
+    const Tolerance & tolerance() const { return m_tol; }
+    size_t evaluations() const { return m_evaluations; }
+
+    // the error estimate behaves like tau^errorOrder()
+    virtual int errorOrder() const = 0;
+    virtual bool TryStep (double tau, VectorView<double> y, double & err) = 0;
+
+    // steppers choosing their step size themselves (e.g. variable order)
+    // return it here after TryStep, 0 leaves the choice to the controller
+    virtual double proposedStepSize() const { return 0; }
+
+    // starting step size from the scaled size of y and f(y), Hairer-Wanner II.4
+    double initialStepSize (VectorView<double> y)
+    {
+      Vector<> f(y.size());
+      m_rhs->evaluate(y, f);
+      m_evaluations++;
+      double d0 = m_tol.errorNorm(y, y, y);
+      double d1 = m_tol.errorNorm(f, y, y);
+      if (d0 < 1e-5 || d1 < 1e-5) return 1e-6;
+      return 0.01 * d0 / d1;
+    }
+  };
+
+
+  struct StepStatistics
+  {
+    size_t accepted = 0;
+    size_t rejected = 0;
+    size_t evaluations = 0;
+  };
+
+
+  /*
+    Called after every step from told to t with the new state y. It may
+    move t and y back into the step, e.g. to a point of the dense output,
+    and returns true to end the integration there.
+  */
+  using StepControl = std::function<bool(double told, double & t, VectorView<double> y)>;
+
+  /*
+    The step loop of the drivers: from t0 to tend with adaptive step
+    sizes, starting with tau (chosen automatically if tau <= 0), or until
+    control ends it. Returns the time reached, y is the state there.
+  */
+  inline double IntegrateAdaptive (AdaptiveTimeStepper & stepper, double t0, double tend,
+                                   VectorView<double> y, double tau, StepControl control,
+                                   StepStatistics & stats, PIController controller = PIController())
+  {
+    size_t evals = stepper.evaluations();
+    if (tau <= 0) tau = std::min(stepper.initialStepSize(y), tend-t0);
+
+    double t = t0;
+    while (t < tend)
+      {
+        bool last = t + tau >= tend - 1e-12 * std::fabs(tend);
+        double h = last ? tend - t : tau;
+        double err;
+        int k = stepper.errorOrder();
+        if (stepper.TryStep(h, y, err))
+          {
+            double told = t;
+            t = last ? tend : t + h;
+            stats.accepted++;
+            if (control && control(told, t, y)) break;
+            tau = controller.accept(h, err, k);
+            if (stepper.proposedStepSize() > 0) tau = stepper.proposedStepSize();
+          }
+        else
+          {
+            stats.rejected++;
+            tau = controller.reject(h, err, k);
+            if (stepper.proposedStepSize() > 0) tau = stepper.proposedStepSize();
+            if (tau < 1e-14 * std::max(1.0, std::fabs(tend)))
+              throw std::domain_error("IntegrateAdaptive: step size too small");
+          }
+      }
+    stats.evaluations += stepper.evaluations() - evals;
+    return t;
+  }
+
+  // the same with constant step size tau, the last step ends at tend
+  inline double IntegrateFixed (TimeStepper & stepper, double tau, double t0, double tend,
+                                VectorView<double> y, StepControl control, StepStatistics & stats)
+  {
+    double t = t0;
+    while (t < tend)
+      {
+        double h = std::min(tau, tend-t);
+        stepper.DoStep(h, y);
+        double told = t;
+        t = t + h >= tend - 1e-12 * std::fabs(tend) ? tend : t + h;
+        stats.accepted++;
+        if (control && control(told, t, y)) break;
+      }
+    return t;
+  }
+
+
+  /*
+    Integrates from 0 to tend with adaptive step sizes, starting with tau
+    (chosen automatically if tau <= 0). callback(t, y) is called after
+    every accepted step.
+  */
+  inline StepStatistics SolveAdaptive (AdaptiveTimeStepper & stepper, double tend,
+                                       VectorView<double> y, double tau = 0,
+                                       std::function<void(double,VectorView<double>)> callback = nullptr,
+                                       PIController controller = PIController())
+  {
+    StepStatistics stats;
+    StepControl control;
+    if (callback)
+      control = [&](double, double & t, VectorView<double> ynew)
+      {
+        callback(t, ynew);
+        return false;
+      };
+    IntegrateAdaptive(stepper, 0, tend, y, tau, control, stats, controller);
+    return stats;
+  }
+
+
+  /*
+    Integrates from 0 to the last of the increasing output times and calls
+    output(t, y) at every output time. The solution between the steps
+    comes from the dense output, the step sizes do not depend on the
+    output times.
+  */
+  inline StepStatistics SolveDenseOutput (AdaptiveTimeStepper & stepper, const std::vector<double> & times,
+                                          VectorView<double> y,
+                                          std::function<void(double,VectorView<double>)> output,
+                                          double tau = 0, PIController controller = PIController())
+  {
+    if (!stepper.hasDenseOutput())
+      throw std::invalid_argument("SolveDenseOutput: stepper has no dense output");
+    if (times.empty()) return StepStatistics();
+
+    Vector<> yout(y.size());
+    size_t next = 0;
+    for ( ; next < times.size() && times[next] <= 0; next++)
+      output(times[next], y);
+
+    double told = 0;
+    auto callback = [&](double t, VectorView<double> ynew)
+    {
+      for ( ; next < times.size() && times[next] < t; next++)
+        {
+          stepper.DenseOutput((times[next]-told) / (t-told), yout);
+          output(times[next], yout);
+        }
+      for ( ; next < times.size() && times[next] == t; next++)
+        output(times[next], ynew);
+      told = t;
+    };
+    return SolveAdaptive(stepper, times.back(), y, tau, callback, controller);
+  }
+
+
+  // the same with constant step size tau
+  inline void SolveDenseOutput (TimeStepper & stepper, double tau, const std::vector<double> & times,
+                                VectorView<double> y,
+                                std::function<void(double,VectorView<double>)> output)
+  {
+    if (!stepper.hasDenseOutput())
+      throw std::invalid_argument("SolveDenseOutput: stepper has no dense output");
+    if (times.empty()) return;
+
+    Vector<> yout(y.size());
+    size_t next = 0;
+    for ( ; next < times.size() && times[next] <= 0; next++)
+      output(times[next], y);
+
+    StepStatistics stats;
+    IntegrateFixed(stepper, tau, 0, times.back(), y, [&](double told, double & t, VectorView<double> ynew)
+    {
+      for ( ; next < times.size() && times[next] < t; next++)
+        {
+          stepper.DenseOutput((times[next]-told) / (t-told), yout);
+          output(times[next], yout);
+        }
+      for ( ; next < times.size() && times[next] == t; next++)
+        output(times[next], ynew);
+      return false;
+    }, stats);
+  }
 
 }
 